@@ -0,0 +1,842 @@
+#include <cstring>
+#include <cctype>
+#include <climits>
+#include <algorithm>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+#include "annexb_stream.h"
+#include "mmap_input.h"
+#include "shared_registry.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define ANNEXB_SSE2
+#include <emmintrin.h>
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+extern "C"
+{
+#include "libavutil/buffer.h"
+}
+
+static constexpr int MAX_PARAM_SET_SIZE = 4096;   // 参数集长度上限(Byte), 超过的视为损坏
+
+#ifdef ANNEXB_SSE2
+static inline int lowest_bit(unsigned int mask)
+{
+#ifdef _MSC_VER
+	unsigned long i = 0;
+	_BitScanForward(&i, mask);
+	return int(i);
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+const uint8_t* FindStartCode(const uint8_t* p, const uint8_t* end)
+{
+#ifdef ANNEXB_SSE2
+	// 错开0、1、2字节各取16字节比较, 三个条件同时成立的位置即起始码
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi8(1);
+	while (end - p >= 18)
+	{
+		__m128i b0 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)), zero);
+		__m128i b1 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 1)), zero);
+		__m128i b2 = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 2)), one);
+		unsigned int mask = unsigned(_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(b0, b1), b2)));
+		if (mask != 0)
+		{
+			return p + lowest_bit(mask);
+		}
+		p += 16;
+	}
+#else
+	// 没有SSE2时用memchr查找01(C库通常已向量化), 再检查前两个字节
+	p = p + 2 <= end ? p + 2 : end;
+	while (p < end)
+	{
+		p = static_cast<const uint8_t*>(std::memchr(p, 1, size_t(end - p)));
+		if (p == NULL)
+		{
+			return end;
+		}
+		if (p[-1] == 0 && p[-2] == 0)
+		{
+			return p - 2;
+		}
+		p++;
+	}
+	return end;
+#endif
+
+	for (; end - p >= 3; p++)
+	{
+		if (p[0] == 0 && p[1] == 0 && p[2] == 1)
+		{
+			return p;
+		}
+	}
+
+	return end;
+}
+
+// RBSP比特读取, 越界后读出0并记录错误
+class BitReader
+{
+public:
+	BitReader(const uint8_t* data, size_t size) :m_data(data), m_bits(size * 8) {}
+
+	uint32_t u(int n)
+	{
+		uint32_t v = 0;
+		for (int i = 0; i < n; i++)
+		{
+			v = (v << 1) | bit();
+		}
+		return v;
+	}
+
+	// 无符号指数哥伦布码
+	uint32_t ue()
+	{
+		int zeros = 0;
+		while (bit() == 0)
+		{
+			if (++zeros >= 32)
+			{
+				m_error = true;
+				return 0;
+			}
+		}
+		return (1u << zeros) - 1 + u(zeros);
+	}
+
+	// 有符号指数哥伦布码
+	int32_t se()
+	{
+		uint32_t k = ue();
+		return (k & 1) ? int32_t((k + 1) / 2) : -int32_t(k / 2);
+	}
+
+	void skip(int n)
+	{
+		m_pos += size_t(n);
+	}
+
+	bool error() const { return m_error || m_pos > m_bits; }
+
+protected:
+	uint32_t bit()
+	{
+		if (m_pos >= m_bits)
+		{
+			m_pos++;
+			m_error = true;
+			return 0;
+		}
+		uint32_t v = (m_data[m_pos / 8] >> (7 - m_pos % 8)) & 1;
+		m_pos++;
+		return v;
+	}
+
+protected:
+	const uint8_t* m_data;
+	size_t m_bits;
+	size_t m_pos = 0;
+	bool m_error = false;
+};
+
+// 去掉防竞争字节(00 00 03中的03)
+static std::vector<uint8_t> to_rbsp(const uint8_t* nal, size_t size)
+{
+	std::vector<uint8_t> rbsp;
+	rbsp.reserve(size);
+	int zeros = 0;
+	for (size_t i = 0; i < size; i++)
+	{
+		if (zeros >= 2 && nal[i] == 3)
+		{
+			zeros = 0;
+			continue;
+		}
+		zeros = nal[i] == 0 ? zeros + 1 : 0;
+		rbsp.push_back(nal[i]);
+	}
+
+	return rbsp;
+}
+
+// 参数集中用到的信息: 宽高和VUI时间信息, 一帧时长 = units / scale 秒
+struct SpsInfo
+{
+	int width = 0;
+	int height = 0;
+	uint64_t units = 0;
+	uint64_t scale = 0;
+};
+
+// H.264缩放矩阵, 只跳过
+static void skip_h264_scaling_list(BitReader& br, int size)
+{
+	int last = 8;
+	int next = 8;
+	for (int i = 0; i < size; i++)
+	{
+		if (next != 0)
+		{
+			next = (last + br.se() + 256) % 256;
+		}
+		last = next == 0 ? last : next;
+	}
+}
+
+static bool parse_h264_sps(const std::vector<uint8_t>& rbsp, SpsInfo& sps)
+{
+	BitReader br(rbsp.data() + 1, rbsp.size() - 1);   // 跳过NAL头
+	int profile = int(br.u(8));
+	br.skip(16);   // constraint_set_flags, level_idc
+	br.ue();       // seq_parameter_set_id
+
+	uint32_t chroma = 1;
+	bool separate = false;
+	if (profile == 100 || profile == 110 || profile == 122 || profile == 244 || profile == 44 || profile == 83 || profile == 86
+		|| profile == 118 || profile == 128 || profile == 138 || profile == 139 || profile == 134 || profile == 135)
+	{
+		chroma = br.ue();
+		if (chroma == 3)
+		{
+			separate = br.u(1) != 0;
+		}
+		br.ue();   // bit_depth_luma_minus8
+		br.ue();   // bit_depth_chroma_minus8
+		br.u(1);   // qpprime_y_zero_transform_bypass_flag
+		if (br.u(1))
+		{
+			for (int i = 0; i < (chroma != 3 ? 8 : 12); i++)
+			{
+				if (br.u(1))
+				{
+					skip_h264_scaling_list(br, i < 6 ? 16 : 64);
+				}
+			}
+		}
+	}
+
+	br.ue();   // log2_max_frame_num_minus4
+	uint32_t pocType = br.ue();
+	if (pocType == 0)
+	{
+		br.ue();   // log2_max_pic_order_cnt_lsb_minus4
+	}
+	else if (pocType == 1)
+	{
+		br.u(1);
+		br.se();
+		br.se();
+		uint32_t cycle = br.ue();
+		if (cycle > 255)
+		{
+			return false;
+		}
+		for (uint32_t i = 0; i < cycle; i++)
+		{
+			br.se();
+		}
+	}
+
+	br.ue();   // max_num_ref_frames
+	br.u(1);   // gaps_in_frame_num_value_allowed_flag
+	uint32_t widthMbs = br.ue() + 1;
+	uint32_t heightMapUnits = br.ue() + 1;
+	uint32_t frameMbsOnly = br.u(1);
+	if (!frameMbsOnly)
+	{
+		br.u(1);   // mb_adaptive_frame_field_flag
+	}
+	br.u(1);   // direct_8x8_inference_flag
+
+	uint32_t crop[4] = { 0, 0, 0, 0 };
+	if (br.u(1))
+	{
+		for (uint32_t& c : crop)
+		{
+			c = br.ue();
+		}
+	}
+
+	if (br.error() || widthMbs > 1024 || heightMapUnits > 1024)
+	{
+		return false;
+	}
+
+	// 裁剪单位: 4:2:0为2x2, 4:2:2为2x1, 场编码时纵向加倍
+	bool mono = chroma == 0 || separate;
+	uint32_t cropX = mono || chroma == 3 ? 1 : 2;
+	uint32_t cropY = (mono || chroma != 1 ? 1 : 2) * (2 - frameMbsOnly);
+	sps.width = int(widthMbs * 16) - int(cropX * (crop[0] + crop[1]));
+	sps.height = int((2 - frameMbsOnly) * heightMapUnits * 16) - int(cropY * (crop[2] + crop[3]));
+
+	if (br.u(1))   // vui_parameters_present_flag
+	{
+		if (br.u(1) && br.u(8) == 255)   // aspect_ratio_info
+		{
+			br.skip(32);
+		}
+		if (br.u(1))   // overscan_info
+		{
+			br.u(1);
+		}
+		if (br.u(1))   // video_signal_type
+		{
+			br.skip(4);
+			if (br.u(1))
+			{
+				br.skip(24);
+			}
+		}
+		if (br.u(1))   // chroma_loc_info
+		{
+			br.ue();
+			br.ue();
+		}
+		if (br.u(1))   // timing_info: num_units_in_tick按场计, 一帧为两个tick
+		{
+			sps.units = uint64_t(br.u(32)) * 2;
+			sps.scale = br.u(32);
+		}
+	}
+
+	return !br.error() && sps.width > 0 && sps.height > 0;
+}
+
+// H.265 profile_tier_level, 只跳过
+static void skip_hevc_ptl(BitReader& br, uint32_t maxSubLayersMinus1)
+{
+	br.skip(96);   // general_profile/tier/level
+	bool profile[8] = {};
+	bool level[8] = {};
+	for (uint32_t i = 0; i < maxSubLayersMinus1; i++)
+	{
+		profile[i] = br.u(1) != 0;
+		level[i] = br.u(1) != 0;
+	}
+	if (maxSubLayersMinus1 > 0)
+	{
+		br.skip(2 * (8 - int(maxSubLayersMinus1)));
+	}
+	for (uint32_t i = 0; i < maxSubLayersMinus1; i++)
+	{
+		br.skip((profile[i] ? 88 : 0) + (level[i] ? 8 : 0));
+	}
+}
+
+// H.265 VPS: 只取vps_timing_info, SPS中没有VUI时间信息时使用
+static bool parse_hevc_vps(const std::vector<uint8_t>& rbsp, SpsInfo& vps)
+{
+	BitReader br(rbsp.data() + 2, rbsp.size() - 2);
+	br.skip(12);   // vps_video_parameter_set_id, base_layer_internal/available, max_layers_minus1
+	uint32_t maxSub = br.u(3);
+	br.skip(17);   // temporal_id_nesting, reserved_0xffff_16bits
+	skip_hevc_ptl(br, maxSub);
+
+	bool ordering = br.u(1) != 0;
+	for (uint32_t i = ordering ? 0 : maxSub; i <= maxSub; i++)
+	{
+		br.ue();
+		br.ue();
+		br.ue();
+	}
+
+	uint32_t maxLayerId = br.u(6);
+	uint32_t layerSets = br.ue();
+	if (layerSets > 1023)
+	{
+		return false;
+	}
+	br.skip(int(layerSets * (maxLayerId + 1)));
+
+	if (br.u(1))
+	{
+		vps.units = br.u(32);
+		vps.scale = br.u(32);
+	}
+
+	return !br.error() && vps.units > 0;
+}
+
+static bool parse_hevc_sps(const std::vector<uint8_t>& rbsp, SpsInfo& sps)
+{
+	BitReader br(rbsp.data() + 2, rbsp.size() - 2);   // 跳过2字节NAL头
+	br.skip(4);    // sps_video_parameter_set_id
+	uint32_t maxSub = br.u(3);
+	br.u(1);       // sps_temporal_id_nesting_flag
+	if (maxSub > 6)
+	{
+		return false;
+	}
+	skip_hevc_ptl(br, maxSub);
+
+	br.ue();   // sps_seq_parameter_set_id
+	uint32_t chroma = br.ue();
+	if (chroma == 3)
+	{
+		br.u(1);   // separate_colour_plane_flag
+	}
+	uint32_t width = br.ue();
+	uint32_t height = br.ue();
+	uint32_t window[4] = { 0, 0, 0, 0 };
+	if (br.u(1))   // conformance_window_flag
+	{
+		for (uint32_t& w : window)
+		{
+			w = br.ue();
+		}
+	}
+
+	if (br.error() || width > 16384 || height > 16384)
+	{
+		return false;
+	}
+
+	uint32_t subWidth = chroma == 1 || chroma == 2 ? 2 : 1;
+	uint32_t subHeight = chroma == 1 ? 2 : 1;
+	sps.width = int(width) - int(subWidth * (window[0] + window[1]));
+	sps.height = int(height) - int(subHeight * (window[2] + window[3]));
+
+	br.ue();   // bit_depth_luma_minus8
+	br.ue();   // bit_depth_chroma_minus8
+	uint32_t pocLsbBits = br.ue() + 4;
+	bool ordering = br.u(1) != 0;
+	for (uint32_t i = ordering ? 0 : maxSub; i <= maxSub; i++)
+	{
+		br.ue();
+		br.ue();
+		br.ue();
+	}
+	for (int i = 0; i < 6; i++)   // 编码块和变换块尺寸, 变换层次
+	{
+		br.ue();
+	}
+
+	if (br.u(1) && br.u(1))   // scaling_list_enabled_flag, sps_scaling_list_data_present_flag
+	{
+		for (int sizeId = 0; sizeId < 4; sizeId++)
+		{
+			for (int matrixId = 0; matrixId < 6; matrixId += sizeId == 3 ? 3 : 1)
+			{
+				if (!br.u(1))
+				{
+					br.ue();   // scaling_list_pred_matrix_id_delta
+					continue;
+				}
+
+				int coefNum = std::min(64, 1 << (4 + (sizeId << 1)));
+				if (sizeId > 1)
+				{
+					br.se();
+				}
+				for (int i = 0; i < coefNum; i++)
+				{
+					br.se();
+				}
+			}
+		}
+	}
+
+	br.u(1);   // amp_enabled_flag
+	br.u(1);   // sample_adaptive_offset_enabled_flag
+	if (br.u(1))   // pcm_enabled_flag
+	{
+		br.skip(8);
+		br.ue();
+		br.ue();
+		br.u(1);
+	}
+
+	// 短期参考图像集, 帧间预测的集合需要被参考集合的delta数量
+	uint32_t setCount = br.ue();
+	if (setCount > 64)
+	{
+		return false;
+	}
+	std::vector<uint32_t> deltaCount(setCount, 0);
+	for (uint32_t idx = 0; idx < setCount; idx++)
+	{
+		if (idx != 0 && br.u(1))
+		{
+			br.u(1);   // delta_rps_sign
+			br.ue();   // abs_delta_rps_minus1
+			uint32_t count = 0;
+			for (uint32_t j = 0; j <= deltaCount[idx - 1]; j++)
+			{
+				bool used = br.u(1) != 0;
+				if (used || br.u(1))
+				{
+					count++;
+				}
+			}
+			deltaCount[idx] = count;
+		}
+		else
+		{
+			uint32_t negative = br.ue();
+			uint32_t positive = br.ue();
+			if (negative > 16 || positive > 16)
+			{
+				return false;
+			}
+			for (uint32_t i = 0; i < negative + positive; i++)
+			{
+				br.ue();
+				br.u(1);
+			}
+			deltaCount[idx] = negative + positive;
+		}
+	}
+
+	if (br.u(1))   // long_term_ref_pics_present_flag
+	{
+		uint32_t count = br.ue();
+		if (count > 32)
+		{
+			return false;
+		}
+		br.skip(int(count * (pocLsbBits + 1)));
+	}
+
+	br.u(1);   // sps_temporal_mvp_enabled_flag
+	br.u(1);   // strong_intra_smoothing_enabled_flag
+	if (br.u(1))   // vui_parameters_present_flag
+	{
+		if (br.u(1) && br.u(8) == 255)   // aspect_ratio_info
+		{
+			br.skip(32);
+		}
+		if (br.u(1))   // overscan_info
+		{
+			br.u(1);
+		}
+		if (br.u(1))   // video_signal_type
+		{
+			br.skip(4);
+			if (br.u(1))
+			{
+				br.skip(24);
+			}
+		}
+		if (br.u(1))   // chroma_loc_info
+		{
+			br.ue();
+			br.ue();
+		}
+		br.skip(3);    // neutral_chroma, field_seq, frame_field_info
+		if (br.u(1))   // default_display_window
+		{
+			br.ue();
+			br.ue();
+			br.ue();
+			br.ue();
+		}
+		if (br.u(1))   // vui_timing_info
+		{
+			sps.units = br.u(32);
+			sps.scale = br.u(32);
+		}
+	}
+
+	// VUI之后的字段用不到, 只要求宽高有效; 时间信息解析失败时不使用
+	if (br.error())
+	{
+		sps.units = 0;
+		sps.scale = 0;
+	}
+	return sps.width > 0 && sps.height > 0;
+}
+
+static void free_mapping(void* opaque, uint8_t*)
+{
+	delete static_cast<std::shared_ptr<const uint8_t>*>(opaque);
+}
+
+AnnexBStream::~AnnexBStream()
+{
+	av_buffer_unref(&m_buffer);
+	avcodec_parameters_free(&m_codecpar);
+}
+
+// 按扩展名确定编码格式, 不是裸流返回AV_CODEC_ID_NONE
+static AVCodecID annexb_codec(const std::string& path)
+{
+	std::string ext = std::filesystem::path(path).extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+	if (ext == ".h264" || ext == ".264" || ext == ".avc")
+	{
+		return AV_CODEC_ID_H264;
+	}
+	if (ext == ".h265" || ext == ".265" || ext == ".hevc")
+	{
+		return AV_CODEC_ID_HEVC;
+	}
+
+	return AV_CODEC_ID_NONE;
+}
+
+bool AnnexBStream::is_annexb(const std::string& path)
+{
+	return annexb_codec(path) != AV_CODEC_ID_NONE;
+}
+
+std::shared_ptr<const AnnexBStream> AnnexBStream::open(const std::string& path)
+{
+	if (!is_annexb(path))
+	{
+		return nullptr;
+	}
+
+	// 同一文件的索引由所有使用者共享, 最后一个使用者释放时解除映射; 建立索引需要扫描整个文件, 在注册表锁外进行
+	static SharedRegistry<const AnnexBStream> streams;
+	return streams.get(path, [&path]() -> std::shared_ptr<const AnnexBStream>
+		{
+			std::shared_ptr<AnnexBStream> stream(new AnnexBStream);
+			int ret = stream->index(path, annexb_codec(path));
+			if (ret != 0)
+			{
+				spdlog::warn("Index Annex-B stream {} failed: {}, fall back to ffmpeg", path, ret);
+				return nullptr;
+			}
+
+			spdlog::info("Index Annex-B stream {}: {} frames, {}/{} fps", path, stream->size(), stream->m_frameRate.num, stream->m_frameRate.den);
+			return stream;
+		});
+}
+
+int AnnexBStream::index(const std::string& path, AVCodecID codecId)
+{
+	m_data = MapInputFile(path, &m_bytes);
+	if (!m_data)
+	{
+		return 10;
+	}
+
+	const bool hevc = codecId == AV_CODEC_ID_HEVC;
+	const uint8_t* data = m_data.get();
+	const uint8_t* end = data + m_bytes;
+
+	SpsInfo sps;
+	SpsInfo vps;
+	bool hasSps = false;
+	bool keySeen = false;                  // 第一个关键帧之后不再收集参数集
+	std::vector<std::string> paramSets;    // 第一个关键帧之前的参数集, 去重
+	Frame frame;
+	frame.offset = -1;
+	bool hasVcl = false;                   // 当前访问单元是否已有片数据
+
+	// 逐个NAL单元: 遇到新访问单元的起点(参数集/AUD/SEI或新图像的第一个片)时结束上一帧
+	const uint8_t* code = FindStartCode(data, end);
+	while (code < end)
+	{
+		const uint8_t* nal = code + 3;
+		const uint8_t* next = FindStartCode(nal, end);
+		const uint8_t* nalEnd = next;
+		while (nalEnd > nal && nalEnd[-1] == 0)
+		{
+			nalEnd--;
+		}
+		size_t nalSize = size_t(nalEnd - nal);
+		int64_t start = (code > data && code[-1] == 0 ? code - 1 : code) - data;   // 4字节起始码从前导0开始
+		code = next;
+
+		if (nalSize < (hevc ? 2u : 1u))
+		{
+			continue;
+		}
+
+		int type = 0;
+		bool vcl = false;        // 片数据
+		bool first = false;      // 图像的第一个片
+		bool begin = false;      // 只能出现在访问单元开头的非VCL单元
+		bool key = false;
+		bool param = false;      // VPS/SPS/PPS
+		if (hevc)
+		{
+			type = (nal[0] >> 1) & 0x3F;
+			vcl = type < 32;
+			first = vcl && nalSize > 2 && (nal[2] & 0x80);
+			begin = (type >= 32 && type <= 35) || type == 39 || (type >= 41 && type <= 44) || (type >= 48 && type <= 55);
+			key = type >= 16 && type <= 23;
+			param = type >= 32 && type <= 34;
+		}
+		else
+		{
+			type = nal[0] & 0x1F;
+			vcl = type >= 1 && type <= 5;
+			first = vcl && nalSize > 1 && (nal[1] & 0x80);   // first_mb_in_slice为0
+			begin = (type >= 6 && type <= 9) || (type >= 14 && type <= 18);
+			key = type == 5;   // 只有IDR可以作为起点, 恢复点SEI之后的帧可能参考之前的帧
+			param = type == 7 || type == 8;
+		}
+
+		if (hasVcl && (begin || first))
+		{
+			frame.size = int(start - frame.offset);
+			m_frames.push_back(frame);
+			frame = Frame();
+			frame.offset = -1;
+			hasVcl = false;
+		}
+
+		if (frame.offset < 0)
+		{
+			frame.offset = start;
+		}
+		frame.key = frame.key || key;
+		hasVcl = hasVcl || vcl;
+		keySeen = keySeen || (vcl && frame.key);
+
+		if (!param || keySeen || nalSize > size_t(MAX_PARAM_SET_SIZE))
+		{
+			continue;
+		}
+
+		std::string set(reinterpret_cast<const char*>(nal), nalSize);
+		if (std::find(paramSets.begin(), paramSets.end(), set) != paramSets.end())
+		{
+			continue;
+		}
+		paramSets.push_back(set);
+
+		if (hevc && type == 32 && vps.units == 0)
+		{
+			parse_hevc_vps(to_rbsp(nal, nalSize), vps);
+		}
+		else if (!hasSps && type == (hevc ? 33 : 7))
+		{
+			hasSps = hevc ? parse_hevc_sps(to_rbsp(nal, nalSize), sps) : parse_h264_sps(to_rbsp(nal, nalSize), sps);
+		}
+	}
+
+	if (hasVcl)
+	{
+		frame.size = int(m_bytes - frame.offset);
+		m_frames.push_back(frame);
+	}
+
+	if (!hasSps || m_frames.empty())
+	{
+		return 20;
+	}
+
+	// 帧率取SPS VUI, 其次VPS, 超出合理范围时按25
+	const SpsInfo& timing = sps.units > 0 ? sps : vps;
+	AVRational rate = { 0, 1 };
+	if (timing.units > 0 && timing.scale > 0)
+	{
+		av_reduce(&rate.num, &rate.den, int64_t(timing.scale), int64_t(timing.units), INT_MAX);
+	}
+	if (av_q2d(rate) >= 1 && av_q2d(rate) <= 1000)
+	{
+		m_frameRate = rate;
+	}
+
+	std::string extradata;
+	for (const std::string& set : paramSets)
+	{
+		extradata.append("\0\0\0\1", 4);
+		extradata += set;
+	}
+
+	m_codecpar = avcodec_parameters_alloc();
+	if (m_codecpar == NULL)
+	{
+		return 30;
+	}
+	m_codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+	m_codecpar->codec_id = codecId;
+	m_codecpar->width = sps.width;
+	m_codecpar->height = sps.height;
+	m_codecpar->extradata = static_cast<uint8_t*>(av_mallocz(extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+	if (m_codecpar->extradata == NULL)
+	{
+		return 30;
+	}
+	std::memcpy(m_codecpar->extradata, extradata.data(), extradata.size());
+	m_codecpar->extradata_size = int(extradata.size());
+
+	// 整个映射作为一个只读缓冲区, 帧引用它; 最后一个帧释放后才解除映射
+	std::shared_ptr<const uint8_t>* holder = new std::shared_ptr<const uint8_t>(m_data);
+#if LIBAVUTIL_VERSION_MAJOR >= 57
+	m_buffer = av_buffer_create(const_cast<uint8_t*>(data), size_t(m_bytes), free_mapping, holder, AV_BUFFER_FLAG_READONLY);
+#else
+	m_buffer = av_buffer_create(const_cast<uint8_t*>(data), int(std::min<int64_t>(m_bytes, INT_MAX)), free_mapping, holder, AV_BUFFER_FLAG_READONLY);
+#endif
+	if (m_buffer == NULL)
+	{
+		delete holder;
+		return 30;
+	}
+
+	return 0;
+}
+
+double AnnexBStream::duration() const
+{
+	return m_frames.size() / av_q2d(m_frameRate);
+}
+
+double AnnexBStream::gop_duration() const
+{
+	int64_t first = -1;
+	for (size_t i = 0; i < m_frames.size(); i++)
+	{
+		if (!m_frames[i].key)
+		{
+			continue;
+		}
+
+		if (first >= 0)
+		{
+			return (int64_t(i) - first) / av_q2d(m_frameRate);
+		}
+		first = int64_t(i);
+	}
+
+	return 0;
+}
+
+int AnnexBStream::make_packet(size_t i, AVPacket* packet) const
+{
+	const Frame& frame = m_frames[i];
+
+	// 解析器可能越过帧尾读取填充区, 文件末尾的帧后面没有可读数据, 复制到带填充的缓冲区
+	if (frame.offset + frame.size + AV_INPUT_BUFFER_PADDING_SIZE > m_bytes)
+	{
+		int ret = av_new_packet(packet, frame.size);
+		if (ret < 0)
+		{
+			return ret;
+		}
+		std::memcpy(packet->data, m_data.get() + frame.offset, size_t(frame.size));
+	}
+	else
+	{
+		packet->buf = av_buffer_ref(m_buffer);
+		if (packet->buf == NULL)
+		{
+			return AVERROR(ENOMEM);
+		}
+		packet->data = packet->buf->data + frame.offset;
+		packet->size = frame.size;
+	}
+
+	packet->pts = int64_t(i);
+	packet->dts = int64_t(i);
+	packet->duration = 1;
+	packet->stream_index = 0;
+	packet->flags = frame.key ? AV_PKT_FLAG_KEY : 0;
+
+	return 0;
+}
\ No newline at end of file
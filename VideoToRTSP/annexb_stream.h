@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+extern "C"
+{
+#include "libavformat/avformat.h"
+};
+
+// 查找Annex-B起始码(00 00 01), 返回起始码的位置, 找不到返回end; 支持SSE2时每次比较16字节
+const uint8_t* FindStartCode(const uint8_t* p, const uint8_t* end);
+
+// H.264/H.265 Annex-B裸流(.h264/.h265等)
+// 文件映射到内存, 一次扫描起始码切分访问单元并建立帧/关键帧索引, 帧率取自SPS(或VPS)的VUI时间信息
+// 推流时帧直接引用映射内存, 不经过ffmpeg解复用和解析器, 也不复制数据; 同一文件的索引由所有使用者共享
+class AnnexBStream
+{
+public:
+	// 一个访问单元(一帧), 含起始码
+	struct Frame
+	{
+		int64_t offset = 0;  // 在文件中的位置
+		int size = 0;        // 长度(Byte)
+		bool key = false;    // IDR(H.264)/IRAP(H.265)帧
+	};
+
+	~AnnexBStream();
+
+	AnnexBStream(const AnnexBStream&) = delete;
+	AnnexBStream& operator=(const AnnexBStream&) = delete;
+
+	static bool is_annexb(const std::string& path);  // 按扩展名判断是否按裸流处理
+	static std::shared_ptr<const AnnexBStream> open(const std::string& path);  // 不是裸流或没有参数集时返回nullptr
+
+	const AVCodecParameters* codecpar() const { return m_codecpar; }  // 编码格式、宽高, extradata为Annex-B参数集
+	AVRational frame_rate() const { return m_frameRate; }            // VUI中没有时间信息时为25
+	AVRational time_base() const { return av_inv_q(m_frameRate); }   // 帧时间戳以帧为单位
+	size_t size() const { return m_frames.size(); }
+	const Frame& at(size_t i) const { return m_frames[i]; }
+	int64_t bytes() const { return m_bytes; }                        // 文件长度(Byte)
+	double duration() const;                                          // 帧数 / 帧率(秒)
+	double gop_duration() const;                                      // 前两个关键帧的间隔(秒), 只有一个关键帧时返回0
+
+	// 取第i帧: 引用映射内存, DTS=PTS=i(裸流没有显示时间戳, 按解码顺序); 成功返回0
+	int make_packet(size_t i, AVPacket* packet) const;
+
+protected:
+	AnnexBStream() = default;
+	int index(const std::string& path, AVCodecID codecId);   // 成功返回0
+
+protected:
+	std::shared_ptr<const uint8_t> m_data;   // 文件映射
+	AVBufferRef* m_buffer = NULL;            // 覆盖整个映射的缓冲区, 帧以引用方式共享
+	AVCodecParameters* m_codecpar = NULL;
+	AVRational m_frameRate = { 25, 1 };
+	std::vector<Frame> m_frames;
+	int64_t m_bytes = 0;
+};
\ No newline at end of file
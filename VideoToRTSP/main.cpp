@@ -2,6 +2,10 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/basic_file_sink.h>
 #include "video_to_rtsp.h"
+#include "video_info_cache.h"
+#include "metrics.h"
+
+static constexpr int METRICS_PORT = 9101;  // 指标服务端口, 只监听本机
 
 int main(int argc, char* argv[])
 {
@@ -11,8 +15,17 @@ int main(int argc, char* argv[])
 	spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%l] %v");
 
 	QApplication a(argc, argv);
+
+	// 视频信息缓存, 与程序放在同一目录
+	VideoInfoCache::instance().load((QCoreApplication::applicationDirPath() + "/VideoToRTSP.cache").toLocal8Bit().toStdString());
+	// 推流指标: http://127.0.0.1:9101/metrics, 每分钟输出一次日志摘要
+	MetricsServer::instance().start(METRICS_PORT, 60);
+
 	VideoToRTSP w;
 	w.show();
 
-	return a.exec();
+	int ret = a.exec();
+	MetricsServer::instance().stop();
+
+	return ret;
 }
\ No newline at end of file
@@ -0,0 +1,356 @@
+#include <chrono>
+#include <filesystem>
+#include <spdlog/spdlog.h>
+#include "metrics.h"
+
+void Histogram::observe(int64_t us)
+{
+	size_t i = 0;
+	while (i < BOUNDS.size() && us > BOUNDS[i])
+	{
+		i++;
+	}
+
+	m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(us, std::memory_order_relaxed);
+}
+
+void Histogram::reset()
+{
+	for (auto& bucket : m_buckets)
+	{
+		bucket.store(0, std::memory_order_relaxed);
+	}
+
+	m_count.store(0, std::memory_order_relaxed);
+	m_sum.store(0, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::count() const
+{
+	return m_count.load(std::memory_order_relaxed);
+}
+
+int64_t Histogram::sum() const
+{
+	return m_sum.load(std::memory_order_relaxed);
+}
+
+uint64_t Histogram::bucket(size_t i) const
+{
+	return m_buckets[i].load(std::memory_order_relaxed);
+}
+
+int64_t Histogram::quantile(double q) const
+{
+	uint64_t total = 0;
+	std::array<uint64_t, BOUNDS.size() + 1> counts;
+	for (size_t i = 0; i < counts.size(); i++)
+	{
+		counts[i] = bucket(i);
+		total += counts[i];
+	}
+
+	if (total == 0)
+	{
+		return 0;
+	}
+
+	uint64_t target = uint64_t(q * total + 0.5);
+	uint64_t cumulative = 0;
+	for (size_t i = 0; i < BOUNDS.size(); i++)
+	{
+		cumulative += counts[i];
+		if (cumulative >= target)
+		{
+			return BOUNDS[i];
+		}
+	}
+
+	return BOUNDS.back();
+}
+
+void SenderStats::reset()
+{
+	frames = 0;
+	bytes = 0;
+	position = 0;
+	bitrate = 0;
+	frame_rate = 0;
+	speed = 0;
+	loops = 0;
+	write_errors = 0;
+	outputs = 0;
+	underruns = 0;
+	packet_allocs = 0;
+	packet_refs = 0;
+
+	write_latency.reset();
+	lateness.reset();
+	loop_restart.reset();
+}
+
+/**** MetricsRegistry ****/
+
+// 标签值转义: 反斜杠、双引号、换行
+static std::string escape_label(const std::string& value)
+{
+	std::string out;
+	out.reserve(value.size());
+	for (char c : value)
+	{
+		if (c == '\\' || c == '"')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if (c == '\n')
+		{
+			out += "\\n";
+		}
+		else
+		{
+			out += c;
+		}
+	}
+
+	return out;
+}
+
+static void append_histogram(std::string& out, const std::string& name, const std::string& labels, const Histogram& histogram)
+{
+	uint64_t cumulative = 0;
+	for (size_t i = 0; i < Histogram::BOUNDS.size(); i++)
+	{
+		cumulative += histogram.bucket(i);
+		out += fmt::format("{}_bucket{{{},le=\"{}\"}} {}\n", name, labels, Histogram::BOUNDS[i] / 1e6, cumulative);
+	}
+	cumulative += histogram.bucket(Histogram::BOUNDS.size());
+
+	out += fmt::format("{}_bucket{{{},le=\"+Inf\"}} {}\n", name, labels, cumulative);
+	out += fmt::format("{}_sum{{{}}} {}\n", name, labels, histogram.sum() / 1e6);
+	out += fmt::format("{}_count{{{}}} {}\n", name, labels, cumulative);
+}
+
+MetricsRegistry& MetricsRegistry::instance()
+{
+	static MetricsRegistry registry;
+	return registry;
+}
+
+void MetricsRegistry::add(const SenderStats* stats, const std::string& video)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Entry& entry = m_entries[stats];
+	if (entry.id == 0)
+	{
+		entry.id = m_nextId++;
+	}
+	entry.video = video;
+}
+
+void MetricsRegistry::remove(const SenderStats* stats)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_entries.erase(stats);
+}
+
+std::string MetricsRegistry::prometheus()
+{
+	struct Counter
+	{
+		const char* name;
+		const char* type;
+		const char* help;
+		const std::atomic<int64_t> SenderStats::* member;
+		int64_t scale = 1;   // 导出值 = 原始值 / scale
+	};
+
+	static const Counter counters[] = {
+		{ "videotortsp_packets_written_total", "counter", "Video packets written", &SenderStats::frames },
+		{ "videotortsp_bytes_sent_total", "counter", "Video payload bytes sent (counted once per packet)", &SenderStats::bytes },
+		{ "videotortsp_bitrate_bps", "gauge", "Bitrate over the last second", &SenderStats::bitrate },
+		{ "videotortsp_frame_rate", "gauge", "Frames written per second over the last second", &SenderStats::frame_rate },
+		{ "videotortsp_replay_speed", "gauge", "Media time sent per wall-clock second over the last second", &SenderStats::speed, 1000 },
+		{ "videotortsp_loops_total", "counter", "Completed loop passes", &SenderStats::loops },
+		{ "videotortsp_write_errors_total", "counter", "Failed output writes", &SenderStats::write_errors },
+		{ "videotortsp_outputs", "gauge", "Active outputs", &SenderStats::outputs },
+		{ "videotortsp_prefetch_underruns_total", "counter", "Sends that found the prefetch queue empty", &SenderStats::underruns },
+		{ "videotortsp_packet_allocs_total", "counter", "Packets whose payload was newly allocated by the demuxer or encoder", &SenderStats::packet_allocs },
+		{ "videotortsp_packet_refs_total", "counter", "Packets served by reference without allocating (loop cache, Annex-B map, test pattern)", &SenderStats::packet_refs },
+	};
+
+	struct Hist
+	{
+		const char* name;
+		const char* help;
+		const Histogram SenderStats::* member;
+	};
+
+	static const Hist histograms[] = {
+		{ "videotortsp_write_latency_seconds", "av_interleaved_write_frame latency", &SenderStats::write_latency },
+		{ "videotortsp_pacing_lateness_seconds", "Actual send time minus scheduled send time", &SenderStats::lateness },
+		{ "videotortsp_loop_restart_seconds", "Time to restart a loop pass", &SenderStats::loop_restart },
+	};
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::string out;
+	for (const auto& counter : counters)
+	{
+		out += fmt::format("# HELP {} {}\n# TYPE {} {}\n", counter.name, counter.help, counter.name, counter.type);
+		for (const auto& [stats, entry] : m_entries)
+		{
+			int64_t value = (stats->*counter.member).load(std::memory_order_relaxed);
+			if (counter.scale == 1)
+			{
+				out += fmt::format("{}{{id=\"{}\",video=\"{}\"}} {}\n", counter.name, entry.id, escape_label(entry.video), value);
+			}
+			else
+			{
+				out += fmt::format("{}{{id=\"{}\",video=\"{}\"}} {}\n", counter.name, entry.id, escape_label(entry.video), double(value) / counter.scale);
+			}
+		}
+	}
+
+	for (const auto& histogram : histograms)
+	{
+		out += fmt::format("# HELP {} {}\n# TYPE {} histogram\n", histogram.name, histogram.help, histogram.name);
+		for (const auto& [stats, entry] : m_entries)
+		{
+			std::string labels = fmt::format("id=\"{}\",video=\"{}\"", entry.id, escape_label(entry.video));
+			append_histogram(out, histogram.name, labels, stats->*histogram.member);
+		}
+	}
+
+	return out;
+}
+
+void MetricsRegistry::log_summary()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_entries.empty())
+	{
+		return;
+	}
+
+	int64_t bitrate = 0;
+	for (const auto& [stats, entry] : m_entries)
+	{
+		bitrate += stats->bitrate.load(std::memory_order_relaxed) * stats->outputs.load(std::memory_order_relaxed);
+
+		spdlog::info("Metrics [{}] {}: outputs {}, frames {}, {} kbps, {} fps, speed {:.2f}x, write p99 {:.1f} ms, late p99 {:.1f} ms, loops {}, errors {}, underruns {}, allocs {}",
+			entry.id,
+			std::filesystem::path(entry.video).filename().string(),
+			stats->outputs.load(std::memory_order_relaxed),
+			stats->frames.load(std::memory_order_relaxed),
+			stats->bitrate.load(std::memory_order_relaxed) / 1000,
+			stats->frame_rate.load(std::memory_order_relaxed),
+			stats->speed.load(std::memory_order_relaxed) / 1000.0,
+			stats->write_latency.quantile(0.99) / 1000.0,
+			stats->lateness.quantile(0.99) / 1000.0,
+			stats->loops.load(std::memory_order_relaxed),
+			stats->write_errors.load(std::memory_order_relaxed),
+			stats->underruns.load(std::memory_order_relaxed),
+			stats->packet_allocs.load(std::memory_order_relaxed));
+	}
+
+	spdlog::info("Metrics total: {} senders, {} kbps", m_entries.size(), bitrate / 1000);
+}
+
+/**** MetricsServer ****/
+
+MetricsServer& MetricsServer::instance()
+{
+	static MetricsServer server;
+	return server;
+}
+
+MetricsServer::~MetricsServer()
+{
+	stop();
+}
+
+bool MetricsServer::start(int port, int summaryInterval)
+{
+	stop();
+
+	// 只监听本机
+	m_socket = tcp_listen("127.0.0.1", port);
+	if (m_socket == BAD_SOCKET)
+	{
+		spdlog::error("Metrics server listen on port {} failed", port);
+		return false;
+	}
+
+	m_summaryInterval = summaryInterval;
+	m_quit = false;
+	t = std::thread(&MetricsServer::serve, this);
+
+	spdlog::info("Metrics server: http://127.0.0.1:{}/metrics", port);
+	return true;
+}
+
+void MetricsServer::stop()
+{
+	m_quit = true;
+	if (t.joinable())
+	{
+		t.join();
+	}
+
+	close_socket(m_socket);
+	m_socket = BAD_SOCKET;
+}
+
+void MetricsServer::serve()
+{
+	auto lastSummary = std::chrono::steady_clock::now();
+	while (!m_quit)
+	{
+		if (wait_readable(m_socket, 500))
+		{
+			socket_t client = tcp_accept(m_socket);
+			if (client != BAD_SOCKET)
+			{
+				handle(client);
+				close_socket(client);
+			}
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		if (m_summaryInterval > 0 && now - lastSummary >= std::chrono::seconds(m_summaryInterval))
+		{
+			MetricsRegistry::instance().log_summary();
+			lastSummary = now;
+		}
+	}
+}
+
+void MetricsServer::handle(socket_t client)
+{
+	// 只需要请求行
+	char buf[1024] = { 0 };
+	if (!wait_readable(client, 1000) || recv_some(client, buf, sizeof(buf) - 1) <= 0)
+	{
+		return;
+	}
+
+	std::string request(buf);
+	std::string status = "200 OK";
+	std::string body;
+	if (request.rfind("GET /metrics", 0) == 0)
+	{
+		body = MetricsRegistry::instance().prometheus();
+	}
+	else
+	{
+		status = "404 Not Found";
+		body = "Not Found\n";
+	}
+
+	std::string response = fmt::format("HTTP/1.1 {}\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: {}\r\nConnection: close\r\n\r\n", status, body.size());
+	send_all(client, response.data(), response.size());
+	send_all(client, body.data(), body.size());
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <map>
+#include <cstdint>
+#include "net_socket.h"
+
+// 直方图: 固定分桶(微秒), 推流线程以relaxed原子操作更新
+class Histogram
+{
+public:
+	static constexpr std::array<int64_t, 14> BOUNDS = { 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 5000000 };
+
+	void observe(int64_t us);
+	void reset();
+
+	uint64_t count() const;
+	int64_t sum() const;                 // 累计值(微秒)
+	uint64_t bucket(size_t i) const;     // 第i个分桶的计数(非累计), i == BOUNDS.size()为+Inf
+	int64_t quantile(double q) const;    // 按分桶估算分位数, 返回分桶上限(微秒)
+
+protected:
+	std::array<std::atomic<uint64_t>, BOUNDS.size() + 1> m_buckets = {};
+	std::atomic<uint64_t> m_count = 0;
+	std::atomic<int64_t> m_sum = 0;
+};
+
+// 推流统计: 推流线程以relaxed原子操作更新, GUI线程和指标服务定时采样
+struct SenderStats
+{
+	std::atomic<int64_t> frames = 0;        // 已发送帧数
+	std::atomic<int64_t> bytes = 0;         // 已发送数据量(Byte), 多个输出只计一份
+	std::atomic<int64_t> position = 0;      // 推流位置(微秒), 含已完成的循环
+	std::atomic<int64_t> bitrate = 0;       // 最近1秒码率(bps)
+	std::atomic<int64_t> frame_rate = 0;    // 最近1秒帧率(fps)
+	std::atomic<int64_t> speed = 0;         // 最近1秒推流速度(推流时长/实际时长, 千分比), 加速回放时大于1000
+	std::atomic<int64_t> loops = 0;         // 已完成的循环次数
+	std::atomic<int64_t> write_errors = 0;  // 写入失败次数
+	std::atomic<int64_t> outputs = 0;       // 当前输出数量
+	std::atomic<int64_t> underruns = 0;     // 发送时预读队列为空的次数
+	std::atomic<int64_t> packet_allocs = 0; // 新申请帧数据的帧数(解复用、转码编码)
+	std::atomic<int64_t> packet_refs = 0;   // 引用已有数据、不申请内存的帧数(循环缓存、Annex-B映射、测试图案)
+
+	Histogram write_latency;   // av_interleaved_write_frame耗时
+	Histogram lateness;        // 实际发送时间 - 计划发送时间
+	Histogram loop_restart;    // 每轮循环结束到下一轮第一帧的耗时
+
+	void reset();
+};
+
+// 指标注册表: 推流器开始推流时注册, 结束时注销
+class MetricsRegistry
+{
+public:
+	static MetricsRegistry& instance();
+
+	void add(const SenderStats* stats, const std::string& video);
+	void remove(const SenderStats* stats);
+
+	std::string prometheus();   // Prometheus文本格式
+	void log_summary();         // 通过spdlog输出各路流摘要
+
+protected:
+	struct Entry
+	{
+		int id = 0;             // 推流器编号, 区分同一视频的多个推流器
+		std::string video;      // 视频路径
+	};
+
+	std::mutex m_mutex;
+	std::map<const SenderStats*, Entry> m_entries;
+	int m_nextId = 1;
+};
+
+// 指标服务: 本地HTTP端口提供 GET /metrics, 并定时输出spdlog摘要
+class MetricsServer
+{
+public:
+	static MetricsServer& instance();
+	~MetricsServer();
+
+	bool start(int port, int summaryInterval = 10);  // summaryInterval: 摘要日志间隔(秒), 0表示不输出
+	void stop();
+
+protected:
+	MetricsServer() = default;
+	void serve();
+	void handle(socket_t client);
+
+protected:
+	std::atomic_bool m_quit = false;
+	socket_t m_socket = BAD_SOCKET;
+	int m_summaryInterval = 0;
+	std::thread t;
+};
\ No newline at end of file
@@ -0,0 +1,301 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <algorithm>
+#include "mmap_input.h"
+#include "string_util.h"
+
+static constexpr int IO_BUFFER_SIZE = 64 * 1024;   // AVIOContext缓冲区, 大块读取时ffmpeg直接读入目标缓冲区
+
+// 只读文件映射, 映射期间文件被截断时访问会触发SIGBUS/访问异常, 推流中的文件不应被修改
+class MappedFile
+{
+public:
+	~MappedFile();
+
+	static std::shared_ptr<MappedFile> open(const std::string& path);
+
+	const uint8_t* data() const { return m_data; }
+	int64_t size() const { return m_size; }
+
+protected:
+	MappedFile() = default;
+	bool map(const std::string& path);
+
+protected:
+	const uint8_t* m_data = NULL;
+	int64_t m_size = 0;
+#ifdef _WIN32
+	HANDLE m_file = INVALID_HANDLE_VALUE;
+	HANDLE m_mapping = NULL;
+#endif
+};
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if (m_data)
+	{
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping)
+	{
+		CloseHandle(m_mapping);
+	}
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+	}
+#else
+	if (m_data)
+	{
+		munmap(const_cast<uint8_t*>(m_data), size_t(m_size));
+	}
+#endif
+}
+
+bool MappedFile::map(const std::string& path)
+{
+#ifdef _WIN32
+	m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size) || size.QuadPart <= 0)
+	{
+		return false;
+	}
+	m_size = size.QuadPart;
+
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (m_mapping == NULL)
+	{
+		return false;
+	}
+
+	m_data = static_cast<const uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	return m_data != NULL;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+	{
+		::close(fd);
+		return false;
+	}
+	m_size = st.st_size;
+
+	// 映射建立后即可关闭文件描述符
+	void* data = mmap(NULL, size_t(m_size), PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+
+	// 顺序读取: 内核加大预读, 已读页面优先回收
+	madvise(data, size_t(m_size), MADV_SEQUENTIAL);
+	m_data = static_cast<const uint8_t*>(data);
+	return true;
+#endif
+}
+
+std::shared_ptr<MappedFile> MappedFile::open(const std::string& path)
+{
+	// 同一文件的映射由所有读取者共享, 最后一个读取者关闭时解除映射
+	static std::mutex mutex;
+	static std::map<std::string, std::weak_ptr<MappedFile>> files;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = files.find(path);
+	if (it != files.end())
+	{
+		std::shared_ptr<MappedFile> file = it->second.lock();
+		if (file)
+		{
+			return file;
+		}
+		files.erase(it);
+	}
+
+	std::shared_ptr<MappedFile> file(new MappedFile);
+	if (!file->map(path))
+	{
+		return nullptr;
+	}
+
+	// 顺带清理已失效的记录
+	for (auto i = files.begin(); i != files.end();)
+	{
+		i = i->second.expired() ? files.erase(i) : std::next(i);
+	}
+	files[path] = file;
+
+	return file;
+}
+
+std::shared_ptr<const uint8_t> MapInputFile(const std::string& video, int64_t* size)
+{
+	std::shared_ptr<MappedFile> file = MappedFile::open(video);
+	if (!file)
+	{
+		return nullptr;
+	}
+
+	// 别名构造: 指向映射数据, 引用计数仍由MappedFile管理
+	*size = file->size();
+	return std::shared_ptr<const uint8_t>(file, file->data());
+}
+
+// AVIOContext的读取位置
+struct MappedReader
+{
+	std::shared_ptr<MappedFile> file;
+	int64_t pos = 0;
+};
+
+static int read_packet(void* opaque, uint8_t* buf, int bufSize)
+{
+	MappedReader* reader = static_cast<MappedReader*>(opaque);
+	int64_t remain = reader->file->size() - reader->pos;
+	if (remain <= 0)
+	{
+		return AVERROR_EOF;
+	}
+
+	int len = int(std::min<int64_t>(remain, bufSize));
+	std::memcpy(buf, reader->file->data() + reader->pos, size_t(len));
+	reader->pos += len;
+
+	return len;
+}
+
+static int64_t seek(void* opaque, int64_t offset, int whence)
+{
+	MappedReader* reader = static_cast<MappedReader*>(opaque);
+	int64_t size = reader->file->size();
+	if (whence & AVSEEK_SIZE)
+	{
+		return size;
+	}
+
+	int64_t pos = 0;
+	switch (whence & ~AVSEEK_FORCE)
+	{
+	case SEEK_SET:
+		pos = offset;
+		break;
+	case SEEK_CUR:
+		pos = reader->pos + offset;
+		break;
+	case SEEK_END:
+		pos = size + offset;
+		break;
+	default:
+		return AVERROR(EINVAL);
+	}
+
+	if (pos < 0 || pos > size)
+	{
+		return AVERROR(EINVAL);
+	}
+
+	reader->pos = pos;
+	return pos;
+}
+
+static void free_io(AVIOContext** ppIoCtx)
+{
+	AVIOContext* pIoCtx = *ppIoCtx;
+	if (pIoCtx == NULL)
+	{
+		return;
+	}
+
+	delete static_cast<MappedReader*>(pIoCtx->opaque);
+	av_freep(&pIoCtx->buffer);
+	avio_context_free(ppIoCtx);
+}
+
+int OpenInputFile(AVFormatContext** ppFmtCtx, const std::string& video, AVDictionary** options)
+{
+	std::string url = toUtf8(video);  // ffmpeg要以UTF-8格式作为输入, 自定义IO时仍用于按扩展名探测格式
+	AVFormatContext* pFmtCtx = NULL;
+	AVIOContext* pIoCtx = NULL;
+	uint8_t* buffer = NULL;
+	MappedReader* reader = NULL;
+	int ret = 0;
+
+	std::shared_ptr<MappedFile> file = MappedFile::open(video);
+	if (!file)
+	{
+		return avformat_open_input(ppFmtCtx, url.c_str(), NULL, options);
+	}
+
+	pFmtCtx = avformat_alloc_context();
+	buffer = static_cast<uint8_t*>(av_malloc(IO_BUFFER_SIZE));
+	if (pFmtCtx == NULL || buffer == NULL)
+	{
+		ret = AVERROR(ENOMEM);
+		goto end;
+	}
+
+	reader = new MappedReader;
+	reader->file = file;
+	pIoCtx = avio_alloc_context(buffer, IO_BUFFER_SIZE, 0, reader, read_packet, NULL, seek);
+	if (pIoCtx == NULL)
+	{
+		delete reader;
+		ret = AVERROR(ENOMEM);
+		goto end;
+	}
+	buffer = NULL;
+
+	// 预设pb后avformat_open_input不再打开文件, 并设置AVFMT_FLAG_CUSTOM_IO
+	pFmtCtx->pb = pIoCtx;
+	ret = avformat_open_input(&pFmtCtx, url.c_str(), NULL, options);
+	if (ret < 0)
+	{
+		// 失败时pFmtCtx已被释放, 自定义IO需要自己释放
+		free_io(&pIoCtx);
+		return ret;
+	}
+
+	*ppFmtCtx = pFmtCtx;
+	return 0;
+
+end:
+	av_free(buffer);
+	avformat_free_context(pFmtCtx);
+	return ret;
+}
+
+void CloseInputFile(AVFormatContext** ppFmtCtx)
+{
+	AVFormatContext* pFmtCtx = *ppFmtCtx;
+	if (pFmtCtx == NULL)
+	{
+		return;
+	}
+
+	AVIOContext* pIoCtx = (pFmtCtx->flags & AVFMT_FLAG_CUSTOM_IO) ? pFmtCtx->pb : NULL;
+	avformat_close_input(ppFmtCtx);
+	free_io(&pIoCtx);
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <string>
+#include <memory>
+
+extern "C"
+{
+#include "libavformat/avformat.h"
+};
+
+// 打开本地视频, 用法同avformat_open_input: 文件映射到内存, 通过自定义AVIOContext读取
+// 同一文件的多个推流器共享一份映射(页缓存), 不再逐次read()系统调用; 映射失败时使用ffmpeg默认文件协议
+int OpenInputFile(AVFormatContext** ppFmtCtx, const std::string& video, AVDictionary** options = NULL);
+
+// 关闭OpenInputFile打开的输入, 释放自定义AVIOContext
+void CloseInputFile(AVFormatContext** ppFmtCtx);
+
+// 只读映射整个文件, 与OpenInputFile共享同一份映射; 返回的指针在所有持有者释放前有效, 失败返回nullptr
+std::shared_ptr<const uint8_t> MapInputFile(const std::string& video, int64_t* size);
\ No newline at end of file
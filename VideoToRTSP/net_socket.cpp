@@ -0,0 +1,583 @@
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+#ifdef __linux__
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#endif
+#include <algorithm>
+#include <cstring>
+#include <atomic>
+#include "net_socket.h"
+
+#ifdef _WIN32
+static bool would_block()
+{
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+#else
+static bool would_block()
+{
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+}
+#endif
+
+static sockaddr_in to_sockaddr(const NetAddress& addr)
+{
+	sockaddr_in sa = {};
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(addr.ip);
+	sa.sin_port = htons(addr.port);
+	return sa;
+}
+
+bool net_init()
+{
+#ifdef _WIN32
+	static bool ok = []()
+		{
+			WSADATA data;
+			return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+		}();
+	return ok;
+#else
+	return true;
+#endif
+}
+
+void close_socket(socket_t s)
+{
+	if (s == BAD_SOCKET)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	closesocket(s);
+#else
+	::close(s);
+#endif
+}
+
+socket_t tcp_listen(const std::string& ip, int port, int backlog)
+{
+	if (!net_init())
+	{
+		return BAD_SOCKET;
+	}
+
+	socket_t s = socket_t(::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+	if (s == BAD_SOCKET)
+	{
+		return BAD_SOCKET;
+	}
+
+	int reuse = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(uint16_t(port));
+	if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1
+		|| ::bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+		|| ::listen(s, backlog) != 0)
+	{
+		close_socket(s);
+		return BAD_SOCKET;
+	}
+
+	return s;
+}
+
+socket_t tcp_accept(socket_t s, std::string* peer)
+{
+	sockaddr_in addr = {};
+	socklen_t len = sizeof(addr);
+	socket_t c = socket_t(::accept(s, reinterpret_cast<sockaddr*>(&addr), &len));
+	if (c != BAD_SOCKET && peer)
+	{
+		char ip[INET_ADDRSTRLEN] = { 0 };
+		inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+		*peer = ip;
+	}
+
+	return c;
+}
+
+bool wait_readable(socket_t s, int timeoutMs)
+{
+	fd_set fds;
+	FD_ZERO(&fds);
+	FD_SET(s, &fds);
+
+	timeval tv;
+	tv.tv_sec = timeoutMs / 1000;
+	tv.tv_usec = (timeoutMs % 1000) * 1000;
+
+	return ::select(int(s + 1), &fds, NULL, NULL, &tv) > 0;
+}
+
+int recv_some(socket_t s, char* buf, int len)
+{
+	return int(::recv(s, buf, len, 0));
+}
+
+bool send_all(socket_t s, const char* data, size_t len)
+{
+	while (len > 0)
+	{
+		int n = int(::send(s, data, int(len), 0));
+		if (n <= 0)
+		{
+#ifndef _WIN32
+			if (n < 0 && errno == EINTR)
+			{
+				continue;
+			}
+#endif
+			return false;
+		}
+
+		data += n;
+		len -= n;
+	}
+
+	return true;
+}
+
+int send_some(socket_t s, const char* data, size_t len)
+{
+#ifdef _WIN32
+	int n = ::send(s, data, int(len), 0);
+#else
+	int n = int(::send(s, data, len, MSG_NOSIGNAL));
+#endif
+	if (n < 0)
+	{
+		return would_block() ? 0 : -1;
+	}
+
+	return n;
+}
+
+int send_some_v(socket_t s, const IoSlice* slices, size_t count)
+{
+#ifdef _WIN32
+	std::vector<WSABUF> bufs(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		bufs[i].buf = const_cast<CHAR*>(static_cast<const CHAR*>(slices[i].data));
+		bufs[i].len = ULONG(slices[i].size);
+	}
+
+	DWORD sent = 0;
+	if (WSASend(s, bufs.data(), DWORD(count), &sent, 0, NULL, NULL) != 0)
+	{
+		return would_block() ? 0 : -1;
+	}
+	return int(sent);
+#else
+	// 每次sendmsg最多IOV_MAX段, 分批提交直到缓冲区满
+	static constexpr size_t MAX_IOV = 512;
+	iovec iov[MAX_IOV];
+	int total = 0;
+	while (count > 0)
+	{
+		size_t n = std::min(count, MAX_IOV);
+		size_t bytes = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			iov[i].iov_base = const_cast<void*>(slices[i].data);
+			iov[i].iov_len = slices[i].size;
+			bytes += slices[i].size;
+		}
+
+		msghdr msg = {};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = n;
+		ssize_t ret = ::sendmsg(s, &msg, MSG_NOSIGNAL);
+		if (ret < 0)
+		{
+			if (would_block())
+			{
+				return total;
+			}
+			return total > 0 ? total : -1;
+		}
+
+		total += int(ret);
+		if (size_t(ret) < bytes)
+		{
+			break;
+		}
+		slices += n;
+		count -= n;
+	}
+
+	return total;
+#endif
+}
+
+int poll_sockets(std::vector<PollItem>& items, int timeoutMs)
+{
+#ifdef _WIN32
+	std::vector<WSAPOLLFD> fds(items.size());
+#else
+	std::vector<pollfd> fds(items.size());
+#endif
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		fds[i].fd = items[i].s;
+		fds[i].events = short((items[i].read ? POLLIN : 0) | (items[i].write ? POLLOUT : 0));
+		fds[i].revents = 0;
+	}
+
+#ifdef _WIN32
+	int ret = WSAPoll(fds.data(), ULONG(fds.size()), timeoutMs);
+#else
+	int ret = ::poll(fds.data(), nfds_t(fds.size()), timeoutMs);
+#endif
+	if (ret < 0)
+	{
+		return -1;
+	}
+
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		items[i].readable = (fds[i].revents & (POLLIN | POLLHUP)) != 0;
+		items[i].writable = (fds[i].revents & POLLOUT) != 0;
+		items[i].error = (fds[i].revents & (POLLERR | POLLNVAL)) != 0;
+	}
+
+	return ret;
+}
+
+socket_t udp_open(const std::string& ip, int port)
+{
+	if (!net_init())
+	{
+		return BAD_SOCKET;
+	}
+
+	socket_t s = socket_t(::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+	if (s == BAD_SOCKET)
+	{
+		return BAD_SOCKET;
+	}
+
+	sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(uint16_t(port));
+	if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1
+		|| ::bind(s, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+	{
+		close_socket(s);
+		return BAD_SOCKET;
+	}
+
+	return s;
+}
+
+int udp_port(socket_t s)
+{
+	sockaddr_in addr = {};
+	socklen_t len = sizeof(addr);
+	if (getsockname(s, reinterpret_cast<sockaddr*>(&addr), &len) != 0)
+	{
+		return 0;
+	}
+
+	return ntohs(addr.sin_port);
+}
+
+bool udp_send_to(socket_t s, const NetAddress& addr, const char* data, size_t len)
+{
+	sockaddr_in sa = to_sockaddr(addr);
+	return ::sendto(s, data, int(len), 0, reinterpret_cast<sockaddr*>(&sa), sizeof(sa)) == int(len);
+}
+
+#ifdef __linux__
+static std::atomic_bool g_udpGso = true;   // 内核不支持UDP_SEGMENT时关闭
+
+// 数据报长度
+static size_t datagram_size(const IoSlice* slices, size_t perDatagram)
+{
+	size_t size = 0;
+	for (size_t i = 0; i < perDatagram; i++)
+	{
+		size += slices[i].size;
+	}
+	return size;
+}
+
+// GSO: 连续的同长度数据报(最后一个可以更短)作为一个大数据报提交, 由内核/网卡分段
+// 返回已提交的数据报数, 内核不支持时关闭GSO并返回已提交的部分
+static size_t udp_send_gso(socket_t s, const sockaddr_in& sa, const IoSlice* slices, size_t datagrams, size_t perDatagram)
+{
+	static constexpr size_t MAX_SEGMENTS = 64;
+	static constexpr size_t MAX_GSO_BYTES = 65000;
+
+	std::vector<iovec> iov;
+	size_t i = 0;
+	while (i < datagrams)
+	{
+		size_t segment = datagram_size(slices + i * perDatagram, perDatagram);
+		size_t j = i + 1;
+		while (j < datagrams && j - i < MAX_SEGMENTS && (j - i + 1) * segment <= MAX_GSO_BYTES)
+		{
+			size_t size = datagram_size(slices + j * perDatagram, perDatagram);
+			if (size > segment)
+			{
+				break;
+			}
+			j++;
+			if (size < segment)
+			{
+				break;
+			}
+		}
+
+		iov.resize((j - i) * perDatagram);
+		for (size_t k = 0; k < iov.size(); k++)
+		{
+			iov[k].iov_base = const_cast<void*>(slices[i * perDatagram + k].data);
+			iov[k].iov_len = slices[i * perDatagram + k].size;
+		}
+
+		char control[CMSG_SPACE(sizeof(uint16_t))] = { 0 };
+		msghdr msg = {};
+		msg.msg_name = const_cast<sockaddr_in*>(&sa);
+		msg.msg_namelen = sizeof(sa);
+		msg.msg_iov = iov.data();
+		msg.msg_iovlen = iov.size();
+		if (j - i > 1)
+		{
+			msg.msg_control = control;
+			msg.msg_controllen = sizeof(control);
+			cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+			cm->cmsg_level = SOL_UDP;
+			cm->cmsg_type = UDP_SEGMENT;
+			cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			uint16_t gsoSize = uint16_t(segment);
+			std::memcpy(CMSG_DATA(cm), &gsoSize, sizeof(gsoSize));
+		}
+
+		if (::sendmsg(s, &msg, 0) < 0 && !would_block())
+		{
+			if (errno == EINVAL || errno == EIO || errno == ENOPROTOOPT || errno == EOPNOTSUPP)
+			{
+				g_udpGso = false;
+				return i;
+			}
+		}
+		i = j;
+	}
+
+	return datagrams;
+}
+#endif
+
+int udp_send_batch(socket_t s, const NetAddress& addr, const IoSlice* slices, size_t datagrams, size_t perDatagram)
+{
+	sockaddr_in sa = to_sockaddr(addr);
+#ifdef __linux__
+	size_t sent = 0;
+	if (g_udpGso)
+	{
+		sent = udp_send_gso(s, sa, slices, datagrams, perDatagram);
+		if (sent == datagrams)
+		{
+			return int(sent);
+		}
+	}
+
+	// sendmmsg: 一次系统调用提交多个数据报
+	std::vector<iovec> iov((datagrams - sent) * perDatagram);
+	std::vector<mmsghdr> msgs(datagrams - sent);
+	for (size_t i = 0; i < msgs.size(); i++)
+	{
+		for (size_t k = 0; k < perDatagram; k++)
+		{
+			const IoSlice& slice = slices[(sent + i) * perDatagram + k];
+			iov[i * perDatagram + k].iov_base = const_cast<void*>(slice.data);
+			iov[i * perDatagram + k].iov_len = slice.size;
+		}
+
+		msgs[i] = {};
+		msgs[i].msg_hdr.msg_name = &sa;
+		msgs[i].msg_hdr.msg_namelen = sizeof(sa);
+		msgs[i].msg_hdr.msg_iov = iov.data() + i * perDatagram;
+		msgs[i].msg_hdr.msg_iovlen = perDatagram;
+	}
+
+	size_t done = 0;
+	while (done < msgs.size())
+	{
+		int ret = ::sendmmsg(s, msgs.data() + done, unsigned(msgs.size() - done), 0);
+		if (ret <= 0)
+		{
+			break;
+		}
+		done += size_t(ret);
+	}
+
+	return int(sent + done);
+#elif defined(_WIN32)
+	// Windows: 每个数据报一次WSASendTo, 头部和负载分段提交, 不复制
+	std::vector<WSABUF> bufs(perDatagram);
+	size_t sent = 0;
+	for (size_t i = 0; i < datagrams; i++)
+	{
+		for (size_t k = 0; k < perDatagram; k++)
+		{
+			bufs[k].buf = const_cast<CHAR*>(static_cast<const CHAR*>(slices[i * perDatagram + k].data));
+			bufs[k].len = ULONG(slices[i * perDatagram + k].size);
+		}
+
+		DWORD bytes = 0;
+		if (WSASendTo(s, bufs.data(), DWORD(perDatagram), &bytes, 0, reinterpret_cast<sockaddr*>(&sa), sizeof(sa), NULL, NULL) == 0)
+		{
+			sent++;
+		}
+	}
+
+	return int(sent);
+#else
+	std::vector<iovec> iov(perDatagram);
+	size_t sent = 0;
+	for (size_t i = 0; i < datagrams; i++)
+	{
+		for (size_t k = 0; k < perDatagram; k++)
+		{
+			iov[k].iov_base = const_cast<void*>(slices[i * perDatagram + k].data);
+			iov[k].iov_len = slices[i * perDatagram + k].size;
+		}
+
+		msghdr msg = {};
+		msg.msg_name = &sa;
+		msg.msg_namelen = sizeof(sa);
+		msg.msg_iov = iov.data();
+		msg.msg_iovlen = perDatagram;
+		if (::sendmsg(s, &msg, 0) >= 0)
+		{
+			sent++;
+		}
+	}
+
+	return int(sent);
+#endif
+}
+
+int udp_recv_from(socket_t s, char* buf, int len, NetAddress* from)
+{
+	sockaddr_in sa = {};
+	socklen_t salen = sizeof(sa);
+	int n = int(::recvfrom(s, buf, len, 0, reinterpret_cast<sockaddr*>(&sa), &salen));
+	if (n >= 0 && from)
+	{
+		from->ip = ntohl(sa.sin_addr.s_addr);
+		from->port = ntohs(sa.sin_port);
+	}
+
+	return n;
+}
+
+bool parse_ipv4(const std::string& ip, uint32_t& addr)
+{
+	in_addr in = {};
+	if (inet_pton(AF_INET, ip.c_str(), &in) != 1)
+	{
+		return false;
+	}
+
+	addr = ntohl(in.s_addr);
+	return true;
+}
+
+std::string ipv4_string(uint32_t addr)
+{
+	in_addr in = {};
+	in.s_addr = htonl(addr);
+
+	char ip[INET_ADDRSTRLEN] = { 0 };
+	inet_ntop(AF_INET, &in, ip, sizeof(ip));
+	return ip;
+}
+
+std::vector<std::string> local_ipv4_addresses()
+{
+	std::vector<std::string> ips;
+	if (!net_init())
+	{
+		return ips;
+	}
+
+	char hostName[256] = { 0 };
+	if (gethostname(hostName, sizeof(hostName) - 1) != 0)
+	{
+		return ips;
+	}
+
+	addrinfo hints = {};
+	hints.ai_family = AF_INET;
+	addrinfo* result = NULL;
+	if (getaddrinfo(hostName, NULL, &hints, &result) != 0)
+	{
+		return ips;
+	}
+
+	for (addrinfo* p = result; p; p = p->ai_next)
+	{
+		uint32_t addr = ntohl(reinterpret_cast<sockaddr_in*>(p->ai_addr)->sin_addr.s_addr);
+		std::string ip = ipv4_string(addr);
+		if ((addr >> 24) != 127 && std::find(ips.begin(), ips.end(), ip) == ips.end())
+		{
+			ips.push_back(ip);
+		}
+	}
+	freeaddrinfo(result);
+
+	return ips;
+}
+
+bool set_nonblocking(socket_t s, bool enable)
+{
+#ifdef _WIN32
+	u_long mode = enable ? 1 : 0;
+	return ioctlsocket(s, FIONBIO, &mode) == 0;
+#else
+	int flags = fcntl(s, F_GETFL, 0);
+	if (flags < 0)
+	{
+		return false;
+	}
+	flags = enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+	return fcntl(s, F_SETFL, flags) == 0;
+#endif
+}
+
+bool set_nodelay(socket_t s, bool enable)
+{
+	int value = enable ? 1 : 0;
+	return setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&value), sizeof(value)) == 0;
+}
+
+bool set_send_buffer(socket_t s, int bytes)
+{
+	return setsockopt(s, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&bytes), sizeof(bytes)) == 0;
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// 跨平台TCP/UDP套接字辅助函数, 系统头文件只在net_socket.cpp中包含, 避免与<windows.h>冲突
+#ifdef _WIN32
+using socket_t = uintptr_t;
+#else
+using socket_t = int;
+#endif
+
+static constexpr socket_t BAD_SOCKET = socket_t(~socket_t(0));
+
+// IPv4地址和端口, 均为主机字节序
+struct NetAddress
+{
+	uint32_t ip = 0;
+	uint16_t port = 0;
+
+	bool operator==(const NetAddress& other) const { return ip == other.ip && port == other.port; }
+};
+
+// 聚合发送的一段数据
+struct IoSlice
+{
+	const void* data = nullptr;
+	size_t size = 0;
+};
+
+// 等待多个套接字的读写事件
+struct PollItem
+{
+	socket_t s = BAD_SOCKET;
+	bool read = true;          // 关注可读
+	bool write = false;        // 关注可写
+	bool readable = false;     // 结果: 可读(含连接关闭)
+	bool writable = false;     // 结果: 可写
+	bool error = false;        // 结果: 出错或挂断
+};
+
+bool net_init();                                           // Windows下初始化Winsock, 可重复调用
+void close_socket(socket_t s);
+
+socket_t tcp_listen(const std::string& ip, int port, int backlog = 64);  // 监听, 失败返回BAD_SOCKET
+socket_t tcp_accept(socket_t s, std::string* peer = nullptr);           // 接受连接, 可返回对端IP
+bool wait_readable(socket_t s, int timeoutMs);             // 等待可读, 超时返回false
+
+int recv_some(socket_t s, char* buf, int len);             // 返回读取字节数, 连接关闭或出错返回<=0
+bool send_all(socket_t s, const char* data, size_t len);   // 阻塞发送全部数据
+
+int send_some(socket_t s, const char* data, size_t len);   // 非阻塞发送, 返回已发送字节数, 缓冲区满返回0, 出错返回-1
+int send_some_v(socket_t s, const IoSlice* slices, size_t count); // 非阻塞聚合发送(sendmsg/WSASend), 返回值同send_some
+int poll_sockets(std::vector<PollItem>& items, int timeoutMs); // 返回就绪数量, 出错返回-1
+
+socket_t udp_open(const std::string& ip, int port);         // 绑定UDP端口, port为0时由系统分配
+int udp_port(socket_t s);                                   // 已绑定的本地端口
+bool udp_send_to(socket_t s, const NetAddress& addr, const char* data, size_t len);
+// 批量发送datagrams个数据报, 每个数据报由连续的perDatagram段组成, 负载不复制
+// Linux下优先使用UDP GSO(同长度数据报一次提交), 内核不支持时使用sendmmsg; 返回交给系统的数据报数
+int udp_send_batch(socket_t s, const NetAddress& addr, const IoSlice* slices, size_t datagrams, size_t perDatagram);
+int udp_recv_from(socket_t s, char* buf, int len, NetAddress* from);
+
+bool parse_ipv4(const std::string& ip, uint32_t& addr);     // 点分十进制转主机字节序
+std::string ipv4_string(uint32_t addr);
+std::vector<std::string> local_ipv4_addresses();           // 本机IPv4地址(按主机名解析), 不含127.0.0.1
+
+bool set_nonblocking(socket_t s, bool enable);
+bool set_nodelay(socket_t s, bool enable);
+bool set_send_buffer(socket_t s, int bytes);
\ No newline at end of file
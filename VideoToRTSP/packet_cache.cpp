@@ -0,0 +1,77 @@
+#include "packet_cache.h"
+
+PacketCache::PacketCache(int64_t limit) :m_limit(limit)
+{
+}
+
+PacketCache::~PacketCache()
+{
+	clear();
+}
+
+bool PacketCache::append(const AVPacket* packet)
+{
+	if (m_overflow)
+	{
+		return false;
+	}
+
+	if (m_bytes + packet->size > m_limit)
+	{
+		// 超过上限, 退回从磁盘读取
+		clear();
+		m_overflow = true;
+		return false;
+	}
+
+	AVPacket* pkt = av_packet_clone(packet);
+	if (pkt == NULL)
+	{
+		clear();
+		m_overflow = true;
+		return false;
+	}
+
+	m_packets.push_back(pkt);
+	m_bytes += pkt->size;
+
+	return true;
+}
+
+void PacketCache::clear()
+{
+	for (AVPacket*& pkt : m_packets)
+	{
+		av_packet_free(&pkt);
+	}
+
+	m_packets.clear();
+	m_bytes = 0;
+}
+
+void PacketCache::reset(int64_t limit)
+{
+	clear();
+	m_limit = limit;
+	m_overflow = false;
+}
+
+size_t PacketCache::size() const
+{
+	return m_packets.size();
+}
+
+int64_t PacketCache::bytes() const
+{
+	return m_bytes;
+}
+
+bool PacketCache::overflow() const
+{
+	return m_overflow;
+}
+
+const AVPacket* PacketCache::at(size_t i) const
+{
+	return m_packets[i];
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+extern "C"
+{
+#include "libavformat/avformat.h"
+};
+
+// 内存包缓存: 首轮解复用的视频帧以引用计数方式保存, 后续循环直接从内存回放
+class PacketCache
+{
+public:
+	explicit PacketCache(int64_t limit);
+	~PacketCache();
+
+	PacketCache(const PacketCache&) = delete;
+	PacketCache& operator=(const PacketCache&) = delete;
+
+	bool append(const AVPacket* packet); // 缓存一帧, 超过上限时清空缓存并返回false
+	void clear();
+	void reset(int64_t limit);           // 清空缓存并重新设置上限
+
+	size_t size() const;
+	int64_t bytes() const;
+	bool overflow() const;
+	const AVPacket* at(size_t i) const;
+
+protected:
+	std::vector<AVPacket*> m_packets;
+	int64_t m_bytes = 0;      // 已缓存数据量(Byte)
+	int64_t m_limit = 0;      // 缓存上限(Byte)
+	bool m_overflow = false;  // 是否超过上限
+};
\ No newline at end of file
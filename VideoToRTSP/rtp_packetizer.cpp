@@ -0,0 +1,409 @@
+#include <random>
+#include <cstdio>
+#include <algorithm>
+#include "rtp_packetizer.h"
+#include "string_util.h"
+#include "annexb_stream.h"
+
+// NAL类型
+static constexpr int H264_NAL_SPS = 7;
+static constexpr int H264_NAL_PPS = 8;
+static constexpr int H264_NAL_AUD = 9;
+static constexpr int H264_NAL_FU_A = 28;
+static constexpr int HEVC_NAL_VPS = 32;
+static constexpr int HEVC_NAL_SPS = 33;
+static constexpr int HEVC_NAL_PPS = 34;
+static constexpr int HEVC_NAL_AUD = 35;
+static constexpr int HEVC_NAL_FU = 49;
+
+void RtpFrame::clear()
+{
+	headers.clear();
+	tcp.clear();
+	udp.clear();
+	sizes.clear();
+	timestamp = 0;
+	key = false;
+	channel = 0;
+}
+
+void RtpFrame::set_channel(uint8_t ch)
+{
+	if (ch == channel)
+	{
+		return;
+	}
+
+	for (size_t i = 0; i < count(); i++)
+	{
+		headers[i * RTP_HEADER_STRIDE + 1] = ch;
+	}
+	channel = ch;
+}
+
+void RtpFrame::finish()
+{
+	// 打包过程中headers可能重新分配, 最后统一填写头部地址
+	udp.resize(tcp.size());
+	for (size_t i = 0; i < count(); i++)
+	{
+		const uint8_t* header = headers.data() + i * RTP_HEADER_STRIDE;
+		tcp[i * 2].data = header;
+		udp[i * 2].data = header + INTERLEAVED_HEADER_SIZE;
+		udp[i * 2].size = tcp[i * 2].size - INTERLEAVED_HEADER_SIZE;
+		udp[i * 2 + 1] = tcp[i * 2 + 1];
+	}
+}
+
+// 查找Annex-B起始码(00 00 01), 返回起始码之后的位置, 找不到返回end; 由FindStartCode按16字节批量查找
+// 4字节起始码多出的0由调用方作为上一个NAL的末尾0去掉
+static const uint8_t* find_start_code(const uint8_t* p, const uint8_t* end, const uint8_t** codeBegin)
+{
+	*codeBegin = FindStartCode(p, end);
+	return *codeBegin < end ? *codeBegin + 3 : end;
+}
+
+// 依次取出每个NAL单元
+template<typename Func>
+static void for_each_nal(const uint8_t* data, size_t size, int lengthSize, Func func)
+{
+	const uint8_t* end = data + size;
+	if (lengthSize > 0)
+	{
+		const uint8_t* p = data;
+		while (p + lengthSize <= end)
+		{
+			size_t len = 0;
+			for (int i = 0; i < lengthSize; i++)
+			{
+				len = (len << 8) | p[i];
+			}
+			p += lengthSize;
+			if (len == 0 || len > size_t(end - p))
+			{
+				break;
+			}
+
+			func(p, len);
+			p += len;
+		}
+		return;
+	}
+
+	const uint8_t* codeBegin = NULL;
+	const uint8_t* nal = find_start_code(data, end, &codeBegin);
+	while (nal < end)
+	{
+		const uint8_t* next = find_start_code(nal, end, &codeBegin);
+
+		// 去掉NAL末尾的0(下一个起始码的一部分)
+		const uint8_t* nalEnd = codeBegin;
+		while (nalEnd > nal && nalEnd[-1] == 0)
+		{
+			nalEnd--;
+		}
+
+		if (nalEnd > nal)
+		{
+			func(nal, size_t(nalEnd - nal));
+		}
+		nal = next;
+	}
+}
+
+RtpPacketizer::RtpPacketizer()
+{
+	std::random_device rd;
+	m_seq = uint16_t(rd());
+	m_ssrc = rd();
+	m_tsBase = rd();
+	m_lastTimestamp = m_tsBase;
+}
+
+bool RtpPacketizer::init(const AVCodecParameters* codecpar)
+{
+	if (codecpar->codec_id != AV_CODEC_ID_H264 && codecpar->codec_id != AV_CODEC_ID_HEVC)
+	{
+		return false;
+	}
+
+	m_codec = codecpar->codec_id;
+	m_lengthSize = 0;
+	m_vps.clear();
+	m_sps.clear();
+	m_pps.clear();
+	if (codecpar->extradata && codecpar->extradata_size > 0)
+	{
+		parse_extradata(codecpar->extradata, size_t(codecpar->extradata_size));
+	}
+
+	return true;
+}
+
+void RtpPacketizer::parse_extradata(const uint8_t* data, size_t size)
+{
+	// Annex-B格式extradata
+	if (size < 7 || data[0] != 1)
+	{
+		for_each_nal(data, size, 0, [this](const uint8_t* nal, size_t len)
+			{
+				save_parameter_set(nal, len);
+			});
+		return;
+	}
+
+	if (m_codec == AV_CODEC_ID_H264)
+	{
+		// avcC: 版本, profile, 兼容性, level, 长度字段字节数, SPS数量, [长度, SPS]..., PPS数量, [长度, PPS]...
+		m_lengthSize = (data[4] & 0x03) + 1;
+		size_t pos = 5;
+		for (int group = 0; group < 2 && pos < size; group++)
+		{
+			int count = group == 0 ? (data[pos] & 0x1F) : data[pos];
+			pos++;
+			for (int i = 0; i < count && pos + 2 <= size; i++)
+			{
+				size_t len = (size_t(data[pos]) << 8) | data[pos + 1];
+				pos += 2;
+				if (pos + len > size)
+				{
+					return;
+				}
+				save_parameter_set(data + pos, len);
+				pos += len;
+			}
+		}
+		return;
+	}
+
+	// hvcC: 22字节配置头(第21字节低2位为长度字段字节数-1), 数组个数, [NAL类型, 数量, [长度, NAL]...]...
+	if (size < 23)
+	{
+		return;
+	}
+	m_lengthSize = (data[21] & 0x03) + 1;
+	size_t pos = 23;
+	for (int array = 0; array < data[22] && pos + 3 <= size; array++)
+	{
+		int count = (data[pos + 1] << 8) | data[pos + 2];
+		pos += 3;
+		for (int i = 0; i < count && pos + 2 <= size; i++)
+		{
+			size_t len = (size_t(data[pos]) << 8) | data[pos + 1];
+			pos += 2;
+			if (pos + len > size)
+			{
+				return;
+			}
+			save_parameter_set(data + pos, len);
+			pos += len;
+		}
+	}
+}
+
+void RtpPacketizer::save_parameter_set(const uint8_t* nal, size_t size)
+{
+	if (size < 2)
+	{
+		return;
+	}
+
+	// 每个NAL都会经过这里, 先判断类型, 只复制参数集
+	std::string* value = NULL;
+	if (m_codec == AV_CODEC_ID_H264)
+	{
+		int type = nal[0] & 0x1F;
+		if (type == H264_NAL_SPS) value = &m_sps;
+		else if (type == H264_NAL_PPS) value = &m_pps;
+	}
+	else
+	{
+		int type = (nal[0] >> 1) & 0x3F;
+		if (type == HEVC_NAL_VPS) value = &m_vps;
+		else if (type == HEVC_NAL_SPS) value = &m_sps;
+		else if (type == HEVC_NAL_PPS) value = &m_pps;
+	}
+
+	if (value)
+	{
+		value->assign(reinterpret_cast<const char*>(nal), size);
+	}
+}
+
+std::string RtpPacketizer::sdp_media() const
+{
+	auto b64 = [](const std::string& nal)
+		{
+			return base64_encode(reinterpret_cast<const uint8_t*>(nal.data()), nal.size());
+		};
+
+	std::string sdp = "m=video 0 RTP/AVP " + std::to_string(RTP_PAYLOAD_TYPE) + "\r\n";
+	if (m_codec == AV_CODEC_ID_H264)
+	{
+		sdp += "a=rtpmap:" + std::to_string(RTP_PAYLOAD_TYPE) + " H264/90000\r\n";
+		sdp += "a=fmtp:" + std::to_string(RTP_PAYLOAD_TYPE) + " packetization-mode=1";
+		if (m_sps.size() >= 4)
+		{
+			char profile[8] = { 0 };
+			snprintf(profile, sizeof(profile), "%02X%02X%02X", uint8_t(m_sps[1]), uint8_t(m_sps[2]), uint8_t(m_sps[3]));
+			sdp += std::string(";profile-level-id=") + profile;
+		}
+		if (!m_sps.empty() && !m_pps.empty())
+		{
+			sdp += ";sprop-parameter-sets=" + b64(m_sps) + "," + b64(m_pps);
+		}
+	}
+	else
+	{
+		sdp += "a=rtpmap:" + std::to_string(RTP_PAYLOAD_TYPE) + " H265/90000\r\n";
+		sdp += "a=fmtp:" + std::to_string(RTP_PAYLOAD_TYPE);
+		std::string params;
+		if (!m_vps.empty()) params += ";sprop-vps=" + b64(m_vps);
+		if (!m_sps.empty()) params += ";sprop-sps=" + b64(m_sps);
+		if (!m_pps.empty()) params += ";sprop-pps=" + b64(m_pps);
+		if (params.empty())
+		{
+			params = ";profile-id=1";
+		}
+		params[0] = ' ';
+		sdp += params;
+	}
+	sdp += "\r\n";
+
+	return sdp;
+}
+
+void RtpPacketizer::packetize(const AVPacket* packet, AVRational timeBase, RtpFrame& frame)
+{
+	frame.clear();
+	frame.key = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+
+	int64_t pts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+	frame.timestamp = m_tsBase + uint32_t(av_rescale_q(pts, timeBase, av_make_q(1, RTP_CLOCK_RATE)));
+	m_lastTimestamp = frame.timestamp;
+
+	if (frame.key && !has_parameter_sets(packet))
+	{
+		m_repeat[0] = m_codec == AV_CODEC_ID_HEVC ? m_vps : std::string();
+		m_repeat[1] = m_sps;
+		m_repeat[2] = m_pps;
+		for (const std::string& nal : m_repeat)
+		{
+			if (!nal.empty())
+			{
+				add_nal(reinterpret_cast<const uint8_t*>(nal.data()), nal.size(), frame);
+			}
+		}
+	}
+
+	for_each_nal(packet->data, size_t(packet->size), m_lengthSize, [this, &frame](const uint8_t* nal, size_t size)
+		{
+			int type = m_codec == AV_CODEC_ID_H264 ? (nal[0] & 0x1F) : ((nal[0] >> 1) & 0x3F);
+			if (type == H264_NAL_AUD && m_codec == AV_CODEC_ID_H264)
+			{
+				return;
+			}
+			if (type == HEVC_NAL_AUD && m_codec == AV_CODEC_ID_HEVC)
+			{
+				return;
+			}
+
+			// 码流内的参数集, 用于extradata缺少参数集的文件(如部分TS)
+			save_parameter_set(nal, size);
+			add_nal(nal, size, frame);
+		});
+
+	// 一帧最后一个包设置标记位
+	if (frame.count() > 0)
+	{
+		frame.headers[(frame.count() - 1) * RTP_HEADER_STRIDE + INTERLEAVED_HEADER_SIZE + 1] |= 0x80;
+	}
+	frame.finish();
+}
+
+bool RtpPacketizer::has_parameter_sets(const AVPacket* packet)
+{
+	bool found = false;
+	for_each_nal(packet->data, size_t(packet->size), m_lengthSize, [this, &found](const uint8_t* nal, size_t)
+		{
+			int type = m_codec == AV_CODEC_ID_H264 ? (nal[0] & 0x1F) : ((nal[0] >> 1) & 0x3F);
+			found = found || type == (m_codec == AV_CODEC_ID_H264 ? H264_NAL_SPS : HEVC_NAL_SPS);
+		});
+
+	return found;
+}
+
+uint8_t* RtpPacketizer::begin_packet(RtpFrame& frame, size_t extra, const uint8_t* payload, size_t size)
+{
+	size_t offset = frame.headers.size();
+	size_t packetSize = RTP_HEADER_SIZE + extra + size;
+	frame.headers.resize(offset + RTP_HEADER_STRIDE);
+	frame.sizes.push_back(uint16_t(packetSize));
+	frame.tcp.push_back({ nullptr, INTERLEAVED_HEADER_SIZE + RTP_HEADER_SIZE + extra });
+	frame.tcp.push_back({ payload, size });
+
+	uint8_t* p = frame.headers.data() + offset;
+	p[0] = '$';
+	p[1] = frame.channel;
+	p[2] = uint8_t(packetSize >> 8);
+	p[3] = uint8_t(packetSize);
+
+	uint8_t* rtp = p + INTERLEAVED_HEADER_SIZE;
+	rtp[0] = 0x80;  // V=2
+	rtp[1] = uint8_t(RTP_PAYLOAD_TYPE);  // 标记位在整帧打包完成后设置
+	rtp[2] = uint8_t(m_seq >> 8);
+	rtp[3] = uint8_t(m_seq);
+	rtp[4] = uint8_t(frame.timestamp >> 24);
+	rtp[5] = uint8_t(frame.timestamp >> 16);
+	rtp[6] = uint8_t(frame.timestamp >> 8);
+	rtp[7] = uint8_t(frame.timestamp);
+	rtp[8] = uint8_t(m_ssrc >> 24);
+	rtp[9] = uint8_t(m_ssrc >> 16);
+	rtp[10] = uint8_t(m_ssrc >> 8);
+	rtp[11] = uint8_t(m_ssrc);
+
+	m_seq++;
+	m_packets++;
+	m_octets += uint32_t(extra + size);
+
+	return rtp + RTP_HEADER_SIZE;
+}
+
+void RtpPacketizer::add_nal(const uint8_t* nal, size_t size, RtpFrame& frame)
+{
+	// 单个NAL
+	if (size <= RTP_MAX_PAYLOAD)
+	{
+		begin_packet(frame, 0, nal, size);
+		return;
+	}
+
+	// FU分片: H.264为1字节FU指示+1字节FU头, H.265为2字节负载头+1字节FU头
+	size_t headerSize = m_codec == AV_CODEC_ID_H264 ? 1 : 2;
+	size_t fuSize = headerSize + 1;
+	const uint8_t* p = nal + headerSize;
+	size_t remain = size - headerSize;
+	bool first = true;
+	while (remain > 0)
+	{
+		size_t len = std::min(remain, size_t(RTP_MAX_PAYLOAD) - fuSize);
+		bool end = len == remain;
+		uint8_t* fu = begin_packet(frame, fuSize, p, len);
+
+		if (m_codec == AV_CODEC_ID_H264)
+		{
+			fu[0] = uint8_t((nal[0] & 0xE0) | H264_NAL_FU_A);
+			fu[1] = uint8_t((first ? 0x80 : 0) | (end ? 0x40 : 0) | (nal[0] & 0x1F));
+		}
+		else
+		{
+			fu[0] = uint8_t((nal[0] & 0x81) | (HEVC_NAL_FU << 1));
+			fu[1] = nal[1];
+			fu[2] = uint8_t((first ? 0x80 : 0) | (end ? 0x40 : 0) | ((nal[0] >> 1) & 0x3F));
+		}
+
+		p += len;
+		remain -= len;
+		first = false;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "net_socket.h"
+
+extern "C"
+{
+#include "libavformat/avformat.h"
+};
+
+static constexpr int RTP_HEADER_SIZE = 12;          // RTP固定头长度
+static constexpr int RTP_MAX_PAYLOAD = 1400;        // 单个RTP包最大负载, 避免IP分片
+static constexpr int RTP_PAYLOAD_TYPE = 96;         // 动态负载类型
+static constexpr int RTP_CLOCK_RATE = 90000;        // 视频时钟频率
+static constexpr int INTERLEAVED_HEADER_SIZE = 4;   // RTSP over TCP交织头: '$' + 通道 + 2字节长度
+static constexpr int RTP_HEADER_STRIDE = 20;        // 每个包的头部区域: 交织头 + RTP头 + FU头(最多3字节)
+
+// 一帧打包结果: 每个包分为头部和负载两段, 负载直接指向AVPacket中的NAL数据, 不复制
+// 发送时以分段聚合提交(TCP: sendmsg/WSASend, UDP: GSO/sendmmsg), 负载只在AVPacket释放前有效
+struct RtpFrame
+{
+	std::vector<uint8_t> headers;    // 各包头部, 间隔RTP_HEADER_STRIDE, 交织头在前
+	std::vector<IoSlice> tcp;        // 每包两段: 交织头+RTP头+FU头, 负载
+	std::vector<IoSlice> udp;        // 每包两段: RTP头+FU头, 负载
+	std::vector<uint16_t> sizes;     // 每个RTP包长度(不含交织头)
+	uint32_t timestamp = 0;          // RTP时间戳
+	bool key = false;                // 是否关键帧
+	uint8_t channel = 0;             // 交织头中当前的通道号
+
+	void clear();
+	size_t count() const { return sizes.size(); }
+	void set_channel(uint8_t ch);    // 修改所有交织头的通道号
+	void finish();                   // 打包完成后生成发送分段
+};
+
+// H.264(RFC 6184)/H.265(RFC 7798) RTP打包: 小于MTU的NAL单独成包, 大NAL按FU分片
+// 输入支持Annex-B和MP4(avcC/hvcC长度前缀)两种格式, 参数集来自extradata或码流内
+// 码流内没有参数集的关键帧(如MP4)前补发最近的参数集, 中途加入的客户端收到关键帧即可解码
+class RtpPacketizer
+{
+public:
+	RtpPacketizer();
+
+	bool init(const AVCodecParameters* codecpar);   // 不支持的编码格式返回false
+	void packetize(const AVPacket* packet, AVRational timeBase, RtpFrame& frame);
+
+	std::string sdp_media() const;     // SDP中的媒体描述(m=/a=行), 不含a=control
+	uint16_t next_seq() const { return m_seq; }
+	uint32_t ssrc() const { return m_ssrc; }
+	uint32_t last_timestamp() const { return m_lastTimestamp; }
+	uint32_t packet_count() const { return m_packets; }
+	uint32_t octet_count() const { return m_octets; }
+
+protected:
+	void add_nal(const uint8_t* nal, size_t size, RtpFrame& frame);
+	uint8_t* begin_packet(RtpFrame& frame, size_t extra, const uint8_t* payload, size_t size); // 追加一个包并写入RTP头, 返回FU头位置(extra字节)
+	void save_parameter_set(const uint8_t* nal, size_t size);
+	bool has_parameter_sets(const AVPacket* packet);   // 帧内是否带SPS
+	void parse_extradata(const uint8_t* data, size_t size);
+
+protected:
+	AVCodecID m_codec = AV_CODEC_ID_NONE;
+	int m_lengthSize = 0;            // MP4格式NAL长度字段字节数, 0表示Annex-B
+	std::string m_vps;               // 参数集(不含起始码)
+	std::string m_sps;
+	std::string m_pps;
+	std::string m_repeat[3];         // 关键帧前补发的参数集副本(VPS/SPS/PPS), 打包结果引用其数据, 到下一个关键帧前不变
+
+	uint16_t m_seq = 0;              // 下一个包的序号
+	uint32_t m_ssrc = 0;
+	uint32_t m_tsBase = 0;           // 时间戳随机起点
+	uint32_t m_lastTimestamp = 0;
+	uint32_t m_packets = 0;          // 已发送包数, 用于RTCP SR
+	uint32_t m_octets = 0;           // 已发送负载字节数, 用于RTCP SR
+};
\ No newline at end of file
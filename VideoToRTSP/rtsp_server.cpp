@@ -0,0 +1,1102 @@
+#include <algorithm>
+#include <random>
+#include <spdlog/spdlog.h>
+#include "rtsp_server.h"
+
+static constexpr int SESSION_TIMEOUT = 60;                   // 会话超时(秒), TCP播放中的会话不超时
+static constexpr int REPORT_INTERVAL = 5;                    // RTCP发送端报告间隔(秒)
+static constexpr size_t MAX_BACKLOG = 4 * 1024 * 1024;       // 单个客户端未发送数据上限, 超过时丢帧直到下一个关键帧
+static constexpr size_t MAX_REQUEST = 64 * 1024;             // 单个请求最大长度
+static constexpr int SEND_BUFFER = 1024 * 1024;              // 客户端套接字发送缓冲区
+
+// 一个RTSP连接及其播放会话(每个连接一个会话, 一路视频)
+struct RtspSession
+{
+	socket_t s = BAD_SOCKET;
+	NetAddress peer;                     // 客户端地址(端口无效)
+	std::string id;                      // 会话ID, SETUP时分配
+	std::string input;                   // 未处理的请求数据
+	std::chrono::steady_clock::time_point active;  // 最近活动时间
+
+	std::shared_ptr<RtspMount> mount;    // SETUP的挂载点
+	std::string url;                     // SETUP的地址, 用于RTP-Info
+	bool playing = false;
+	bool tcp = true;                     // RTP over TCP交织, 否则UDP单播
+	uint8_t rtpChannel = 0;
+	uint8_t rtcpChannel = 1;
+	NetAddress rtpAddr;                  // UDP客户端RTP端口
+	NetAddress rtcpAddr;                 // UDP客户端RTCP端口
+	bool waitKey = true;                 // 从关键帧开始发送, 由挂载点在推流线程中访问
+	bool sending = false;                // 当前帧已开始发送给该客户端, 分段发送时中途加入的客户端等下一帧
+
+	std::mutex mutex;                    // 保护output和套接字发送
+	std::string output;                  // 未发送完的数据
+	std::atomic_bool closed = false;
+
+	// 聚合发送多段数据, 发送缓冲区满时复制剩余部分暂存; 媒体数据暂存超过上限时丢弃并返回false
+	bool send(const IoSlice* slices, size_t count, bool media)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (closed)
+		{
+			return false;
+		}
+
+		size_t sent = 0;
+		if (output.empty())
+		{
+			int n = send_some_v(s, slices, count);
+			if (n < 0)
+			{
+				closed = true;
+				return false;
+			}
+			sent = size_t(n);
+		}
+		else if (media)
+		{
+			size_t len = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				len += slices[i].size;
+			}
+			if (output.size() + len > MAX_BACKLOG)
+			{
+				return false;
+			}
+		}
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const char* data = static_cast<const char*>(slices[i].data);
+			if (sent >= slices[i].size)
+			{
+				sent -= slices[i].size;
+				continue;
+			}
+			output.append(data + sent, slices[i].size - sent);
+			sent = 0;
+		}
+		return true;
+	}
+
+	bool send(const uint8_t* data, size_t len, bool media)
+	{
+		IoSlice slice = { data, len };
+		return send(&slice, 1, media);
+	}
+
+	bool send(const std::string& data)
+	{
+		return send(reinterpret_cast<const uint8_t*>(data.data()), data.size(), false);
+	}
+
+	// 套接字可写时发送暂存数据
+	bool flush()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (output.empty())
+		{
+			return true;
+		}
+
+		int n = send_some(s, output.data(), output.size());
+		if (n < 0)
+		{
+			return false;
+		}
+
+		output.erase(0, size_t(n));
+		return true;
+	}
+
+	bool has_output()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return !output.empty();
+	}
+};
+
+struct RtspUrl
+{
+	std::string host;
+	int port = 554;
+	std::string path;   // 不含首尾'/'
+};
+
+// rtsp://[user:pass@]host[:port]/path[?query]
+static bool parse_url(const std::string& url, RtspUrl& out)
+{
+	static const std::string SCHEME = "rtsp://";
+	if (url.size() <= SCHEME.size() || url.compare(0, SCHEME.size(), SCHEME) != 0)
+	{
+		return false;
+	}
+
+	size_t begin = SCHEME.size();
+	size_t slash = url.find('/', begin);
+	std::string authority = url.substr(begin, slash == std::string::npos ? std::string::npos : slash - begin);
+	std::string path = slash == std::string::npos ? std::string() : url.substr(slash + 1);
+
+	size_t at = authority.rfind('@');
+	if (at != std::string::npos)
+	{
+		authority = authority.substr(at + 1);
+	}
+
+	size_t colon = authority.rfind(':');
+	out.host = authority.substr(0, colon);
+	out.port = colon == std::string::npos ? 554 : std::atoi(authority.c_str() + colon + 1);
+
+	path = path.substr(0, path.find('?'));
+	while (!path.empty() && path.back() == '/')
+	{
+		path.pop_back();
+	}
+	out.path = path;
+
+	return !out.host.empty() && out.port > 0;
+}
+
+// 去掉SETUP地址中的轨道部分
+static std::string strip_track(const std::string& path)
+{
+	size_t pos = path.rfind("/trackID=");
+	return pos == std::string::npos ? path : path.substr(0, pos);
+}
+
+static std::string lower(std::string str)
+{
+	std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+	return str;
+}
+
+static std::string trim(const std::string& str)
+{
+	size_t begin = str.find_first_not_of(" \t");
+	size_t end = str.find_last_not_of(" \t\r");
+	return begin == std::string::npos ? std::string() : str.substr(begin, end - begin + 1);
+}
+
+static const char* reason_phrase(int code)
+{
+	switch (code)
+	{
+	case 200: return "OK";
+	case 400: return "Bad Request";
+	case 404: return "Not Found";
+	case 454: return "Session Not Found";
+	case 455: return "Method Not Valid in This State";
+	case 461: return "Unsupported Transport";
+	case 501: return "Not Implemented";
+	default: return "Error";
+	}
+}
+
+static std::string make_response(int code, const std::string& cseq, const std::string& headers = std::string(), const std::string& body = std::string())
+{
+	std::string response = "RTSP/1.0 " + std::to_string(code) + " " + reason_phrase(code) + "\r\n";
+	response += "CSeq: " + cseq + "\r\n";
+	response += "Server: VideoToRTSP\r\n";
+	response += headers;
+	if (!body.empty())
+	{
+		response += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+	}
+	response += "\r\n";
+	response += body;
+
+	return response;
+}
+
+// 解析"a-b"形式的端口或通道对
+static bool parse_pair(const std::string& transport, const std::string& key, int& first, int& second)
+{
+	size_t pos = transport.find(key);
+	if (pos == std::string::npos)
+	{
+		return false;
+	}
+
+	pos += key.size();
+	first = std::atoi(transport.c_str() + pos);
+	size_t dash = transport.find('-', pos);
+	size_t semi = transport.find(';', pos);
+	second = (dash != std::string::npos && dash < semi) ? std::atoi(transport.c_str() + dash + 1) : first + 1;
+
+	return true;
+}
+
+/**** RtspMount ****/
+
+RtspMount::RtspMount(RtspServer* server, const std::string& path) :m_server(server), m_path(path)
+{
+}
+
+RtspMount::~RtspMount()
+{
+	for (AVPacket*& packet : m_gopPackets)
+	{
+		av_packet_free(&packet);
+	}
+}
+
+bool RtspMount::init(const AVCodecParameters* codecpar)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_lastReport = std::chrono::steady_clock::now();
+	return m_packetizer.init(codecpar);
+}
+
+std::string RtspMount::sdp(const std::string& host)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::string sdp = "v=0\r\n";
+	sdp += "o=- " + std::to_string(m_packetizer.ssrc()) + " 1 IN IP4 " + host + "\r\n";
+	sdp += "s=VideoToRTSP\r\n";
+	sdp += "c=IN IP4 0.0.0.0\r\n";
+	sdp += "t=0 0\r\n";
+	sdp += "a=control:*\r\n";
+	sdp += "a=range:npt=0-\r\n";
+	sdp += m_packetizer.sdp_media();
+	sdp += "a=control:trackID=0\r\n";
+
+	return sdp;
+}
+
+void RtspMount::add_player(const std::shared_ptr<RtspSession>& session, const std::function<std::string(uint16_t seq, uint32_t rtptime)>& response)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (std::find(m_players.begin(), m_players.end(), session) == m_players.end())
+	{
+		m_players.push_back(session);
+	}
+
+	session->playing = true;
+	session->waitKey = true;
+	session->sending = false;
+
+	// 有GOP缓存时从缓存的关键帧开始, 当前帧已在缓存中, 剩余分段不再发送给该客户端
+	if (m_gopCount > 0)
+	{
+		RtpPacketizer packetizer = m_gopPacketizer;
+		RtpFrame frame;
+		packetizer.packetize(m_gopPackets[0], m_gopTimeBase, frame);
+		session->send(response(m_gopPacketizer.next_seq(), frame.timestamp));
+		send_gop(*session, packetizer, frame);
+		return;
+	}
+
+	session->send(response(m_packetizer.next_seq(), m_packetizer.last_timestamp()));
+}
+
+void RtspMount::remove_player(const std::shared_ptr<RtspSession>& session)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_players.erase(std::remove(m_players.begin(), m_players.end(), session), m_players.end());
+	session->playing = false;
+}
+
+void RtspMount::close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_closed = true;
+	for (auto& session : m_players)
+	{
+		session->closed = true;
+	}
+	m_players.clear();
+	clear_gop();
+}
+
+int RtspMount::write(const AVPacket* packet, AVRational timeBase)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_closed)
+	{
+		return -1;
+	}
+
+	cache_frame(packet, timeBase);
+	m_packetizer.packetize(packet, timeBase, m_frame);
+	m_cursor = m_frame.count();
+	for (auto& session : m_players)
+	{
+		send_range(*session, 0, m_frame.count());
+	}
+
+	check_report();
+	return 0;
+}
+
+int RtspMount::begin_frame(const AVPacket* packet, AVRational timeBase)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_closed)
+	{
+		return -1;
+	}
+
+	cache_frame(packet, timeBase);
+	m_packetizer.packetize(packet, timeBase, m_frame);
+	m_cursor = 0;
+
+	check_report();
+	return 0;
+}
+
+int64_t RtspMount::send_packets(int64_t budget)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_closed || m_cursor >= m_frame.count())
+	{
+		return 0;
+	}
+
+	// 至少发送一个包, 之后不超过预算
+	size_t first = m_cursor;
+	int64_t bytes = 0;
+	while (m_cursor < m_frame.count() && (m_cursor == first || bytes + m_frame.sizes[m_cursor] <= budget))
+	{
+		bytes += m_frame.sizes[m_cursor];
+		m_cursor++;
+	}
+
+	for (auto& session : m_players)
+	{
+		send_range(*session, first, m_cursor - first);
+	}
+
+	return bytes;
+}
+
+int64_t RtspMount::next_packet_size()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_closed || m_cursor >= m_frame.count())
+	{
+		return 0;
+	}
+
+	return m_frame.sizes[m_cursor];
+}
+
+size_t RtspMount::player_count()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_players.size();
+}
+
+void RtspMount::cache_frame(const AVPacket* packet, AVRational timeBase)
+{
+	bool key = (packet->flags & AV_PKT_FLAG_KEY) != 0;
+	if (m_gopLimit == 0 || (!key && m_gopCount == 0))
+	{
+		return;
+	}
+
+	if (key)
+	{
+		clear_gop();
+		m_gopPacketizer = m_packetizer;
+		m_gopTimeBase = timeBase;
+	}
+	else if (av_cmp_q(timeBase, m_gopTimeBase) != 0)
+	{
+		clear_gop();
+		return;
+	}
+
+	// 空闲的AVPacket复用, 推流器的帧都有引用计数, 只增加引用
+	if (m_gopCount == m_gopPackets.size())
+	{
+		AVPacket* free = av_packet_alloc();
+		if (free == NULL)
+		{
+			clear_gop();
+			return;
+		}
+		m_gopPackets.push_back(free);
+	}
+	m_gopBytes += size_t(packet->size);
+	if (m_gopBytes > m_gopLimit || av_packet_ref(m_gopPackets[m_gopCount], packet) < 0)
+	{
+		clear_gop();
+		return;
+	}
+	m_gopCount++;
+}
+
+void RtspMount::clear_gop()
+{
+	for (size_t i = 0; i < m_gopCount; i++)
+	{
+		av_packet_unref(m_gopPackets[i]);
+	}
+	m_gopCount = 0;
+	m_gopBytes = 0;
+}
+
+void RtspMount::send_gop(RtspSession& session, RtpPacketizer& packetizer, RtpFrame& frame)
+{
+	// 与实时帧相同逐帧发送, 未发送数据超过上限时放弃补发, 等下一个关键帧
+	for (size_t i = 0; i < m_gopCount; i++)
+	{
+		if (i > 0)
+		{
+			packetizer.packetize(m_gopPackets[i], m_gopTimeBase, frame);
+		}
+
+		if (session.tcp)
+		{
+			frame.set_channel(session.rtpChannel);
+			if (!session.send(frame.tcp.data(), frame.tcp.size(), true))
+			{
+				session.waitKey = true;
+				return;
+			}
+		}
+		else
+		{
+			udp_send_batch(m_server->m_rtpSocket, session.rtpAddr, frame.udp.data(), frame.count(), 2);
+		}
+	}
+
+	session.waitKey = false;
+}
+
+void RtspMount::check_report()
+{
+	auto now = std::chrono::steady_clock::now();
+	if (now - m_lastReport >= std::chrono::seconds(REPORT_INTERVAL))
+	{
+		send_report();
+		m_lastReport = now;
+	}
+}
+
+void RtspMount::send_range(RtspSession& session, size_t first, size_t count)
+{
+	if (session.closed || count == 0)
+	{
+		return;
+	}
+
+	// 帧的第一段决定是否发送给该客户端, 新加入或丢帧后的客户端从关键帧开始
+	if (first == 0)
+	{
+		session.sending = false;
+		if (session.waitKey)
+		{
+			if (!m_frame.key)
+			{
+				return;
+			}
+			session.waitKey = false;
+		}
+		session.sending = true;
+	}
+	else if (!session.sending)
+	{
+		return;
+	}
+
+	if (session.tcp)
+	{
+		// 多个包一次聚合发送, 交织头已预留在头部中
+		m_frame.set_channel(session.rtpChannel);
+		if (!session.send(m_frame.tcp.data() + first * 2, count * 2, true))
+		{
+			session.waitKey = true;
+			session.sending = false;
+		}
+		return;
+	}
+
+	udp_send_batch(m_server->m_rtpSocket, session.rtpAddr, m_frame.udp.data() + first * 2, count, 2);
+}
+
+void RtspMount::send_report()
+{
+	// NTP时间: 1900年起的秒数和秒的小数部分(1/2^32)
+	auto now = std::chrono::system_clock::now().time_since_epoch();
+	uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+	uint32_t ntpSec = uint32_t(us / 1000000 + 2208988800ULL);
+	uint32_t ntpFrac = uint32_t(((us % 1000000) << 32) / 1000000);
+
+	uint32_t words[] = { m_packetizer.ssrc(), ntpSec, ntpFrac, m_packetizer.last_timestamp(), m_packetizer.packet_count(), m_packetizer.octet_count() };
+
+	uint8_t buf[INTERLEAVED_HEADER_SIZE + 28] = { '$', 0, 0, 28 };
+	uint8_t* sr = buf + INTERLEAVED_HEADER_SIZE;
+	sr[0] = 0x80;   // V=2, 无接收报告块
+	sr[1] = 200;    // SR
+	sr[2] = 0;
+	sr[3] = 6;      // 长度(32位字数-1)
+	for (int i = 0; i < 6; i++)
+	{
+		sr[4 + i * 4] = uint8_t(words[i] >> 24);
+		sr[5 + i * 4] = uint8_t(words[i] >> 16);
+		sr[6 + i * 4] = uint8_t(words[i] >> 8);
+		sr[7 + i * 4] = uint8_t(words[i]);
+	}
+
+	for (auto& session : m_players)
+	{
+		if (session->closed || session->waitKey)
+		{
+			continue;
+		}
+
+		if (session->tcp)
+		{
+			buf[1] = session->rtcpChannel;
+			session->send(buf, sizeof(buf), true);
+		}
+		else
+		{
+			udp_send_to(m_server->m_rtcpSocket, session->rtcpAddr, reinterpret_cast<const char*>(sr), 28);
+		}
+	}
+}
+
+/**** RtspServer ****/
+
+RtspServer& RtspServer::instance()
+{
+	static RtspServer server;
+	return server;
+}
+
+RtspServer::~RtspServer()
+{
+	stop();
+}
+
+bool RtspServer::start(int port, int rtpPort)
+{
+	stop();
+
+	m_socket = tcp_listen("0.0.0.0", port);
+	if (m_socket == BAD_SOCKET)
+	{
+		spdlog::error("RTSP server listen on port {} failed", port);
+		return false;
+	}
+	set_nonblocking(m_socket, true);
+
+	// UDP端口被占用时只支持TCP传输
+	m_rtpSocket = udp_open("0.0.0.0", rtpPort);
+	m_rtcpSocket = udp_open("0.0.0.0", rtpPort + 1);
+	if (m_rtpSocket == BAD_SOCKET || m_rtcpSocket == BAD_SOCKET)
+	{
+		spdlog::warn("RTSP server UDP port {}-{} unavailable, TCP only", rtpPort, rtpPort + 1);
+		close_socket(m_rtpSocket);
+		close_socket(m_rtcpSocket);
+		m_rtpSocket = BAD_SOCKET;
+		m_rtcpSocket = BAD_SOCKET;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_localHosts = local_ipv4_addresses();
+		m_localHosts.push_back("127.0.0.1");
+		m_localHosts.push_back("localhost");
+		m_localHosts.push_back("0.0.0.0");
+	}
+
+	m_port = port;
+	m_rtpPort = rtpPort;
+	m_quit = false;
+	m_running = true;
+	t = std::thread(&RtspServer::serve, this);
+
+	spdlog::info("RTSP server started on port {}", port);
+	return true;
+}
+
+void RtspServer::stop()
+{
+	m_quit = true;
+	if (t.joinable())
+	{
+		t.join();
+	}
+
+	for (auto& session : std::vector<std::shared_ptr<RtspSession>>(m_sessions))
+	{
+		close_session(session);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (auto& [path, mount] : m_mounts)
+		{
+			mount->close();
+		}
+		m_mounts.clear();
+	}
+
+	close_socket(m_socket);
+	close_socket(m_rtpSocket);
+	close_socket(m_rtcpSocket);
+	m_socket = BAD_SOCKET;
+	m_rtpSocket = BAD_SOCKET;
+	m_rtcpSocket = BAD_SOCKET;
+	m_running = false;
+}
+
+bool RtspServer::is_local_url(const std::string& url)
+{
+	RtspUrl parsed;
+	if (!m_running || !parse_url(url, parsed) || parsed.port != m_port)
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::string host = lower(parsed.host);
+	return std::find(m_localHosts.begin(), m_localHosts.end(), host) != m_localHosts.end();
+}
+
+std::shared_ptr<RtspMount> RtspServer::publish(const std::string& url, const AVCodecParameters* codecpar)
+{
+	RtspUrl parsed;
+	if (!parse_url(url, parsed) || parsed.path.empty())
+	{
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_mounts.count(parsed.path) > 0)
+	{
+		spdlog::error("RTSP path {} is already published", parsed.path);
+		return nullptr;
+	}
+
+	auto mount = std::make_shared<RtspMount>(this, parsed.path);
+	mount->m_gopLimit = std::min<size_t>(m_gopCacheLimit, MAX_BACKLOG);
+	if (!mount->init(codecpar))
+	{
+		spdlog::error("RTSP server does not support codec {} for {}", int(codecpar->codec_id), parsed.path);
+		return nullptr;
+	}
+
+	m_mounts[parsed.path] = mount;
+	return mount;
+}
+
+void RtspServer::unpublish(const std::shared_ptr<RtspMount>& mount)
+{
+	if (!mount)
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto it = m_mounts.find(mount->path());
+		if (it != m_mounts.end() && it->second == mount)
+		{
+			m_mounts.erase(it);
+		}
+	}
+
+	mount->close();
+}
+
+std::shared_ptr<RtspMount> RtspServer::find_mount(const std::string& url)
+{
+	RtspUrl parsed;
+	if (!parse_url(url, parsed))
+	{
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_mounts.find(parsed.path);
+	if (it == m_mounts.end())
+	{
+		it = m_mounts.find(strip_track(parsed.path));
+	}
+
+	return it != m_mounts.end() ? it->second : nullptr;
+}
+
+void RtspServer::serve()
+{
+	auto lastCheck = std::chrono::steady_clock::now();
+	while (!m_quit)
+	{
+		// 监听套接字, UDP RTP/RTCP(如果可用), 各客户端连接
+		std::vector<std::shared_ptr<RtspSession>> sessions(m_sessions);
+		std::vector<PollItem> items(1);
+		items[0].s = m_socket;
+		if (m_rtpSocket != BAD_SOCKET)
+		{
+			items.resize(3);
+			items[1].s = m_rtpSocket;
+			items[2].s = m_rtcpSocket;
+		}
+
+		size_t first = items.size();
+		items.resize(first + sessions.size());
+		for (size_t i = 0; i < sessions.size(); i++)
+		{
+			items[first + i].s = sessions[i]->s;
+			items[first + i].write = sessions[i]->has_output();
+		}
+
+		if (poll_sockets(items, 200) < 0)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			continue;
+		}
+
+		if (items[0].readable)
+		{
+			accept_client();
+		}
+		if (first == 3 && items[1].readable)
+		{
+			receive_rtcp(m_rtpSocket);
+		}
+		if (first == 3 && items[2].readable)
+		{
+			receive_rtcp(m_rtcpSocket);
+		}
+
+		for (size_t i = 0; i < sessions.size(); i++)
+		{
+			const PollItem& item = items[first + i];
+			if ((item.readable || item.error) && !read_client(sessions[i]))
+			{
+				sessions[i]->closed = true;
+			}
+			if (item.writable && !sessions[i]->flush())
+			{
+				sessions[i]->closed = true;
+			}
+		}
+
+		auto now = std::chrono::steady_clock::now();
+		if (now - lastCheck >= std::chrono::seconds(1))
+		{
+			check_timeouts();
+			lastCheck = now;
+		}
+
+		for (auto& session : sessions)
+		{
+			if (session->closed)
+			{
+				close_session(session);
+			}
+		}
+	}
+}
+
+void RtspServer::accept_client()
+{
+	std::string peer;
+	socket_t s = tcp_accept(m_socket, &peer);
+	if (s == BAD_SOCKET)
+	{
+		return;
+	}
+
+	set_nonblocking(s, true);
+	set_nodelay(s, true);
+	set_send_buffer(s, SEND_BUFFER);
+
+	auto session = std::make_shared<RtspSession>();
+	session->s = s;
+	parse_ipv4(peer, session->peer.ip);
+	session->active = std::chrono::steady_clock::now();
+	m_sessions.push_back(session);
+	m_sessionCount = m_sessions.size();
+
+	spdlog::info("RTSP client {} connected", peer);
+}
+
+bool RtspServer::read_client(const std::shared_ptr<RtspSession>& session)
+{
+	char buf[4096];
+	int n = recv_some(session->s, buf, sizeof(buf));
+	if (n <= 0)
+	{
+		return false;
+	}
+
+	session->input.append(buf, size_t(n));
+	session->active = std::chrono::steady_clock::now();
+
+	std::string& input = session->input;
+	while (!input.empty() && !session->closed)
+	{
+		// 客户端通过TCP交织通道发送的RTCP, 丢弃
+		if (input[0] == '$')
+		{
+			if (input.size() < INTERLEAVED_HEADER_SIZE)
+			{
+				break;
+			}
+
+			size_t len = (size_t(uint8_t(input[2])) << 8) | uint8_t(input[3]);
+			if (input.size() < INTERLEAVED_HEADER_SIZE + len)
+			{
+				break;
+			}
+
+			input.erase(0, INTERLEAVED_HEADER_SIZE + len);
+			continue;
+		}
+
+		size_t end = input.find("\r\n\r\n");
+		if (end == std::string::npos)
+		{
+			return input.size() <= MAX_REQUEST;
+		}
+
+		// 带消息体的请求(如SET_PARAMETER)
+		size_t bodySize = 0;
+		std::string header = lower(input.substr(0, end));
+		size_t pos = header.find("content-length:");
+		if (pos != std::string::npos)
+		{
+			bodySize = size_t(std::atoi(header.c_str() + pos + 15));
+		}
+
+		if (input.size() < end + 4 + bodySize)
+		{
+			return bodySize <= MAX_REQUEST;
+		}
+
+		std::string request = input.substr(0, end + 4);
+		input.erase(0, end + 4 + bodySize);
+		handle_request(session, request);
+	}
+
+	return true;
+}
+
+void RtspServer::handle_request(const std::shared_ptr<RtspSession>& session, const std::string& request)
+{
+	// 请求行和头部
+	std::string method, url;
+	std::map<std::string, std::string> headers;
+	size_t lineEnd = request.find("\r\n");
+	{
+		std::string line = request.substr(0, lineEnd);
+		size_t sp1 = line.find(' ');
+		size_t sp2 = line.find(' ', sp1 + 1);
+		if (sp1 == std::string::npos || sp2 == std::string::npos)
+		{
+			session->send(make_response(400, "0"));
+			return;
+		}
+		method = line.substr(0, sp1);
+		url = line.substr(sp1 + 1, sp2 - sp1 - 1);
+	}
+
+	size_t pos = lineEnd + 2;
+	while (pos < request.size())
+	{
+		size_t end = request.find("\r\n", pos);
+		if (end == std::string::npos || end == pos)
+		{
+			break;
+		}
+
+		std::string line = request.substr(pos, end - pos);
+		size_t colon = line.find(':');
+		if (colon != std::string::npos)
+		{
+			headers[lower(trim(line.substr(0, colon)))] = trim(line.substr(colon + 1));
+		}
+		pos = end + 2;
+	}
+
+	std::string cseq = headers.count("cseq") ? headers["cseq"] : "0";
+	std::string sessionId = headers.count("session") ? trim(headers["session"].substr(0, headers["session"].find(';'))) : std::string();
+	bool validSession = !session->id.empty() && sessionId == session->id && session->mount;
+
+	if (method == "OPTIONS")
+	{
+		session->send(make_response(200, cseq, "Public: OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN, GET_PARAMETER, SET_PARAMETER\r\n"));
+	}
+	else if (method == "DESCRIBE")
+	{
+		RtspUrl parsed;
+		std::shared_ptr<RtspMount> mount = find_mount(url);
+		if (!mount || !parse_url(url, parsed))
+		{
+			session->send(make_response(404, cseq));
+			return;
+		}
+
+		std::string sdp = mount->sdp(parsed.host);
+		session->send(make_response(200, cseq, "Content-Base: " + url + "/\r\nContent-Type: application/sdp\r\n", sdp));
+	}
+	else if (method == "SETUP")
+	{
+		std::shared_ptr<RtspMount> mount = find_mount(url);
+		if (!mount)
+		{
+			session->send(make_response(404, cseq));
+			return;
+		}
+		if (session->playing)
+		{
+			session->send(make_response(455, cseq));
+			return;
+		}
+
+		std::string transport = headers["transport"];
+		std::string reply;
+		int first = 0;
+		int second = 0;
+		if (transport.find("RTP/AVP/TCP") != std::string::npos)
+		{
+			if (!parse_pair(transport, "interleaved=", first, second))
+			{
+				first = 0;
+				second = 1;
+			}
+			session->tcp = true;
+			session->rtpChannel = uint8_t(first);
+			session->rtcpChannel = uint8_t(second);
+			reply = "RTP/AVP/TCP;unicast;interleaved=" + std::to_string(first) + "-" + std::to_string(second);
+		}
+		else if (m_rtpSocket != BAD_SOCKET && transport.find("multicast") == std::string::npos && parse_pair(transport, "client_port=", first, second))
+		{
+			session->tcp = false;
+			session->rtpAddr = { session->peer.ip, uint16_t(first) };
+			session->rtcpAddr = { session->peer.ip, uint16_t(second) };
+			reply = "RTP/AVP;unicast;client_port=" + std::to_string(first) + "-" + std::to_string(second)
+				+ ";server_port=" + std::to_string(m_rtpPort) + "-" + std::to_string(m_rtpPort + 1);
+		}
+		else
+		{
+			session->send(make_response(461, cseq));
+			return;
+		}
+
+		if (session->id.empty())
+		{
+			std::random_device rd;
+			char id[17] = { 0 };
+			snprintf(id, sizeof(id), "%08X%08X", rd(), rd());
+			session->id = id;
+		}
+		session->mount = mount;
+		session->url = url;
+
+		char ssrc[9] = { 0 };
+		snprintf(ssrc, sizeof(ssrc), "%08X", mount->m_packetizer.ssrc());
+		reply += std::string(";ssrc=") + ssrc;
+		session->send(make_response(200, cseq, "Transport: " + reply + "\r\nSession: " + session->id + ";timeout=" + std::to_string(SESSION_TIMEOUT) + "\r\n"));
+	}
+	else if (method == "PLAY")
+	{
+		if (!validSession)
+		{
+			session->send(make_response(454, cseq));
+			return;
+		}
+
+		session->mount->add_player(session, [&](uint16_t seq, uint32_t rtptime)
+			{
+				return make_response(200, cseq, "Session: " + session->id + "\r\nRange: npt=0.000-\r\nRTP-Info: url=" + session->url
+					+ ";seq=" + std::to_string(seq) + ";rtptime=" + std::to_string(rtptime) + "\r\n");
+			});
+	}
+	else if (method == "PAUSE")
+	{
+		if (!validSession)
+		{
+			session->send(make_response(454, cseq));
+			return;
+		}
+
+		session->mount->remove_player(session);
+		session->send(make_response(200, cseq, "Session: " + session->id + "\r\n"));
+	}
+	else if (method == "TEARDOWN")
+	{
+		if (session->mount)
+		{
+			session->mount->remove_player(session);
+		}
+		session->send(make_response(200, cseq, "Session: " + session->id + "\r\n"));
+		session->closed = true;
+	}
+	else if (method == "GET_PARAMETER" || method == "SET_PARAMETER")
+	{
+		// 心跳
+		session->send(make_response(200, cseq, session->id.empty() ? std::string() : "Session: " + session->id + "\r\n"));
+	}
+	else
+	{
+		session->send(make_response(501, cseq));
+	}
+}
+
+void RtspServer::close_session(const std::shared_ptr<RtspSession>& session)
+{
+	// 先移出挂载点, 之后推流线程不再向该连接发送
+	if (session->mount)
+	{
+		session->mount->remove_player(session);
+		session->mount.reset();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(session->mutex);
+		session->closed = true;
+		close_socket(session->s);
+		session->s = BAD_SOCKET;
+	}
+
+	m_sessions.erase(std::remove(m_sessions.begin(), m_sessions.end(), session), m_sessions.end());
+	m_sessionCount = m_sessions.size();
+	spdlog::info("RTSP client {} disconnected", ipv4_string(session->peer.ip));
+}
+
+void RtspServer::receive_rtcp(socket_t s)
+{
+	char buf[2048];
+	NetAddress from;
+	if (udp_recv_from(s, buf, sizeof(buf), &from) < 0)
+	{
+		return;
+	}
+
+	// UDP客户端的接收报告作为心跳
+	for (auto& session : m_sessions)
+	{
+		if (!session->tcp && (session->rtcpAddr == from || session->rtpAddr == from))
+		{
+			session->active = std::chrono::steady_clock::now();
+			break;
+		}
+	}
+}
+
+void RtspServer::check_timeouts()
+{
+	auto now = std::chrono::steady_clock::now();
+	for (auto& session : m_sessions)
+	{
+		if (session->playing && session->tcp)
+		{
+			continue;
+		}
+
+		if (now - session->active > std::chrono::seconds(SESSION_TIMEOUT))
+		{
+			spdlog::info("RTSP session {} timeout", session->id);
+			session->closed = true;
+		}
+	}
+}
\ No newline at end of file
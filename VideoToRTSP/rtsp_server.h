@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "net_socket.h"
+#include "rtp_packetizer.h"
+
+struct RtspSession;
+class RtspServer;
+
+// 挂载点: 一个流路径, 由一个推流输出写入, 多个客户端播放
+// 每帧只打包一次, 同一份RTP包发送给所有客户端
+class RtspMount
+{
+public:
+	RtspMount(RtspServer* server, const std::string& path);
+	~RtspMount();
+
+	int write(const AVPacket* packet, AVRational timeBase);  // 打包并发送给所有播放中的客户端, 挂载点已关闭时返回<0
+	const std::string& path() const { return m_path; }
+
+	// 分段发送(流量整形): begin_frame只打包, 之后由send_packets按字节预算分多次发送
+	// 负载引用packet的数据, 整帧发完前packet不能释放
+	int begin_frame(const AVPacket* packet, AVRational timeBase);  // 挂载点已关闭时返回<0
+	int64_t send_packets(int64_t budget);   // 发送不超过budget字节的后续RTP包(至少一个), 返回发送的负载字节数
+	int64_t next_packet_size();             // 下一个待发送RTP包的长度, 当前帧已发完时返回0
+	size_t player_count();                  // 播放中的客户端数
+
+protected:
+	friend class RtspServer;
+
+	bool init(const AVCodecParameters* codecpar);
+	std::string sdp(const std::string& host);
+	// 加入播放: 由response按首个RTP包的seq/rtptime生成PLAY响应并发送, 之后补发GOP缓存, 期间推流线程不会插入数据
+	void add_player(const std::shared_ptr<RtspSession>& session, const std::function<std::string(uint16_t seq, uint32_t rtptime)>& response);
+	void remove_player(const std::shared_ptr<RtspSession>& session);
+	void close();   // 服务停止或推流结束, 断开所有客户端
+
+	void send_range(RtspSession& session, size_t first, size_t count);   // 发送当前帧的第first个起count个RTP包
+	void cache_frame(const AVPacket* packet, AVRational timeBase);   // 帧加入GOP缓存, 在打包前调用
+	void clear_gop();
+	void send_gop(RtspSession& session, RtpPacketizer& packetizer, RtpFrame& frame);   // 向新客户端补发GOP缓存, frame为已打包的第一帧
+	void check_report();
+	void send_report();   // RTCP发送端报告
+
+protected:
+	RtspServer* m_server;
+	std::string m_path;
+
+	std::mutex m_mutex;
+	bool m_closed = false;
+	RtpPacketizer m_packetizer;
+	RtpFrame m_frame;
+	size_t m_cursor = 0;   // 当前帧下一个待发送的包
+
+	// GOP缓存: 最近一个关键帧起的所有帧, 新客户端PLAY后先补发, 不等下一个关键帧
+	// 只保存帧的引用, 有客户端加入时才重新打包; 超过上限时清空, 等下一个关键帧重新开始
+	size_t m_gopLimit = 0;                 // 缓存上限(Byte), 0表示不缓存, 不超过客户端未发送数据上限
+	size_t m_gopBytes = 0;                 // 已缓存的帧数据量
+	size_t m_gopCount = 0;                 // 已缓存的帧数, m_gopPackets中之后的元素为空闲的AVPacket
+	std::vector<AVPacket*> m_gopPackets;   // 帧引用, 不复制数据
+	AVRational m_gopTimeBase = { 1, 1 };
+	RtpPacketizer m_gopPacketizer;         // 打包关键帧前的打包器状态, 重新打包得到与实时发送相同的序号和时间戳
+	std::vector<std::shared_ptr<RtspSession>> m_players;
+	std::chrono::steady_clock::time_point m_lastReport;
+};
+
+// 内置RTSP服务: 代替mediamtx, 推流器直接写入挂载点, 不经过ffmpeg RTSP封装和本地回环转发
+// 支持OPTIONS/DESCRIBE/SETUP/PLAY/PAUSE/TEARDOWN/GET_PARAMETER, RTP over TCP交织和UDP单播
+// 一个线程处理所有RTSP连接(poll), 媒体数据在推流调度线程中直接发送
+class RtspServer
+{
+public:
+	static RtspServer& instance();
+	~RtspServer();
+
+	bool start(int port, int rtpPort = 8000);   // RTP/RTCP使用rtpPort和rtpPort+1
+	void set_gop_cache(size_t limit) { m_gopCacheLimit = limit; }   // 之后发布的挂载点缓存最近一个GOP, limit为每个挂载点的上限(Byte, 不超过4MB), 0表示不缓存
+	void stop();
+
+	bool running() const { return m_running; }
+	int port() const { return m_port; }
+
+	bool is_local_url(const std::string& url);   // 流地址指向本服务(本机地址且端口一致)
+	std::shared_ptr<RtspMount> publish(const std::string& url, const AVCodecParameters* codecpar); // 路径已被占用或编码不支持时返回nullptr
+	void unpublish(const std::shared_ptr<RtspMount>& mount);
+
+	size_t session_count() const { return m_sessionCount; }   // 当前RTSP连接数
+
+protected:
+	friend class RtspMount;
+
+	RtspServer() = default;
+	void serve();
+	void accept_client();
+	bool read_client(const std::shared_ptr<RtspSession>& session);
+	void handle_request(const std::shared_ptr<RtspSession>& session, const std::string& request);
+	void close_session(const std::shared_ptr<RtspSession>& session);
+	void receive_rtcp(socket_t s);
+	void check_timeouts();
+
+	std::shared_ptr<RtspMount> find_mount(const std::string& url);
+
+protected:
+	std::atomic_bool m_quit = false;
+	std::atomic_bool m_running = false;
+	int m_port = 0;
+	int m_rtpPort = 0;
+	socket_t m_socket = BAD_SOCKET;       // RTSP监听
+	socket_t m_rtpSocket = BAD_SOCKET;    // UDP RTP发送
+	socket_t m_rtcpSocket = BAD_SOCKET;   // UDP RTCP发送和接收
+	std::vector<std::string> m_localHosts;   // 本机地址, 判断流地址是否指向本服务
+	std::atomic<size_t> m_sessionCount = 0;
+	std::atomic<size_t> m_gopCacheLimit = 0;
+
+	std::mutex m_mutex;
+	std::map<std::string, std::shared_ptr<RtspMount>> m_mounts;   // 路径 -> 挂载点
+	std::vector<std::shared_ptr<RtspSession>> m_sessions;         // 只在服务线程中访问
+	std::thread t;
+};
\ No newline at end of file
@@ -1,36 +1,153 @@
 #include <iostream>
 #include <filesystem>
-#include <windows.h>
+#include <algorithm>
+#include <spdlog/spdlog.h>
 #include "send_rtsp.h"
+#include "rtsp_server.h"
+#include "mmap_input.h"
 
-static std::string toUtf8(const std::string& str)
+// 创建输出流
+static int open_output(const std::string& url, const AVCodecParameters* codecpar, AVFormatContext** ppOutFmtCtx)
 {
-	int nwLen = MultiByteToWideChar(CP_ACP, 0, str.c_str(), -1, NULL, 0);
+	AVFormatContext* pOutFmtCtx = NULL;     // 输出流
+	AVStream* pOutStream = NULL;            // 输出视频流
+	AVCodec* pCodec = NULL;                 // 解码器
 
-	wchar_t* pwBuf = new wchar_t[nwLen + 1]; // 一定要加1，不然会出现尾巴
-	ZeroMemory(pwBuf, nwLen * 2 + 2);
+	// 创建输出上下文
+	int ret = avformat_alloc_output_context2(&pOutFmtCtx, NULL, "rtsp", url.c_str());
+	if (ret < 0)
+	{
+		return 50;
+	}
 
-	MultiByteToWideChar(CP_ACP, 0, str.c_str(), str.length(), pwBuf, nwLen);
+	// 创建一个新的流
+	pCodec = (AVCodec*)avcodec_find_encoder(pOutFmtCtx->oformat->video_codec);
+	if (pCodec == NULL)
+	{
+		ret = 60;
+		goto end;
+	}
 
-	int nLen = WideCharToMultiByte(CP_UTF8, 0, pwBuf, -1, NULL, NULL, NULL, NULL);
+	pOutStream = avformat_new_stream(pOutFmtCtx, pCodec);
+	if (pOutStream == NULL)
+	{
+		ret = 70;
+		goto end;
+	}
 
-	char* pBuf = new char[nLen + 1];
-	ZeroMemory(pBuf, nLen + 1);
+	// 复制配置信息
+	ret = avcodec_parameters_copy(pOutStream->codecpar, codecpar);
+	if (ret < 0)
+	{
+		ret = 80;
+		goto end;
+	}
+	pOutStream->codecpar->codec_tag = 0;
 
-	WideCharToMultiByte(CP_UTF8, 0, pwBuf, nwLen, pBuf, nLen, NULL, NULL);
+	// 写入头部信息
+	ret = avformat_write_header(pOutFmtCtx, NULL);
+	if (ret < 0)
+	{
+		ret = 90;
+		goto end;
+	}
 
-	std::string retStr(pBuf);
+	*ppOutFmtCtx = pOutFmtCtx;
+	return 0;
 
-	delete[] pwBuf;
-	delete[] pBuf;
+end:
+	avformat_free_context(pOutFmtCtx);
+	return ret;
+}
 
-	pwBuf = NULL;
-	pBuf = NULL;
+// 关闭输出流
+static void close_output(AVFormatContext** ppOutFmtCtx)
+{
+	AVFormatContext* pOutFmtCtx = *ppOutFmtCtx;
+	if (pOutFmtCtx && !(pOutFmtCtx->flags & AVFMT_NOFILE))
+	{
+		avio_close(pOutFmtCtx->pb);
+	}
 
-	return retStr;
+	avformat_free_context(pOutFmtCtx);
+	*ppOutFmtCtx = NULL;
 }
 
-RtspSender::RtspSender() :m_stop(false)
+// 关闭输出, 内置RTSP服务的输出注销挂载点
+static void close_output(RtspOutput& output)
+{
+	if (output.mount)
+	{
+		RtspServer::instance().unpublish(output.mount);
+		output.mount.reset();
+	}
+
+	close_output(&output.fmtCtx);
+
+	for (AVPacket*& packet : output.delayed)
+	{
+		av_packet_free(&packet);
+	}
+	for (AVPacket*& packet : output.spare)
+	{
+		av_packet_free(&packet);
+	}
+	output.delayed.clear();
+	output.spare.clear();
+	av_packet_free(&output.held);
+}
+
+// 通过ffmpeg RTSP封装写入一帧
+static int write_packet(RtspOutput& output, const AVPacket* packet, AVRational timeBase)
+{
+	AVPacket avPacket;
+	int ret = av_packet_ref(&avPacket, packet);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	// 计算转换时间戳
+	AVRational otime = output.fmtCtx->streams[0]->time_base;
+	avPacket.dts = av_rescale_q_rnd(packet->dts, timeBase, otime, (AVRounding)(AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX));
+	avPacket.pts = av_rescale_q_rnd(packet->pts, timeBase, otime, (AVRounding)(AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX));
+	if (output.lastDts != AV_NOPTS_VALUE && avPacket.dts <= output.lastDts)
+	{
+		avPacket.dts = output.lastDts + 1;
+	}
+	avPacket.pts = std::max(avPacket.pts, avPacket.dts);
+	output.lastDts = avPacket.dts;
+	avPacket.duration = 0;
+	avPacket.pos = -1;
+	avPacket.stream_index = 0;
+
+	ret = av_interleaved_write_frame(output.fmtCtx, &avPacket);
+	av_packet_unref(&avPacket);
+
+	return ret;
+}
+
+// 推流源名称, 用于日志和指标
+static std::string source_name(const RTSPConfig& config)
+{
+	if (config.source == SourceType::Pattern)
+	{
+		return config.pattern.name();
+	}
+
+	if (config.source == SourceType::Transcode && config.rendition < config.ladder.size())
+	{
+		return config.video + " [" + config.ladder[config.rendition].name() + "]";
+	}
+
+	return config.video;
+}
+
+// 预读队列为空时的重试间隔
+static constexpr auto UNDERRUN_RETRY = std::chrono::milliseconds(2);
+static constexpr int64_t SHAPE_MIN_BURST = 8 * RTP_MAX_PAYLOAD;      // 单路整形桶容量下限(Byte)
+
+RtspSender::RtspSender() :m_stop(false), m_opener(this), m_prefetcher(this), m_cache(0)
 {
 }
 
@@ -41,175 +158,1045 @@ RtspSender::~RtspSender()
 
 void RtspSender::async_send_rtsp(const RTSPConfig& config)
 {
-	t = std::thread(&RtspSender::send_rtsp, this, config);
+	stop();
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = true;
+		m_urls = { config.url };
+		m_pending.clear();
+		m_removed.clear();
+
+		RtspOutput output;
+		output.url = config.url;
+		m_pending.push_back(output);
+	}
+
+	m_config = config;
+	m_stop = false;
+	m_stats.reset();
+	MetricsRegistry::instance().add(&m_stats, source_name(config));
+	StreamScheduler::opener_instance().add(&m_opener, SteadyClock::now() + std::chrono::milliseconds(std::max(config.start_delay_ms, 0)));
 }
 
-int RtspSender::send_rtsp(const RTSPConfig& config)
+bool RtspSender::add_output(const std::string& url, int delayMs)
 {
-	m_stop = false;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_running)
+	{
+		return false;
+	}
 
-	if (!std::filesystem::exists(config.video))
+	if (m_urls.count(url) > 0)
 	{
-		return 10;
+		return true;
 	}
 
-	VideoInfo videoInfo = GetVideoInfo(config.video); // 视频信息
-	if (videoInfo.video_index == -1)
+	RtspOutput output;
+	output.url = url;
+	output.delay_ms = std::max(delayMs, 0);
+	m_pending.push_back(output);
+	m_urls.insert(url);
+
+	return true;
+}
+
+void RtspSender::remove_output(const std::string& url)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_urls.erase(url) == 0)
 	{
-		// 没有视频流
-		return 20;
+		return;
 	}
 
-	AVFormatContext* pInFmtCtx = NULL;      // 输入流
-	AVFormatContext* pOutFmtCtx = NULL;     // 输出流
-	AVStream* pOutStream = NULL;            // 输出视频流
-	AVCodec* pCodec = NULL;                 // 解码器
+	// 尚未被推流任务接收(等待开始或正在打开)的输出直接丢弃
+	for (auto it = m_pending.begin(); it != m_pending.end(); ++it)
+	{
+		if (it->url == url)
+		{
+			m_pending.erase(it);
+			return;
+		}
+	}
+
+	// 已打开的输出由推流任务下一次执行时关闭, 不等待
+	m_removed.push_back(url);
+}
+
+bool RtspSender::running()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_running;
+}
+
+const SenderStats& RtspSender::stats() const
+{
+	return m_stats;
+}
+
+size_t RtspSender::output_count()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_urls.size();
+}
+
+bool RtspSender::update_outputs(const AVCodecParameters* codecpar)
+{
+	std::vector<RtspOutput> pending;
+	std::vector<std::string> removed;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		pending.swap(m_pending);
+		removed.swap(m_removed);
+	}
+
+	// 先处理移除, 避免同一地址移除后又重新加入时被误删
+	for (const auto& url : removed)
+	{
+		for (auto it = m_outputs.begin(); it != m_outputs.end(); ++it)
+		{
+			if (it->url == url)
+			{
+				close_output(*it);
+				m_outputs.erase(it);
+				break;
+			}
+		}
+	}
+
+	for (auto& output : pending)
+	{
+		output.delay = av_rescale_q(output.delay_ms, av_make_q(1, 1000), m_timeBase);
+
+		// 指向内置RTSP服务的地址直接写入挂载点
+		if (RtspServer::instance().is_local_url(output.url))
+		{
+			output.mount = RtspServer::instance().publish(output.url, codecpar);
+			if (!output.mount)
+			{
+				spdlog::error("Publish {} to embedded RTSP server failed", output.url);
+				drop_output(output.url);
+				continue;
+			}
+
+			m_outputs.push_back(output);
+			continue;
+		}
+
+		int ret = open_output(output.url, codecpar, &output.fmtCtx);
+		if (ret != 0)
+		{
+			spdlog::error("Open output {} failed: {}", output.url, ret);
+			drop_output(output.url);
+			continue;
+		}
+
+		m_outputs.push_back(output);
+	}
+	m_stats.outputs.store(int64_t(m_outputs.size()), std::memory_order_relaxed);
+
+	// 没有输出时结束, 在锁内判断, 之后add_output返回false, 由调用方重新开始推流
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_outputs.empty() && m_pending.empty())
+	{
+		m_running = false;
+		return false;
+	}
+
+	return true;
+}
+
+void RtspSender::write_outputs(const AVPacket* packet, AVRational timeBase)
+{
+	for (auto it = m_outputs.begin(); it != m_outputs.end();)
+	{
+		RtspOutput& output = *it;
+
+		// 延迟输出写入到期的帧
+		const AVPacket* pkt = output.delay > 0 ? delay_packet(output, packet) : packet;
+
+		// 新加入的输出等待关键帧
+		if (pkt == NULL || (output.waitKey && !(pkt->flags & AV_PKT_FLAG_KEY)))
+		{
+			++it;
+			continue;
+		}
+		output.waitKey = false;
+
+		// 推帧, 单个输出失败不影响其他输出
+		auto writeStart = SteadyClock::now();
+		int ret = 0;
+		if (output.mount)
+		{
+			ret = m_shape ? output.mount->begin_frame(pkt, timeBase) : output.mount->write(pkt, timeBase);
+		}
+		else
+		{
+			ret = write_packet(output, pkt, timeBase);
+		}
+		m_stats.write_latency.observe(std::chrono::duration_cast<std::chrono::microseconds>(SteadyClock::now() - writeStart).count());
+		if (ret < 0)
+		{
+			spdlog::error("Write {} failed: {}", output.url, ret);
+			m_stats.write_errors.fetch_add(1, std::memory_order_relaxed);
+			drop_output(output.url);
+			close_output(output);
+			it = m_outputs.erase(it);
+			m_stats.outputs.store(int64_t(m_outputs.size()), std::memory_order_relaxed);
+			continue;
+		}
+
+		++it;
+	}
+}
+
+void RtspSender::drop_output(const std::string& url)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_urls.erase(url);
+}
+
+SteadyClock::time_point RtspSender::run()
+{
+	if (m_stop)
+	{
+		close();
+		return SteadyClock::time_point::max();
+	}
+
+	// 所有输出都已失效或被移除
+	if (!update_outputs(m_codecpar))
+	{
+		close();
+		return SteadyClock::time_point::max();
+	}
 
-	int frameNum = 0;       // 帧计数
-	int ret = 0;            // 错误码
+	// 推帧
+	if (m_packet && !m_shaping)
+	{
+		// 调度延迟: 实际发送时间晚于计划发送时间
+		auto now = SteadyClock::now();
+		m_stats.lateness.observe(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(now - m_deadline).count()));
+
+		write_outputs(m_packet, m_timeBase);
+		m_shaping = m_shape;
+
+		// 推流进度
+		int64_t bytes = m_stats.bytes.fetch_add(m_packet->size, std::memory_order_relaxed) + m_packet->size;
+		int64_t frames = m_stats.frames.fetch_add(1, std::memory_order_relaxed) + 1;
+		int64_t position = av_rescale_q(av_rescale(m_packet->dts, m_speed.num, m_speed.den) + m_frameDuration, m_timeBase, av_make_q(1, 1000000));
+		m_stats.position.store(position, std::memory_order_relaxed);
+
+		// 最近1秒码率、帧率和推流速度
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - m_rateTime).count();
+		if (elapsed >= 1000000)
+		{
+			m_stats.bitrate.store((bytes - m_rateBytes) * 8 * 1000000 / elapsed, std::memory_order_relaxed);
+			m_stats.frame_rate.store((frames - m_rateFrames) * 1000000 / elapsed, std::memory_order_relaxed);
+			m_stats.speed.store((position - m_ratePosition) * 1000 / elapsed, std::memory_order_relaxed);
+			m_rateTime = now;
+			m_rateBytes = bytes;
+			m_rateFrames = frames;
+			m_ratePosition = position;
+		}
+	}
+
+	if (m_packet)
+	{
+		// 挂载点分段发送, 整帧发完再取下一帧
+		if (m_shaping)
+		{
+			SteadyClock::time_point next = shape_outputs();
+			if (next != SteadyClock::time_point())
+			{
+				return next;
+			}
+			m_shaping = false;
+		}
+
+		recycle_packet(&m_packet);
+		m_frameNum++;
+	}
 
-	auto span = std::chrono::microseconds(int(1000 / videoInfo.fps * 1000)); // 帧间隔
-	decltype(std::chrono::high_resolution_clock::now()) startTime; // 开始推流时间
+	// 从预读队列取出下一帧
+	if (!m_ready.pop(m_packet))
+	{
+		// 读取任务落后, 稍后重试; 每次断流只计一次
+		if (!m_readEnd.load(std::memory_order_acquire))
+		{
+			if (!m_starved)
+			{
+				m_starved = true;
+				m_stats.underruns.fetch_add(1, std::memory_order_relaxed);
+			}
+			return SteadyClock::now() + UNDERRUN_RETRY;
+		}
+
+		// 读取已结束, 再取一次避免漏掉结束前放入的帧, 队列取完时推流结束
+		if (!m_ready.pop(m_packet))
+		{
+			close();
+			return SteadyClock::time_point::max();
+		}
+	}
+	m_starved = false;
+
+	// 控制推帧速度: 按DTS发送, 不限速时立即发送(输出阻塞或发送缓冲区满时自然限速)
+	m_deadline = m_unpaced ? SteadyClock::now() : m_startTime + std::chrono::microseconds(av_rescale_q(m_packet->dts, m_timeBase, av_make_q(1, 1000000)));
+	return m_deadline;
+}
+
+SteadyClock::time_point RtspSender::start()
+{
+	if (m_stop)
+	{
+		return SteadyClock::time_point::max();
+	}
+
+	// 开始前流地址已全部移除, 不再打开
+	bool removed = false;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		removed = m_urls.empty();
+		if (removed)
+		{
+			m_running = false;
+		}
+	}
+	if (removed)
+	{
+		close();
+		return SteadyClock::time_point::max();
+	}
+
+	// 打开文件、建立关键帧索引、编码测试图案或打开转码器可能耗时较长, 不在发送调度器中执行
+	m_error = open();
+	if (m_error != 0)
+	{
+		spdlog::error("Open {} failed: {}", source_name(m_config), m_error);
+		close();
+		return SteadyClock::time_point::max();
+	}
+
+	StreamScheduler::instance().add(this);
+	return SteadyClock::time_point::max();
+}
+
+SteadyClock::time_point RtspSender::prefetch()
+{
+	auto now = SteadyClock::now();
+	while (m_readDeadline - now < m_prefetch)
+	{
+		// 队列已满(帧率很高或预读时长很长), 等发送任务取走一部分; 不限速时队列消耗很快, 短间隔补充
+		if (m_ready.size() >= m_ready.capacity())
+		{
+			return m_unpaced ? now + UNDERRUN_RETRY : now + m_prefetch / 4;
+		}
+
+		AVPacket* packet = NULL;
+		if (!m_free.pop(packet))
+		{
+			packet = av_packet_alloc();
+		}
+
+		int ret = packet != NULL ? read_packet(packet) : AVERROR(ENOMEM);
+		if (ret == AVERROR(EAGAIN))
+		{
+			// 转码输出还没有就绪, 稍后重试
+			av_packet_free(&packet);
+			return now + UNDERRUN_RETRY;
+		}
+
+		if (ret < 0 || filter_packet(packet) < 0)
+		{
+			av_packet_free(&packet);
+			m_readEnd.store(true, std::memory_order_release);
+			return SteadyClock::time_point::max();
+		}
+
+		// 变速回放: 时间戳按倍数缩放, 接收端看到的时钟与发送节奏一致
+		if (m_speed.num != m_speed.den)
+		{
+			packet->dts = av_rescale(packet->dts, m_speed.den, m_speed.num);
+			packet->pts = av_rescale(packet->pts, m_speed.den, m_speed.num);
+			packet->duration = av_rescale(packet->duration, m_speed.den, m_speed.num);
+		}
+
+		// 不限速时预读截止时间不前进, 一直读到队列满
+		if (!m_unpaced)
+		{
+			m_readDeadline = m_startTime + std::chrono::microseconds(av_rescale_q(packet->dts, m_timeBase, av_make_q(1, 1000000)));
+		}
+		m_ready.push(packet);
+	}
+
+	// 预读量降到一半时继续读取
+	return m_readDeadline - m_prefetch / 2;
+}
+
+const AVPacket* RtspSender::delay_packet(RtspOutput& output, const AVPacket* packet)
+{
+	AVPacket* ref = NULL;
+	if (!output.spare.empty())
+	{
+		ref = output.spare.back();
+		output.spare.pop_back();
+	}
+	else
+	{
+		ref = av_packet_alloc();
+	}
+
+	if (ref != NULL && av_packet_ref(ref, packet) >= 0)
+	{
+		output.delayed.push_back(ref);
+	}
+	else
+	{
+		av_packet_free(&ref);
+	}
+
+	// 以当前帧的DTS为时钟, 帧率恒定时每次正好到期一帧
+	if (output.delayed.empty() || output.delayed.front()->dts + output.delay > packet->dts)
+	{
+		return NULL;
+	}
+
+	if (output.held)
+	{
+		av_packet_unref(output.held);
+		output.spare.push_back(output.held);
+	}
+	output.held = output.delayed.front();
+	output.delayed.pop_front();
+
+	return output.held;
+}
+
+SteadyClock::time_point RtspSender::shape_outputs()
+{
+	TokenBucket& total = TokenBucket::global();
+	while (true)
+	{
+		// 按各挂载点下一个包的最大长度判断令牌, 延迟输出的挂载点发送的是较早的帧
+		int64_t chunk = 0;
+		size_t players = 0;
+		for (auto& output : m_outputs)
+		{
+			int64_t size = output.mount ? output.mount->next_packet_size() : 0;
+			if (size > 0)
+			{
+				chunk = std::max(chunk, size);
+				players += output.mount->player_count();
+			}
+		}
+
+		if (chunk == 0)
+		{
+			return SteadyClock::time_point();
+		}
+
+		// 总出口按实际发出的份数计费; 令牌够发一个包时按剩余令牌发送, 桶容量不足一包时允许透支
+		int64_t fanout = int64_t(players);
+		bool limited = fanout > 0 && total.enabled();
+		auto now = SteadyClock::now();
+		SteadyClock::time_point next = m_shaper.ready_time(now, chunk);
+		if (limited)
+		{
+			next = std::max(next, total.ready_time(now, chunk * fanout));
+		}
+		if (next > now)
+		{
+			return next;
+		}
+
+		int64_t budget = m_shaper.available(now);
+		if (limited)
+		{
+			budget = std::min(budget, total.available(now) / fanout);
+		}
+		budget = std::max(budget, chunk);
+
+		int64_t sent = 0;
+		for (auto& output : m_outputs)
+		{
+			if (output.mount)
+			{
+				sent = std::max(sent, output.mount->send_packets(budget));
+			}
+		}
+		m_shaper.consume(sent);
+		total.consume(sent * fanout);
+	}
+}
+
+void RtspSender::recycle_packet(AVPacket** packet)
+{
+	av_packet_unref(*packet);
+	if (!m_free.push(*packet))
+	{
+		av_packet_free(packet);
+	}
+	*packet = NULL;
+}
+
+int RtspSender::open_file()
+{
+	if (!std::filesystem::exists(m_config.video))
+	{
+		return 10;
+	}
+
+	m_videoInfo = GetVideoInfo(m_config.video);
+	if (m_videoInfo.video_index == -1)
+	{
+		// 没有视频流
+		return 20;
+	}
 
 	// 打开文件
-	ret = avformat_open_input(&pInFmtCtx, toUtf8(config.video).c_str(), NULL, NULL);
+	int ret = OpenInputFile(&m_inFmtCtx, m_config.video);
 	if (ret < 0)
 	{
-		ret = 30;
-		goto end;
+		return 30;
 	}
 
 	// 获取流信息
-	ret = avformat_find_stream_info(pInFmtCtx, NULL);
+	ret = avformat_find_stream_info(m_inFmtCtx, NULL);
 	if (ret != 0)
 	{
-		ret = 40;
-		goto end;
+		return 40;
 	}
 
-	// 创建输出上下文
-	ret = avformat_alloc_output_context2(&pOutFmtCtx, NULL, "rtsp", config.url.c_str());
-	if (ret < 0)
+	// 保存视频流参数, 缓存推流时输入文件已关闭
+	m_codecpar = avcodec_parameters_alloc();
+	if (m_codecpar == NULL || avcodec_parameters_copy(m_codecpar, m_inFmtCtx->streams[m_videoInfo.video_index]->codecpar) < 0)
 	{
-		ret = 50;
-		goto end;
+		return 80;
 	}
 
-	// 创建一个新的流
-	pCodec = (AVCodec*)avcodec_find_encoder(pOutFmtCtx->oformat->video_codec);
-	if (pCodec == NULL)
+	// 区间推流时只缓存区间内的帧, 文件较大也尝试缓存, 超过上限时仍每轮从文件读取
+	bool segment = m_config.start_offset > 0 || m_config.end_offset > 0;
+	m_cache.reset(m_videoInfo.size <= m_config.cache_limit || segment ? m_config.cache_limit : 0);
+	m_timeBase = m_inFmtCtx->streams[m_videoInfo.video_index]->time_base;
+
+	return 0;
+}
+
+int RtspSender::open_pattern()
+{
+	m_pattern = PatternGop::get(m_config.pattern);
+	if (!m_pattern)
 	{
-		ret = 60;
-		goto end;
+		return 30;
 	}
 
-	pOutStream = avformat_new_stream(pOutFmtCtx, pCodec);
-	if (pOutStream == NULL)
+	m_codecpar = avcodec_parameters_alloc();
+	if (m_codecpar == NULL || avcodec_parameters_copy(m_codecpar, m_pattern->codecpar()) < 0)
 	{
-		ret = 70;
-		goto end;
+		return 80;
 	}
 
-	// 复制配置信息
-	ret = avcodec_parameters_copy(pOutStream->codecpar, pInFmtCtx->streams[videoInfo.video_index]->codecpar);
-	if (ret < 0)
+	// 一个GOP即一轮, 时长和数据量用于流量整形
+	m_videoInfo = VideoInfo();
+	m_videoInfo.url = m_config.pattern.name();
+	m_videoInfo.size = m_pattern->bytes();
+	m_videoInfo.fps = m_config.pattern.fps;
+	m_videoInfo.duration = double(m_pattern->size()) / m_config.pattern.fps;
+	m_videoInfo.width = m_codecpar->width;
+	m_videoInfo.height = m_codecpar->height;
+	m_videoInfo.stream_num = 1;
+	m_videoInfo.video_index = 0;
+	m_videoInfo.encode = m_codecpar->codec_id == AV_CODEC_ID_HEVC ? EncodeType::HEVC : EncodeType::H264;
+	m_cache.reset(0);
+	m_timeBase = m_pattern->time_base();
+
+	return 0;
+}
+
+int RtspSender::open_annexb()
+{
+	m_codecpar = avcodec_parameters_alloc();
+	if (m_codecpar == NULL || avcodec_parameters_copy(m_codecpar, m_annexb->codecpar()) < 0)
 	{
-		ret = 80;
-		goto end;
+		return 80;
 	}
-	pOutStream->codecpar->codec_tag = 0;
 
-	// 写入头部信息
-	ret = avformat_write_header(pOutFmtCtx, NULL);
-	if (ret < 0)
+	// 视频信息直接取自索引, 不使用按ffmpeg探测结果缓存的信息
+	m_videoInfo = VideoInfo();
+	m_videoInfo.url = m_config.video;
+	m_videoInfo.size = m_annexb->bytes();
+	m_videoInfo.fps = av_q2d(m_annexb->frame_rate());
+	m_videoInfo.duration = m_annexb->duration();
+	m_videoInfo.width = m_codecpar->width;
+	m_videoInfo.height = m_codecpar->height;
+	m_videoInfo.stream_num = 1;
+	m_videoInfo.video_index = 0;
+	m_videoInfo.encode = m_codecpar->codec_id == AV_CODEC_ID_HEVC ? EncodeType::HEVC : EncodeType::H264;
+	m_cache.reset(0);
+	m_timeBase = m_annexb->time_base();
+
+	return 0;
+}
+
+int RtspSender::open_transcode()
+{
+	if (m_config.rendition >= m_config.ladder.size())
 	{
-		ret = 90;
-		goto end;
+		return 10;
 	}
 
-	startTime = std::chrono::high_resolution_clock::now();
-	for (int i = 0; i < config.loop; i++)
+	m_ladder = TranscodeLadder::get(m_config.video, m_config.ladder, m_config.loop);
+	if (!m_ladder)
 	{
-		// 时间基数
-		AVRational timeBase = av_make_q(1000, int(videoInfo.fps * 1000 + 0.5));
-		AVRational otime = pOutFmtCtx->streams[videoInfo.video_index]->time_base;
+		return 30;
+	}
+
+	// 一个档位只能由一个推流器读取, 同一档位的多个地址由该推流器分发
+	if (!m_ladder->attach(m_config.rendition))
+	{
+		spdlog::error("Transcode rendition {} of {} is already read by another sender, add {} as an output of that sender", m_config.rendition, m_config.video, m_config.url);
+		m_ladder.reset();
+		return 40;
+	}
+
+	m_codecpar = avcodec_parameters_alloc();
+	if (m_codecpar == NULL || avcodec_parameters_copy(m_codecpar, m_ladder->codecpar(m_config.rendition)) < 0)
+	{
+		return 80;
+	}
+
+	// 时长未知, 按编码码率折算为1秒的数据量, 用于流量整形
+	m_videoInfo = VideoInfo();
+	m_videoInfo.url = source_name(m_config);
+	m_videoInfo.size = m_codecpar->bit_rate / 8;
+	m_videoInfo.duration = 1;
+	m_videoInfo.fps = av_q2d(m_ladder->frame_rate());
+	m_videoInfo.width = m_codecpar->width;
+	m_videoInfo.height = m_codecpar->height;
+	m_videoInfo.stream_num = 1;
+	m_videoInfo.video_index = 0;
+	m_videoInfo.encode = m_codecpar->codec_id == AV_CODEC_ID_HEVC ? EncodeType::HEVC : EncodeType::H264;
+	m_cache.reset(0);
+	m_timeBase = m_ladder->time_base();
 
-		AVPacket avPacket;
-		while (true)
+	return 0;
+}
+
+void RtspSender::find_segment()
+{
+	m_firstIndex = 0;
+	m_segmentStart = INT64_MIN;
+	m_segmentEnd = INT64_MAX;
+	m_segmentPos = -1;
+	if (m_config.source != SourceType::File || (m_config.start_offset <= 0 && m_config.end_offset <= 0))
+	{
+		return;
+	}
+
+	// 在打开线程中执行, 索引建立完成前推流器不加入调度, 不占用推流线程
+	std::vector<KeyFrame> keys = GetKeyframeIndex(m_config.video);
+	if (keys.empty())
+	{
+		spdlog::warn("{}: no keyframe index, ignore start/end offset", m_config.video);
+		return;
+	}
+
+	// 不晚于start_offset的最后一个关键帧
+	auto it = std::upper_bound(keys.begin(), keys.end(), m_config.start_offset, [](double time, const KeyFrame& key) { return time < key.time; });
+	const KeyFrame& key = it == keys.begin() ? keys.front() : *(it - 1);
+	m_segmentStart = key.dts;
+	m_segmentPos = key.pos;
+	if (m_config.end_offset > key.time)
+	{
+		m_segmentEnd = key.dts + av_rescale_q(int64_t((m_config.end_offset - key.time) * AV_TIME_BASE), av_make_q(1, AV_TIME_BASE), m_timeBase);
+	}
+
+	// Annex-B裸流的DTS即帧序号, 直接从起始帧读取
+	if (m_annexb)
+	{
+		m_firstIndex = size_t(key.dts);
+	}
+
+	spdlog::info("{}: segment {:.3f}s - {}", m_config.video, key.time, m_segmentEnd != INT64_MAX ? fmt::format("{:.3f}s", m_config.end_offset) : std::string("end"));
+}
+
+int RtspSender::seek_segment()
+{
+	m_seeking = m_segmentStart != INT64_MIN && !m_annexb;
+	if (!m_seeking)
+	{
+		return 0;
+	}
+
+	// 定位到不晚于起始关键帧的位置, 之前的帧在读取时丢弃; 不支持按时间戳定位的格式按文件位置定位
+	int ret = avformat_seek_file(m_inFmtCtx, m_videoInfo.video_index, INT64_MIN, m_segmentStart, m_segmentStart, 0);
+	if (ret < 0 && m_segmentPos >= 0)
+	{
+		ret = av_seek_frame(m_inFmtCtx, -1, m_segmentPos, AVSEEK_FLAG_BYTE);
+	}
+
+	return ret;
+}
+
+int RtspSender::open()
+{
+	// Annex-B裸流按索引推流, 建立索引失败时仍由ffmpeg解复用
+	m_annexb = m_config.source == SourceType::File ? AnnexBStream::open(m_config.video) : nullptr;
+	int ret = 0;
+	if (m_config.source == SourceType::Pattern)
+	{
+		ret = open_pattern();
+	}
+	else if (m_config.source == SourceType::Transcode)
+	{
+		ret = open_transcode();
+	}
+	else
+	{
+		ret = m_annexb ? open_annexb() : open_file();
+	}
+	if (ret != 0)
+	{
+		return ret;
+	}
+
+	find_segment();
+	if (seek_segment() < 0)
+	{
+		return 50;
+	}
+
+	if (open_bsf() < 0)
+	{
+		return 60;
+	}
+
+	m_cached = false;
+	m_cacheIndex = m_firstIndex;
+	m_loopCount = 0;
+	m_frameNum = 0;
+	double fps = m_videoInfo.fps > 0 ? m_videoInfo.fps : 25;
+	m_frameDuration = std::max<int64_t>(1, av_rescale_q(1, av_make_q(1000, int(fps * 1000 + 0.5)), m_timeBase));
+	m_maxGap = av_rescale_q(10, av_make_q(1, 1), m_timeBase);
+	m_tsOffset = 0;
+	m_lastDts = AV_NOPTS_VALUE;
+	m_nextDts = 0;
+	m_newPass = true;
+	m_startTime = SteadyClock::now();
+	m_deadline = m_startTime;
+	m_passEnd = SteadyClock::time_point();
+	m_rateTime = m_startTime;
+	m_rateBytes = 0;
+	m_rateFrames = 0;
+	m_ratePosition = 0;
+
+	// 回放速度换算为分数, 最低0.01倍
+	m_unpaced = m_config.speed <= 0;
+	m_speed = m_unpaced ? av_make_q(1, 1) : av_d2q(std::max(m_config.speed, 0.01), 1000);
+
+	// 流量整形: 按文件平均码率(乘回放速度)的shape_peak倍发送, 码率未知或不限速时只受总出口限速
+	m_shaping = false;
+	if (m_config.shape_peak > 0 && m_videoInfo.duration > 0 && !m_unpaced)
+	{
+		int64_t rate = int64_t(m_videoInfo.size / m_videoInfo.duration * av_q2d(m_speed) * m_config.shape_peak);
+		m_shaper.configure(rate, std::max(SHAPE_MIN_BURST, rate / 500));
+	}
+	else
+	{
+		m_shaper.configure(0, 0);
+	}
+	m_shape = m_shaper.enabled() || TokenBucket::global().enabled();
+
+	// 预读队列: 容纳预读时长内(按回放速度)的帧并留有余量, 不限速时加大余量
+	m_prefetch = std::chrono::milliseconds(std::max(m_config.prefetch_ms, 1));
+	m_ready.reset(size_t(fps * av_q2d(m_speed) * std::max(m_config.prefetch_ms, 1) / 1000) + (m_unpaced ? 1024 : 64));
+	m_free.reset(m_ready.capacity());
+	m_readEnd = false;
+	m_readDeadline = m_startTime;
+	m_starved = false;
+
+	// 先在当前线程预读第一批帧, 再交给预读调度器
+	SteadyClock::time_point next = prefetch();
+	if (next != SteadyClock::time_point::max())
+	{
+		StreamScheduler::reader_instance().add(&m_prefetcher, next);
+	}
+
+	return 0;
+}
+
+void RtspSender::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
+		m_urls.clear();
+		m_pending.clear();
+		m_removed.clear();
+	}
+
+	// 先停止预读任务, 之后队列只在当前线程访问
+	StreamScheduler::reader_instance().remove(&m_prefetcher);
+
+	for (auto& output : m_outputs)
+	{
+		close_output(output);
+	}
+	m_outputs.clear();
+
+	CloseInputFile(&m_inFmtCtx);
+
+	avcodec_parameters_free(&m_codecpar);
+	av_packet_free(&m_packet);
+	AVPacket* packet = NULL;
+	while (m_ready.pop(packet) || m_free.pop(packet))
+	{
+		av_packet_free(&packet);
+	}
+	m_cache.reset(0);
+	m_pattern.reset();
+	m_annexb.reset();
+	if (m_ladder)
+	{
+		m_ladder->detach(m_config.rendition);
+		m_ladder.reset();
+	}
+	av_bsf_free(&m_bsf);
+
+	m_stats.outputs = 0;
+	m_stats.bitrate = 0;
+	MetricsRegistry::instance().remove(&m_stats);
+}
+
+int RtspSender::read_packet(AVPacket* packet)
+{
+	if (m_ladder)
+	{
+		// 转码: 取本路档位的编码输出, 时间戳已按帧序号连续递增
+		int ret = m_ladder->read(m_config.rendition, packet);
+		if (ret >= 0)
+		{
+			m_stats.packet_allocs.fetch_add(1, std::memory_order_relaxed);
+			rebase_timestamps(packet);
+			observe_restart();
+		}
+		return ret;
+	}
+
+	while (m_loopCount < m_config.loop)
+	{
+		if (m_pattern)
 		{
-			if (m_stop)
+			// 测试图案: 引用共享GOP中的帧, 时间戳按本路重定基
+			if (m_cacheIndex < m_pattern->size())
 			{
-				goto end;
+				int ret = av_packet_ref(packet, m_pattern->at(m_cacheIndex++));
+				if (ret >= 0)
+				{
+					m_stats.packet_refs.fetch_add(1, std::memory_order_relaxed);
+					rebase_timestamps(packet);
+					observe_restart();
+				}
+				return ret;
 			}
-
-			if (av_read_frame(pInFmtCtx, &avPacket) == AVERROR_EOF)
+		}
+		else if (m_annexb)
+		{
+			// Annex-B裸流: 按索引引用映射内存中的帧, 文件已在页缓存中, 循环时不需要内存缓存
+			if (m_cacheIndex < m_annexb->size() && int64_t(m_cacheIndex) < m_segmentEnd)
 			{
-				av_packet_unref(&avPacket);
-				break;
+				int ret = m_annexb->make_packet(m_cacheIndex++, packet);
+				if (ret >= 0)
+				{
+					m_stats.packet_refs.fetch_add(1, std::memory_order_relaxed);
+					rebase_timestamps(packet);
+					observe_restart();
+				}
+				return ret;
 			}
-
-			if (avPacket.stream_index == videoInfo.video_index)
+		}
+		else if (m_cached)
+		{
+			// 从内存缓存读取
+			if (m_cacheIndex < m_cache.size())
 			{
-				// 计算转换时间戳
-				avPacket.pts = av_rescale_q_rnd(frameNum, timeBase, otime, (AVRounding)(AV_ROUND_NEAR_INF | AV_ROUND_NEAR_INF));
-				avPacket.dts = avPacket.pts;
-				avPacket.duration = 0;
-				avPacket.pos = -1;
-
-				// 控制推帧速度
-				std::this_thread::sleep_until(startTime + span * frameNum);
-
-				// 推帧
-				ret = av_interleaved_write_frame(pOutFmtCtx, &avPacket);
-				if (ret < 0)
+				int ret = av_packet_ref(packet, m_cache.at(m_cacheIndex++));
+				if (ret >= 0)
 				{
-					break;
+					m_stats.packet_refs.fetch_add(1, std::memory_order_relaxed);
+					rebase_timestamps(packet);
+					observe_restart();
 				}
+				return ret;
+			}
+		}
+		else if (av_read_frame(m_inFmtCtx, packet) >= 0)
+		{
+			if (packet->stream_index != m_videoInfo.video_index)
+			{
+				av_packet_unref(packet);
+				continue;
+			}
 
-				frameNum++;
+			// 区间推流: 丢弃定位点到起始关键帧之间的帧, 读到结束位置即本轮结束
+			int64_t dts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+			if (m_seeking && dts != AV_NOPTS_VALUE && dts < m_segmentStart)
+			{
+				av_packet_unref(packet);
+				continue;
+			}
+			m_seeking = false;
 
-				// 推流进度
-				if (config.callback)
+			if (dts == AV_NOPTS_VALUE || dts < m_segmentEnd)
+			{
+				// 首轮推流同时缓存视频帧; 帧数据由解复用器逐帧申请
+				m_stats.packet_allocs.fetch_add(1, std::memory_order_relaxed);
+				if (m_config.loop > 1)
 				{
-					config.callback(frameNum / (videoInfo.fps * videoInfo.duration));
+					m_cache.append(packet);
 				}
+
+				rebase_timestamps(packet);
+				observe_restart();
+				return 0;
 			}
-			av_packet_unref(&avPacket);
+			av_packet_unref(packet);
+		}
+
+		// 本轮结束
+		m_passEnd = SteadyClock::now();
+		m_stats.loops.fetch_add(1, std::memory_order_relaxed);
+		m_loopCount++;
+		m_cacheIndex = m_firstIndex;
+		m_newPass = true;
+		if (m_loopCount >= m_config.loop || m_cached || m_pattern || m_annexb)
+		{
+			continue;
+		}
+
+		// 缓存完整, 关闭文件, 后续循环从内存推流
+		if (m_config.loop > 1 && m_cache.size() > 0 && !m_cache.overflow())
+		{
+			m_cached = true;
+			CloseInputFile(&m_inFmtCtx);
+			continue;
 		}
 
 		// 重新打开文件
-		avio_closep(&pInFmtCtx->pb);
-		avformat_close_input(&pInFmtCtx);
-		ret = avformat_open_input(&pInFmtCtx, toUtf8(config.video).c_str(), NULL, NULL);
-		if (ret < 0)
+		CloseInputFile(&m_inFmtCtx);
+		if (OpenInputFile(&m_inFmtCtx, m_config.video) < 0 || seek_segment() < 0)
 		{
-			ret = 20;
-			goto end;
+			m_error = 20;
+			return AVERROR(EIO);
 		}
 	}
 
-end:
-	if (pInFmtCtx)
+	return AVERROR_EOF;
+}
+
+int RtspSender::open_bsf()
+{
+	if (!m_config.repeat_headers || (m_codecpar->codec_id != AV_CODEC_ID_H264 && m_codecpar->codec_id != AV_CODEC_ID_HEVC))
 	{
-		avio_closep(&pInFmtCtx->pb);
-		avformat_close_input(&pInFmtCtx);
+		return 0;
 	}
 
-	if (pOutFmtCtx && !(pOutFmtCtx->flags & AVFMT_NOFILE))
+	// avcC/hvcC的extradata第一个字节为版本号1, Annex-B以起始码开头
+	bool mp4 = m_codecpar->extradata_size > 0 && m_codecpar->extradata[0] == 1;
+	const char* name = !mp4 ? "dump_extra" : m_codecpar->codec_id == AV_CODEC_ID_H264 ? "h264_mp4toannexb" : "hevc_mp4toannexb";
+	const AVBitStreamFilter* filter = av_bsf_get_by_name(name);
+	if (filter == NULL || av_bsf_alloc(filter, &m_bsf) < 0)
 	{
-		avio_close(pOutFmtCtx->pb);
+		return -1;
 	}
 
-	avformat_free_context(pOutFmtCtx);
+	if (avcodec_parameters_copy(m_bsf->par_in, m_codecpar) < 0)
+	{
+		return -1;
+	}
+	m_bsf->time_base_in = m_timeBase;
 
-	return ret;
+	// 输出改为Annex-B, 新建的输出和挂载点使用过滤器的输出参数
+	if (av_bsf_init(m_bsf) < 0 || avcodec_parameters_copy(m_codecpar, m_bsf->par_out) < 0)
+	{
+		return -1;
+	}
+
+	spdlog::info("{}: repeat parameter sets with {}", m_videoInfo.url, name);
+	return 0;
 }
 
-void RtspSender::stop()
+int RtspSender::filter_packet(AVPacket* packet)
 {
-	m_stop = true;
-	if (t.joinable())
+	if (m_bsf == NULL)
 	{
-		t.join();
+		return 0;
 	}
+
+	int ret = av_bsf_send_packet(m_bsf, packet);
+	if (ret < 0)
+	{
+		av_packet_unref(packet);
+		return ret;
+	}
+
+	return av_bsf_receive_packet(m_bsf, packet);
+}
+
+void RtspSender::observe_restart()
+{
+	if (m_passEnd != SteadyClock::time_point())
+	{
+		m_stats.loop_restart.observe(std::chrono::duration_cast<std::chrono::microseconds>(SteadyClock::now() - m_passEnd).count());
+		m_passEnd = SteadyClock::time_point();
+	}
+}
+
+void RtspSender::rebase_timestamps(AVPacket* packet)
+{
+	int64_t duration = packet->duration > 0 ? packet->duration : m_frameDuration;
+	int64_t dts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+	if (dts == AV_NOPTS_VALUE)
+	{
+		// 没有时间戳, 按帧间隔递增
+		packet->dts = packet->pts = m_nextDts;
+		m_lastDts = m_nextDts;
+		m_nextDts += duration;
+		return;
+	}
+
+	// 新一轮循环、时间戳回退或跳变, 接续上一帧重新计算偏移
+	int64_t outDts = dts + m_tsOffset;
+	if (m_newPass || m_lastDts == AV_NOPTS_VALUE || outDts < m_lastDts || outDts - m_nextDts > m_maxGap)
+	{
+		m_tsOffset = m_nextDts - dts;
+		outDts = m_nextDts;
+		m_newPass = false;
+	}
+
+	if (outDts <= m_lastDts)
+	{
+		outDts = m_lastDts + 1;
+	}
+
+	// B帧: PTS与DTS保持原始差值
+	int64_t outPts = packet->pts != AV_NOPTS_VALUE ? packet->pts + m_tsOffset : outDts;
+
+	packet->dts = outDts;
+	packet->pts = std::max(outPts, outDts);
+	m_lastDts = outDts;
+	m_nextDts = outDts + duration;
+}
+
+void RtspSender::stop()
+{
+	m_stop = true;
+
+	// 先移除打开任务(正在打开时等待其返回), 之后推流任务不会再被加入
+	StreamScheduler::opener_instance().remove(&m_opener);
+	StreamScheduler::instance().remove(this);
+
+	// 任务已移出调度器, 在当前线程释放资源
+	close();
 }
\ No newline at end of file
@@ -3,24 +3,80 @@
 #include <atomic>
 #include <string>
 #include <chrono>
-#include <thread>
-#include <functional>
+#include <mutex>
+#include <set>
+#include <deque>
+#include <vector>
+#include <memory>
 #include "video_info.h"
+#include "packet_cache.h"
+#include "stream_scheduler.h"
+#include "metrics.h"
+#include "spsc_ring.h"
+#include "token_bucket.h"
+#include "test_pattern.h"
+#include "annexb_stream.h"
+#include "transcoder.h"
 
 extern "C"
 {
 #include "libavformat/avformat.h"
+#include "libavcodec/bsf.h"
+};
+
+class RtspMount;
+
+// 推流源
+enum class SourceType
+{
+	File = 0,      // 本地视频
+	Pattern = 1,   // 生成的测试图案, 不读取文件
+	Transcode = 2  // 本地视频解码后重新编码, 用于H.264/H.265以外的编码格式或多档位输出
 };
 
 struct RTSPConfig
 {
 	std::string url;      // 流地址
 	std::string video;    // 本地视频
+	SourceType source = SourceType::File;
+	PatternConfig pattern;                   // 测试图案参数, source为Pattern时使用; loop为GOP回放次数
+	std::vector<Rendition> ladder;           // 转码档位, source为Transcode时使用; 视频、档位和循环次数相同的推流共享一次解码
+	size_t rendition = 0;                    // 本路推送ladder中的第几档
 	int loop = 1;         // 循环次数
-	std::function<void(double)> callback = nullptr; // 进度监控
+	int64_t cache_limit = 256 * 1024 * 1024; // 循环推流内存缓存上限(Byte), 文件超过上限时每轮从磁盘读取
+	int prefetch_ms = 500;                   // 预读时长(毫秒): 读取线程提前读出该时长的视频帧
+	double speed = 1.0;                      // 回放速度倍数(如0.5、2、10), 时间戳按倍数缩放; <=0表示不限速, 按输出能接收的速度写出
+	int start_delay_ms = 0;                  // 延迟开始推流(毫秒), 批量推流时错开各路关键帧
+	double start_offset = 0;                 // 推流区间开始(秒), 从该位置之前最近的关键帧开始, 本地视频有效
+	double end_offset = 0;                   // 推流区间结束(秒), 0表示到文件末尾; 循环推流只重复该区间
+	double shape_peak = 0;                   // 流量整形峰均比: RTP包按平均码率(乘回放速度)的该倍数分段发送, 平滑关键帧突发; 0或不限速时不整形
+	                                         // 整形只作用于内置RTSP服务的挂载点, 推送到外部服务时由ffmpeg整帧发送
+	bool repeat_headers = false;             // 每个关键帧前重复参数集(SPS/PPS, H.265还有VPS), 推送到外部服务时中途加入的客户端无需等待
+	                                         // MP4输入使用h264_mp4toannexb/hevc_mp4toannexb, Annex-B输入使用dump_extra; 内置RTSP服务打包时总是补发
 };
 
-class RtspSender
+// 推流输出, 同一视频可同时推送到多个流地址
+struct RtspOutput
+{
+	std::string url;                 // 流地址
+	AVFormatContext* fmtCtx = NULL;  // 输出流
+	bool waitKey = true;             // 新加入的输出从关键帧开始推流
+	int64_t lastDts = AV_NOPTS_VALUE; // 上一帧输出DTS, 保证时间基转换后单调递增
+	std::shared_ptr<RtspMount> mount; // 内置RTSP服务的挂载点, 非空时不使用fmtCtx
+
+	// 延迟输出: 共用推流器的多个地址错开关键帧相位, 帧以引用方式排队, 不复制数据
+	int delay_ms = 0;                 // 相对推流器的延迟(毫秒)
+	int64_t delay = 0;                // 延迟(输入时间基)
+	std::deque<AVPacket*> delayed;    // 未到期的帧
+	AVPacket* held = NULL;            // 最近写出的延迟帧, 分段发送完之前保留
+	std::vector<AVPacket*> spare;     // 可复用的空帧
+};
+
+// 推流器: 一个视频只解复用一次, 每帧分发到所有输出
+// 由StreamScheduler按下一帧的发送时间驱动, 不单独占用线程
+// 读取和发送分为两级: 预读任务在StreamScheduler::reader_instance()中解复用并放入无锁队列, 发送任务只取帧和推帧
+// 打开视频在StreamScheduler::opener_instance()中完成, 打开成功后才加入发送调度器, 慢速打开不影响其他推流的发送时刻
+class RtspSender : public ScheduledTask
 {
 public:
 	RtspSender();
@@ -29,10 +85,124 @@ public:
 	void async_send_rtsp(const RTSPConfig& config);
 	void stop();
 
+	bool add_output(const std::string& url, int delayMs = 0);  // 推流中加入新的流地址, delayMs: 该地址相对其他地址的延迟
+	void remove_output(const std::string& url);  // 移除流地址, 其余输出不受影响; 不等待, 已打开的输出由推流任务关闭, 全部移除后推流任务自行结束
+	size_t output_count();                       // 当前流地址数量
+	bool running();                              // 推流任务是否在运行(包括等待开始和打开中)
+
+	const SenderStats& stats() const;            // 推流统计, 可在任意线程读取
+
 protected:
-	int send_rtsp(const RTSPConfig& config);
+	SteadyClock::time_point run() override;      // 发送到期的帧并取出下一帧, 返回下一帧发送时间
+	SteadyClock::time_point prefetch();          // 预读到m_prefetch时长, 返回下一次预读时间
+	SteadyClock::time_point start();             // 打开视频, 成功后加入发送调度器; 在打开调度器中执行一次
+
+	int open();                                  // 打开视频
+	int open_file();                             // 打开本地视频, 设置视频信息、流参数和时间基
+	int open_pattern();                          // 取得共享的测试图案GOP
+	int open_annexb();                           // 打开Annex-B裸流索引, 帧直接引用文件映射
+	int open_transcode();                        // 接入共享的转码梯度, 读取本路档位的编码输出
+	void close();                                // 释放资源
+	int read_packet(AVPacket* packet);           // 读取下一帧视频, 处理循环和内存缓存; 转码输出未就绪时返回AVERROR(EAGAIN)
+	int open_bsf();                              // 按repeat_headers创建码流过滤器, 输出参数替换m_codecpar
+	int filter_packet(AVPacket* packet);         // 码流过滤, 这几种过滤器每输入一帧输出一帧
+	void find_segment();                         // 按关键帧索引确定推流区间
+	int seek_segment();                          // 输入文件定位到区间起始关键帧, 成功返回>=0
+
+	bool update_outputs(const AVCodecParameters* codecpar);        // 处理待加入/待移除的输出, 没有输出时返回false
+	void rebase_timestamps(AVPacket* packet);   // 原始时间戳重定基, 循环推流时保持单调递增
+	void observe_restart();                      // 新一轮第一帧读出, 统计循环重启耗时
+	void write_outputs(const AVPacket* packet, AVRational timeBase); // 一帧写入所有输出
+	void drop_output(const std::string& url);
+	const AVPacket* delay_packet(RtspOutput& output, const AVPacket* packet);  // 延迟输出排队, 返回到期的帧, 未到期返回NULL
+	void recycle_packet(AVPacket** packet);      // 发送完的帧还给读取线程复用
+	SteadyClock::time_point shape_outputs();     // 按令牌桶分段发送当前帧, 发完返回time_point(), 否则返回下一段的发送时间
+
+	// 预读任务, 在预读调度器中执行
+	class Prefetcher : public ScheduledTask
+	{
+	public:
+		explicit Prefetcher(RtspSender* sender) :m_sender(sender) {}
+		SteadyClock::time_point run() override { return m_sender->prefetch(); }
+
+	protected:
+		RtspSender* m_sender;
+	};
+
+	// 打开任务, 在打开调度器中执行
+	class Opener : public ScheduledTask
+	{
+	public:
+		explicit Opener(RtspSender* sender) :m_sender(sender) {}
+		SteadyClock::time_point run() override { return m_sender->start(); }
+
+	protected:
+		RtspSender* m_sender;
+	};
 
 protected:
 	std::atomic_bool m_stop;
-	std::thread t;
-};
+	SenderStats m_stats;
+
+	std::mutex m_mutex;
+	bool m_running = false;               // 推流任务是否在运行
+	std::set<std::string> m_urls;         // 所有有效流地址
+	std::vector<RtspOutput> m_pending;    // 待加入的输出
+	std::vector<std::string> m_removed;   // 待移除的输出
+
+	/**** 读取线程和发送线程之间的队列 ****/
+	Opener m_opener;
+	Prefetcher m_prefetcher;
+	SpscRing<AVPacket*> m_ready;             // 已预读的帧: 读取 -> 发送
+	SpscRing<AVPacket*> m_free;              // 已发送的空帧: 发送 -> 读取
+	std::atomic_bool m_readEnd = false;      // 读取结束(推流结束或出错), 队列取完后推流结束
+
+	/**** 打开时设置, 之后只读 ****/
+	RTSPConfig m_config;
+	VideoInfo m_videoInfo;                   // 视频信息
+	AVRational m_timeBase;                   // 输入视频流时间基
+	int64_t m_frameDuration = 0;             // 缺少时长信息时使用的帧间隔(m_timeBase)
+	SteadyClock::time_point m_startTime;     // 开始推流时间
+	std::chrono::microseconds m_prefetch;    // 预读时长
+	AVRational m_speed = { 1, 1 };           // 回放速度, 输出时间戳 = 原时间戳 / m_speed
+	bool m_unpaced = false;                  // 不限速, 不按时间戳等待
+
+	/**** 以下成员只在发送任务中访问 ****/
+	std::vector<RtspOutput> m_outputs;       // 推流输出
+	AVCodecParameters* m_codecpar = NULL;    // 视频流参数, 用于创建新的输出
+	AVPacket* m_packet = NULL;               // 待发送的帧
+	bool m_starved = false;                  // 预读队列为空, 等待读取任务
+	int64_t m_frameNum = 0;                  // 帧计数
+	SteadyClock::time_point m_deadline;      // 当前帧计划发送时间, 用于统计发送延迟
+	SteadyClock::time_point m_rateTime;      // 码率统计窗口开始时间
+	int64_t m_rateBytes = 0;                 // 码率统计窗口开始时的发送量
+	int64_t m_rateFrames = 0;                // 码率统计窗口开始时的帧数
+	int64_t m_ratePosition = 0;              // 码率统计窗口开始时的推流位置(微秒)
+	TokenBucket m_shaper;                    // 单路流量整形
+	bool m_shape = false;                    // 挂载点分段发送
+	bool m_shaping = false;                  // 当前帧正在分段发送, m_packet发完前不能释放
+
+	/**** 以下成员只在读取任务中访问(打开时读取任务尚未开始) ****/
+	AVFormatContext* m_inFmtCtx = NULL;      // 输入流
+	SteadyClock::time_point m_readDeadline;  // 最后读出帧的计划发送时间
+	PacketCache m_cache;                     // 循环推流缓存
+	std::shared_ptr<const PatternGop> m_pattern; // 测试图案, 非空时代替输入文件
+	std::shared_ptr<const AnnexBStream> m_annexb; // Annex-B裸流索引, 非空时不经过ffmpeg解复用
+	std::shared_ptr<TranscodeLadder> m_ladder;    // 转码梯度, 非空时代替输入文件, 循环由转码器完成
+	AVBSFContext* m_bsf = NULL;              // 重复参数集的码流过滤器, 不需要时为NULL
+	bool m_cached = false;                   // 是否从内存缓存推流
+	size_t m_cacheIndex = 0;                 // 内存缓存读取位置
+	size_t m_firstIndex = 0;                 // 每轮的起始读取位置(Annex-B区间推流的起始帧)
+	int64_t m_segmentStart = INT64_MIN;      // 区间起始关键帧的DTS(m_timeBase), seek之后丢弃之前的帧
+	int64_t m_segmentEnd = INT64_MAX;        // 区间结束DTS, 读到该位置即本轮结束
+	int64_t m_segmentPos = -1;               // 区间起始关键帧的文件位置, 按时间戳定位失败时按位置定位
+	bool m_seeking = false;                  // 已定位, 尚未读到区间起始关键帧
+	int m_loopCount = 0;                     // 已完成的循环次数
+	int64_t m_maxGap = 0;                    // 超过该间隔视为时间戳跳变(m_timeBase)
+	int64_t m_tsOffset = 0;                  // 原始DTS到输出DTS的偏移
+	int64_t m_lastDts = AV_NOPTS_VALUE;      // 上一帧输出DTS
+	int64_t m_nextDts = 0;                   // 下一帧预期输出DTS
+	bool m_newPass = true;                   // 新一轮循环开始, 需要重新计算偏移
+	SteadyClock::time_point m_passEnd;       // 上一轮循环结束时间, 用于统计循环重启耗时
+	int m_error = 0;                         // 错误码, 读取结束后由发送任务读取
+};
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <memory>
+#include <future>
+#include <functional>
+
+// 按键共享的对象: 同一键只创建一次, 最后一个使用者释放后销毁
+// 创建在锁外进行, 耗时的创建(编码、扫描文件)不阻塞其他键; 同时请求同一键的调用方等待同一个结果
+template <class T>
+class SharedRegistry
+{
+public:
+	// create返回nullptr表示失败, 等待中的调用方同样得到nullptr, 之后的调用重新创建
+	std::shared_ptr<T> get(const std::string& key, const std::function<std::shared_ptr<T>()>& create)
+	{
+		std::promise<std::shared_ptr<T>> promise;
+		std::shared_future<std::shared_ptr<T>> pending;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			Slot& slot = m_slots[key];
+			std::shared_ptr<T> object = slot.object.lock();
+			if (object)
+			{
+				return object;
+			}
+
+			if (slot.pending.valid())
+			{
+				pending = slot.pending;
+			}
+			else
+			{
+				slot.pending = promise.get_future().share();
+			}
+		}
+
+		// 其他调用方正在创建
+		if (pending.valid())
+		{
+			return pending.get();
+		}
+
+		std::shared_ptr<T> object = create();
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (object)
+			{
+				Slot& slot = m_slots[key];
+				slot.object = object;
+				slot.pending = std::shared_future<std::shared_ptr<T>>();
+			}
+			else
+			{
+				m_slots.erase(key);
+			}
+		}
+		promise.set_value(object);
+
+		return object;
+	}
+
+protected:
+	struct Slot
+	{
+		std::weak_ptr<T> object;                          // 已创建的对象
+		std::shared_future<std::shared_ptr<T>> pending;   // 正在创建
+	};
+
+	std::mutex m_mutex;
+	std::map<std::string, Slot> m_slots;
+};
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+
+// 单生产者单消费者无锁环形队列: 只允许一个线程push、一个线程pop
+// 读写位置分别放在不同缓存行, 避免生产者和消费者相互失效
+template<typename T>
+class SpscRing
+{
+public:
+	explicit SpscRing(size_t capacity = 0)
+	{
+		reset(capacity);
+	}
+
+	// 重新设置容量(取2的幂)并清空, 不能与push/pop并发
+	void reset(size_t capacity)
+	{
+		size_t size = 1;
+		while (size < capacity)
+		{
+			size <<= 1;
+		}
+
+		m_buffer.assign(capacity > 0 ? size : 0, T());
+		m_mask = size - 1;
+		m_head.store(0, std::memory_order_relaxed);
+		m_tail.store(0, std::memory_order_relaxed);
+	}
+
+	// 生产者调用, 队列满返回false
+	bool push(const T& value)
+	{
+		size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_head.load(std::memory_order_acquire) >= m_buffer.size())
+		{
+			return false;
+		}
+
+		m_buffer[tail & m_mask] = value;
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// 消费者调用, 队列空返回false
+	bool pop(T& value)
+	{
+		size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		value = m_buffer[head & m_mask];
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	size_t size() const
+	{
+		return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+	}
+
+	size_t capacity() const
+	{
+		return m_buffer.size();
+	}
+
+protected:
+	static constexpr size_t CACHE_LINE = 64;
+
+	std::vector<T> m_buffer;
+	size_t m_mask = 0;
+	alignas(CACHE_LINE) std::atomic<size_t> m_head = 0;   // 下一个读取位置, 消费者更新
+	alignas(CACHE_LINE) std::atomic<size_t> m_tail = 0;   // 下一个写入位置, 生产者更新
+};
\ No newline at end of file
@@ -0,0 +1,146 @@
+#include <algorithm>
+#include "stream_scheduler.h"
+
+StreamScheduler::StreamScheduler(int threads)
+{
+	if (threads <= 0)
+	{
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	for (int i = 0; i < threads; i++)
+	{
+		m_threads.emplace_back(&StreamScheduler::worker, this);
+	}
+}
+
+StreamScheduler::~StreamScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_cond.notify_all();
+
+	for (auto& t : m_threads)
+	{
+		if (t.joinable())
+		{
+			t.join();
+		}
+	}
+}
+
+StreamScheduler& StreamScheduler::instance()
+{
+	static StreamScheduler scheduler;
+	return scheduler;
+}
+
+StreamScheduler& StreamScheduler::reader_instance()
+{
+	// 读取主要等待IO, 线程数不需要与CPU核心数一致
+	static StreamScheduler scheduler(int(std::max(2u, std::thread::hardware_concurrency() / 2)));
+	return scheduler;
+}
+
+StreamScheduler& StreamScheduler::opener_instance()
+{
+	static StreamScheduler scheduler(int(std::max(2u, std::thread::hardware_concurrency() / 2)));
+	return scheduler;
+}
+
+void StreamScheduler::add(ScheduledTask* task, SteadyClock::time_point when)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		TaskState& state = m_tasks[task];
+		state.seq = ++m_seq;
+		state.removed = false;
+
+		// 正在执行的任务在run()返回后按返回值重新入堆
+		if (!state.running)
+		{
+			m_heap.push({ when, state.seq, task });
+		}
+	}
+	m_cond.notify_one();
+}
+
+void StreamScheduler::remove(ScheduledTask* task)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	auto it = m_tasks.find(task);
+	if (it == m_tasks.end())
+	{
+		return;
+	}
+
+	if (!it->second.running)
+	{
+		// 堆中残留的过期项由工作线程丢弃
+		m_tasks.erase(it);
+		return;
+	}
+
+	it->second.removed = true;
+	m_doneCond.wait(lock, [this, task]() { return m_tasks.count(task) == 0; });
+}
+
+size_t StreamScheduler::task_count()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_tasks.size();
+}
+
+void StreamScheduler::worker()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_quit)
+	{
+		if (m_heap.empty())
+		{
+			m_cond.wait(lock);
+			continue;
+		}
+
+		Entry entry = m_heap.top();
+		auto it = m_tasks.find(entry.task);
+		if (it == m_tasks.end() || it->second.seq != entry.seq || it->second.running)
+		{
+			// 过期项
+			m_heap.pop();
+			continue;
+		}
+
+		if (entry.when > SteadyClock::now())
+		{
+			m_cond.wait_until(lock, entry.when);
+			continue;
+		}
+
+		m_heap.pop();
+		it->second.running = true;
+
+		lock.unlock();
+		SteadyClock::time_point next = entry.task->run();
+		lock.lock();
+
+		it = m_tasks.find(entry.task);
+		it->second.running = false;
+
+		if (it->second.removed || next == SteadyClock::time_point::max())
+		{
+			m_tasks.erase(it);
+			m_doneCond.notify_all();
+		}
+		else
+		{
+			it->second.seq = ++m_seq;
+			m_heap.push({ next, it->second.seq, entry.task });
+
+			// 下一次执行时间可能早于其他线程正在等待的时间
+			m_cond.notify_one();
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+#include <unordered_map>
+
+using SteadyClock = std::chrono::steady_clock;
+
+// 定时任务: run()执行一步并返回下一次执行时间, 返回SteadyClock::time_point::max()表示任务结束
+class ScheduledTask
+{
+public:
+	virtual ~ScheduledTask() = default;
+	virtual SteadyClock::time_point run() = 0;
+};
+
+// 推流调度器: 少量工作线程按截止时间(最小堆)驱动所有推流任务, 代替每路流一个线程
+class StreamScheduler
+{
+public:
+	explicit StreamScheduler(int threads = 0);  // 0: 每个CPU核心一个工作线程
+	~StreamScheduler();
+
+	StreamScheduler(const StreamScheduler&) = delete;
+	StreamScheduler& operator=(const StreamScheduler&) = delete;
+
+	static StreamScheduler& instance();
+	static StreamScheduler& reader_instance();  // 预读调度器: 读取文件与发送分开, 磁盘延迟不影响发送时刻
+	static StreamScheduler& opener_instance();  // 打开调度器: 打开文件、建立索引、编码测试图案等耗时操作, 不占用发送和预读线程
+
+	void add(ScheduledTask* task, SteadyClock::time_point when = SteadyClock::now()); // 添加任务, 已存在时重新设置执行时间
+	void remove(ScheduledTask* task);  // 移除任务, 任务正在执行时等待本次run()返回
+	size_t task_count();
+
+protected:
+	void worker();
+
+	struct Entry
+	{
+		SteadyClock::time_point when;   // 执行时间
+		uint64_t seq;                   // 调度序号, 与任务当前序号不一致时为过期项
+		ScheduledTask* task;
+
+		bool operator>(const Entry& other) const
+		{
+			return when > other.when;
+		}
+	};
+
+	struct TaskState
+	{
+		uint64_t seq = 0;
+		bool running = false;   // run()执行中
+		bool removed = false;   // 执行中被移除
+	};
+
+protected:
+	std::mutex m_mutex;
+	std::condition_variable m_cond;      // 唤醒工作线程
+	std::condition_variable m_doneCond;  // 任务run()返回
+	bool m_quit = false;
+	uint64_t m_seq = 0;
+
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> m_heap;
+	std::unordered_map<ScheduledTask*, TaskState> m_tasks;
+	std::vector<std::thread> m_threads;
+};
\ No newline at end of file
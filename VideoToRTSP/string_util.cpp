@@ -0,0 +1,56 @@
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "string_util.h"
+
+std::string toUtf8(const std::string& str)
+{
+#ifndef _WIN32
+	return str;
+#else
+	int nwLen = MultiByteToWideChar(CP_ACP, 0, str.c_str(), -1, NULL, 0);
+
+	wchar_t* pwBuf = new wchar_t[nwLen + 1]; // 一定要加1，不然会出现尾巴
+	ZeroMemory(pwBuf, nwLen * 2 + 2);
+
+	MultiByteToWideChar(CP_ACP, 0, str.c_str(), str.length(), pwBuf, nwLen);
+
+	int nLen = WideCharToMultiByte(CP_UTF8, 0, pwBuf, -1, NULL, NULL, NULL, NULL);
+
+	char* pBuf = new char[nLen + 1];
+	ZeroMemory(pBuf, nLen + 1);
+
+	WideCharToMultiByte(CP_UTF8, 0, pwBuf, nwLen, pBuf, nLen, NULL, NULL);
+
+	std::string retStr(pBuf);
+
+	delete[] pwBuf;
+	delete[] pBuf;
+
+	pwBuf = NULL;
+	pBuf = NULL;
+
+	return retStr;
+#endif
+}
+
+std::string base64_encode(const uint8_t* data, size_t len)
+{
+	static const char TABLE[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	std::string out;
+	out.reserve((len + 2) / 3 * 4);
+	for (size_t i = 0; i < len; i += 3)
+	{
+		uint32_t value = uint32_t(data[i]) << 16;
+		if (i + 1 < len) value |= uint32_t(data[i + 1]) << 8;
+		if (i + 2 < len) value |= data[i + 2];
+
+		out += TABLE[(value >> 18) & 0x3F];
+		out += TABLE[(value >> 12) & 0x3F];
+		out += i + 1 < len ? TABLE[(value >> 6) & 0x3F] : '=';
+		out += i + 2 < len ? TABLE[value & 0x3F] : '=';
+	}
+
+	return out;
+}
\ No newline at end of file
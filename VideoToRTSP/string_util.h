@@ -0,0 +1,9 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+// 本地编码(Windows为ANSI代码页)转UTF-8, ffmpeg要以UTF-8格式作为输入; 其他平台路径本身为UTF-8, 原样返回
+std::string toUtf8(const std::string& str);
+
+std::string base64_encode(const uint8_t* data, size_t len);
\ No newline at end of file
@@ -0,0 +1,296 @@
+#include <cstdio>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include "test_pattern.h"
+#include "shared_registry.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+}
+
+static constexpr int NOISE_BLOCK = 64;   // 运动噪声块边长(像素), 使P帧大小接近真实画面
+
+// 75%彩条(BT.601): 白、黄、青、绿、品红、红、蓝
+static const uint8_t BARS[7][3] = {
+	{ 180, 128, 128 }, { 162, 44, 142 }, { 131, 156, 44 }, { 112, 72, 58 }, { 84, 184, 198 }, { 65, 100, 212 }, { 35, 212, 114 }
+};
+
+// 5x7点阵字体: 0-9和':', 每行低5位从左到右
+static const uint8_t GLYPHS[11][7] = {
+	{ 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E },
+	{ 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E },
+	{ 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F },
+	{ 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E },
+	{ 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 },
+	{ 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E },
+	{ 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E },
+	{ 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 },
+	{ 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E },
+	{ 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C },
+	{ 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 },
+};
+
+std::string PatternConfig::name() const
+{
+	std::string name = "pattern_" + codec + "_" + std::to_string(width) + "x" + std::to_string(height)
+		+ "_" + std::to_string(fps) + "fps_g" + std::to_string(gop) + "_" + std::to_string(bitrate) + "k";
+	if (id >= 0)
+	{
+		name += "_id" + std::to_string(id);
+	}
+
+	return name;
+}
+
+const AVCodec* FindVideoEncoder(const std::string& codec)
+{
+	if (codec == "hevc" || codec == "h265")
+	{
+		const AVCodec* encoder = avcodec_find_encoder_by_name("libx265");
+		return encoder ? encoder : avcodec_find_encoder(AV_CODEC_ID_HEVC);
+	}
+
+	const AVCodec* encoder = avcodec_find_encoder_by_name("libx264");
+	return encoder ? encoder : avcodec_find_encoder(AV_CODEC_ID_H264);
+}
+
+// 填充矩形, 坐标超出画面时裁剪; 色度按2x2下采样
+static void fill_rect(AVFrame* frame, int left, int top, int width, int height, uint8_t y, uint8_t u, uint8_t v)
+{
+	int right = std::min(frame->width, left + width);
+	int bottom = std::min(frame->height, top + height);
+	left = std::max(0, left);
+	top = std::max(0, top);
+
+	for (int row = top; row < bottom; row++)
+	{
+		std::fill_n(frame->data[0] + row * frame->linesize[0] + left, std::max(0, right - left), y);
+	}
+
+	for (int row = top / 2; row < bottom / 2; row++)
+	{
+		std::fill_n(frame->data[1] + row * frame->linesize[1] + left / 2, std::max(0, right / 2 - left / 2), u);
+		std::fill_n(frame->data[2] + row * frame->linesize[2] + left / 2, std::max(0, right / 2 - left / 2), v);
+	}
+}
+
+// 黑底白字绘制数字和':', 每个点阵像素放大为scale x scale
+static void draw_text(AVFrame* frame, int left, int top, int scale, const std::string& text)
+{
+	fill_rect(frame, left, top, int(text.size()) * 6 * scale + scale, 9 * scale, 16, 128, 128);
+
+	int x = left + scale;
+	for (char c : text)
+	{
+		int glyph = c == ':' ? 10 : c - '0';
+		if (glyph >= 0 && glyph <= 10)
+		{
+			for (int row = 0; row < 7; row++)
+			{
+				for (int col = 0; col < 5; col++)
+				{
+					if (GLYPHS[glyph][row] & (0x10 >> col))
+					{
+						fill_rect(frame, x + col * scale, top + (row + 1) * scale, scale, scale, 235, 128, 128);
+					}
+				}
+			}
+		}
+		x += 6 * scale;
+	}
+}
+
+// 填充一帧: 彩条、移动的噪声块、流编号和GOP内时间码
+static void fill_frame(AVFrame* frame, int index, const PatternConfig& config)
+{
+	for (int i = 0; i < 7; i++)
+	{
+		int left = frame->width * i / 7;
+		int right = frame->width * (i + 1) / 7;
+		fill_rect(frame, left, 0, right - left, frame->height, BARS[i][0], BARS[i][1], BARS[i][2]);
+	}
+
+	// 固定种子的线性同余随机数, 同样参数编码结果一致
+	uint32_t seed = uint32_t(index) * 2654435761u + 1;
+	int left = (index * 8) % std::max(1, frame->width - NOISE_BLOCK);
+	int top = frame->height / 2;
+	for (int y = top; y < std::min(frame->height, top + NOISE_BLOCK); y++)
+	{
+		uint8_t* line = frame->data[0] + y * frame->linesize[0];
+		for (int x = left; x < std::min(frame->width, left + NOISE_BLOCK); x++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			line[x] = uint8_t(seed >> 24);
+		}
+	}
+
+	int scale = std::max(2, frame->height / 120);
+	if (config.id >= 0)
+	{
+		draw_text(frame, 2 * scale, 2 * scale, scale, std::to_string(config.id));
+	}
+
+	// 时间码 HH:MM:SS:FF, 每轮回放从0开始
+	int seconds = index / config.fps;
+	char timecode[32];
+	snprintf(timecode, sizeof(timecode), "%02d:%02d:%02d:%02d", seconds / 3600, seconds / 60 % 60, seconds % 60, index % config.fps);
+	draw_text(frame, 2 * scale, 13 * scale, scale, timecode);
+}
+
+PatternGop::~PatternGop()
+{
+	for (AVPacket*& packet : m_packets)
+	{
+		av_packet_free(&packet);
+	}
+	avcodec_parameters_free(&m_codecpar);
+}
+
+std::shared_ptr<const PatternGop> PatternGop::get(const PatternConfig& config)
+{
+	// 同一参数的GOP由所有推流共享, 最后一个推流结束时释放; 编码在注册表锁外进行, 不阻塞其他参数的推流
+	static SharedRegistry<const PatternGop> gops;
+
+	std::string key = config.name();
+	return gops.get(key, [&config, &key]() -> std::shared_ptr<const PatternGop>
+		{
+			std::shared_ptr<PatternGop> gop(new PatternGop);
+			int ret = gop->encode(config);
+			if (ret != 0)
+			{
+				spdlog::error("Encode test pattern {} failed: {}", key, ret);
+				return nullptr;
+			}
+
+			spdlog::info("Encode test pattern {}: {} frames, {} KB", key, gop->size(), gop->bytes() / 1024);
+			return gop;
+		});
+}
+
+int PatternGop::encode(const PatternConfig& config)
+{
+	AVCodecContext* codecContext = NULL;
+	AVFrame* frame = NULL;
+	AVPacket* packet = NULL;
+	const AVCodec* codec = FindVideoEncoder(config.codec);
+	int ret = 0;
+
+	if (codec == NULL)
+	{
+		return 10;
+	}
+
+	if (config.width <= 0 || config.height <= 0 || config.fps <= 0 || config.gop <= 0 || config.bitrate <= 0)
+	{
+		return 20;
+	}
+
+	codecContext = avcodec_alloc_context3(codec);
+	if (codecContext == NULL)
+	{
+		return 30;
+	}
+
+	// 参数集放在extradata中, 供SDP和ffmpeg RTSP封装使用; 不使用B帧, 按GOP原样循环
+	codecContext->width = config.width & ~1;
+	codecContext->height = config.height & ~1;
+	codecContext->pix_fmt = AV_PIX_FMT_YUV420P;
+	codecContext->time_base = av_make_q(1, config.fps);
+	codecContext->framerate = av_make_q(config.fps, 1);
+	codecContext->gop_size = config.gop;
+	codecContext->max_b_frames = 0;
+	codecContext->bit_rate = int64_t(config.bitrate) * 1000;
+	codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+	// 固定GOP: 关闭场景切换插入关键帧
+	av_opt_set(codecContext->priv_data, "preset", "veryfast", 0);
+	av_opt_set(codecContext->priv_data, "x264-params", "scenecut=0", 0);
+	av_opt_set(codecContext->priv_data, "x265-params", "scenecut=0:open-gop=0:log-level=error", 0);
+
+	if (avcodec_open2(codecContext, codec, NULL) < 0)
+	{
+		ret = 40;
+		goto end;
+	}
+
+	frame = av_frame_alloc();
+	packet = av_packet_alloc();
+	if (frame == NULL || packet == NULL)
+	{
+		ret = 50;
+		goto end;
+	}
+
+	frame->width = codecContext->width;
+	frame->height = codecContext->height;
+	frame->format = AV_PIX_FMT_YUV420P;
+	if (av_frame_get_buffer(frame, 0) < 0)
+	{
+		ret = 50;
+		goto end;
+	}
+
+	// 编码一个GOP, 最后一帧送入NULL取出编码器中缓存的帧
+	for (int i = 0; i <= config.gop; i++)
+	{
+		if (i < config.gop)
+		{
+			if (av_frame_make_writable(frame) < 0)
+			{
+				ret = 50;
+				goto end;
+			}
+
+			fill_frame(frame, i, config);
+			frame->pts = i;
+		}
+
+		if (avcodec_send_frame(codecContext, i < config.gop ? frame : NULL) < 0)
+		{
+			ret = 60;
+			goto end;
+		}
+
+		while ((ret = avcodec_receive_packet(codecContext, packet)) >= 0)
+		{
+			if (packet->duration <= 0)
+			{
+				packet->duration = 1;
+			}
+			packet->stream_index = 0;
+			m_bytes += packet->size;
+			m_packets.push_back(av_packet_clone(packet));
+			av_packet_unref(packet);
+		}
+
+		if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+		{
+			ret = 60;
+			goto end;
+		}
+		ret = 0;
+	}
+
+	if (m_packets.empty() || std::count(m_packets.begin(), m_packets.end(), nullptr) > 0 || !(m_packets.front()->flags & AV_PKT_FLAG_KEY))
+	{
+		ret = 70;
+		goto end;
+	}
+
+	m_codecpar = avcodec_parameters_alloc();
+	if (m_codecpar == NULL || avcodec_parameters_from_context(m_codecpar, codecContext) < 0)
+	{
+		ret = 80;
+		goto end;
+	}
+	m_timeBase = codecContext->time_base;
+
+end:
+	av_packet_free(&packet);
+	av_frame_free(&frame);
+	avcodec_free_context(&codecContext);
+
+	return ret;
+}
\ No newline at end of file
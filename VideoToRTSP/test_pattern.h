@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+extern "C"
+{
+#include "libavformat/avformat.h"
+};
+
+// 按名称(h264 / hevc / h265)查找视频编码器: 优先使用x264/x265, 没有时使用ffmpeg内置的同类编码器
+const AVCodec* FindVideoEncoder(const std::string& codec);
+
+// 测试图案参数, 参数相同的推流共享同一份编码结果
+struct PatternConfig
+{
+	std::string codec = "h264";  // h264 / hevc
+	int width = 1280;            // 画面宽度
+	int height = 720;            // 画面高度
+	int fps = 25;                // 帧率
+	int gop = 50;                // 关键帧间隔(帧), 即回放一轮的帧数
+	int bitrate = 2000;          // 码率(kbps)
+	int id = -1;                 // 叠加在画面上的流编号, -1表示不叠加; 编号不同的推流各自编码一次
+
+	std::string name() const;    // 如 pattern_h264_1280x720_25fps_g50_2000k, 用于日志和指标
+};
+
+// 测试图案GOP: 彩条、流编号和时间码, 编码一次后保存在内存中, 所有推流以引用方式循环回放, 没有文件读取
+class PatternGop
+{
+public:
+	~PatternGop();
+
+	PatternGop(const PatternGop&) = delete;
+	PatternGop& operator=(const PatternGop&) = delete;
+
+	static std::shared_ptr<const PatternGop> get(const PatternConfig& config);  // 编码失败返回nullptr
+
+	const AVCodecParameters* codecpar() const { return m_codecpar; }
+	AVRational time_base() const { return m_timeBase; }
+	size_t size() const { return m_packets.size(); }
+	const AVPacket* at(size_t i) const { return m_packets[i]; }
+	int64_t bytes() const { return m_bytes; }   // 一个GOP的数据量(Byte)
+
+protected:
+	PatternGop() = default;
+	int encode(const PatternConfig& config);   // 成功返回0
+
+protected:
+	AVCodecParameters* m_codecpar = NULL;
+	AVRational m_timeBase = { 1, 25 };
+	std::vector<AVPacket*> m_packets;
+	int64_t m_bytes = 0;
+};
\ No newline at end of file
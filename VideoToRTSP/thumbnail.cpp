@@ -0,0 +1,161 @@
+#include <map>
+#include <tuple>
+#include <algorithm>
+#include "thumbnail.h"
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+static constexpr int MAX_PACKETS = 500;  // 最多读取的帧数, 避免损坏文件读到结尾
+
+// 缩放上下文缓存, 按(像素格式, 输入尺寸, 输出尺寸)复用; 每个线程一份, SwsContext不能跨线程共用
+class ScalerCache
+{
+public:
+	~ScalerCache()
+	{
+		for (auto& [key, ctx] : m_contexts)
+		{
+			sws_freeContext(ctx);
+		}
+	}
+
+	SwsContext* get(AVPixelFormat format, int srcWidth, int srcHeight, int dstWidth, int dstHeight)
+	{
+		auto key = std::make_tuple(int(format), srcWidth, srcHeight, dstWidth, dstHeight);
+		auto it = m_contexts.find(key);
+		if (it != m_contexts.end())
+		{
+			return it->second;
+		}
+
+		SwsContext* ctx = sws_getContext(srcWidth, srcHeight, format, dstWidth, dstHeight, AV_PIX_FMT_RGB24, SWS_FAST_BILINEAR, NULL, NULL, NULL);
+		if (ctx)
+		{
+			m_contexts[key] = ctx;
+		}
+
+		return ctx;
+	}
+
+protected:
+	std::map<std::tuple<int, int, int, int, int>, SwsContext*> m_contexts;
+};
+
+// 缩放为RGB缩略图, 直接写入QImage内存
+static QImage scale_frame(const AVFrame* frame, int maxWidth, int maxHeight)
+{
+	static thread_local ScalerCache scalers;
+
+	double scale = std::min({ 1.0, maxWidth / double(frame->width), maxHeight / double(frame->height) });
+	int width = std::max(2, int(frame->width * scale) & ~1);
+	int height = std::max(2, int(frame->height * scale) & ~1);
+
+	SwsContext* swsCtx = scalers.get(AVPixelFormat(frame->format), frame->width, frame->height, width, height);
+	if (swsCtx == NULL)
+	{
+		return QImage();
+	}
+
+	QImage image(width, height, QImage::Format_RGB888);
+	uint8_t* dst[4] = { image.bits(), NULL, NULL, NULL };
+	int dstStride[4] = { int(image.bytesPerLine()), 0, 0, 0 };
+	sws_scale(swsCtx, frame->data, frame->linesize, 0, frame->height, dst, dstStride);
+
+	return image;
+}
+
+QImage DecodeThumbnail(AVFormatContext* pInFmtCtx, int index, int maxWidth, int maxHeight)
+{
+	QImage image;
+
+	AVCodecParameters* codecpar = pInFmtCtx->streams[index]->codecpar;
+	AVCodecContext* codecContext = NULL;
+	const AVCodec* codec = NULL;
+	AVFrame* frame = NULL;
+	AVPacket* packet = NULL;
+	int lowres = 0;
+
+	codec = avcodec_find_decoder(codecpar->codec_id);
+	if (!codec)
+	{
+		goto end;
+	}
+
+	codecContext = avcodec_alloc_context3(codec);
+	if (!codecContext)
+	{
+		goto end;
+	}
+
+	if (avcodec_parameters_to_context(codecContext, codecpar) < 0)
+	{
+		goto end;
+	}
+
+	// 降分辨率解码(不支持时由avcodec_open2限制为解码器上限), 只解关键帧
+	while (lowres < 3 && (codecpar->width >> (lowres + 1)) >= maxWidth && (codecpar->height >> (lowres + 1)) >= maxHeight)
+	{
+		lowres++;
+	}
+	codecContext->lowres = lowres;
+	codecContext->skip_frame = AVDISCARD_NONKEY;
+	codecContext->skip_loop_filter = AVDISCARD_ALL;
+	codecContext->flags2 |= AV_CODEC_FLAG2_FAST;
+	codecContext->thread_type = FF_THREAD_SLICE; // 帧级多线程会延迟输出第一帧
+
+	if (avcodec_open2(codecContext, codec, nullptr) < 0)
+	{
+		goto end;
+	}
+
+	frame = av_frame_alloc();
+	packet = av_packet_alloc();
+	if (!frame || !packet)
+	{
+		goto end;
+	}
+
+	for (int i = 0; i < MAX_PACKETS && av_read_frame(pInFmtCtx, packet) >= 0; i++)
+	{
+		if (packet->stream_index != index)
+		{
+			av_packet_unref(packet);
+			continue;
+		}
+
+		int ret = avcodec_send_packet(codecContext, packet);
+		av_packet_unref(packet);
+		if (ret < 0)
+		{
+			continue;
+		}
+
+		if (avcodec_receive_frame(codecContext, frame) == 0)
+		{
+			image = scale_frame(frame, maxWidth, maxHeight);
+			av_frame_unref(frame);
+			break;
+		}
+	}
+
+	// 文件结束, 取出解码器中缓存的帧
+	if (image.isNull() && avcodec_send_packet(codecContext, NULL) >= 0 && avcodec_receive_frame(codecContext, frame) == 0)
+	{
+		image = scale_frame(frame, maxWidth, maxHeight);
+		av_frame_unref(frame);
+	}
+
+end:
+	av_packet_free(&packet);
+	av_frame_free(&frame);
+	if (codecContext)
+	{
+		avcodec_free_context(&codecContext);
+	}
+
+	return image;
+}
\ No newline at end of file
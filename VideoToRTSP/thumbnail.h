@@ -0,0 +1,15 @@
+#pragma once
+
+#include <QImage>
+
+extern "C"
+{
+#include "libavformat/avformat.h"
+};
+
+static constexpr int THUMBNAIL_WIDTH = 320;   // 缩略图最大宽度
+static constexpr int THUMBNAIL_HEIGHT = 180;  // 缩略图最大高度
+
+// 解码第一个关键帧并缩放为缩略图, 保持宽高比
+// 解码器支持时使用lowres降分辨率解码, 并跳过非关键帧和环路滤波
+QImage DecodeThumbnail(AVFormatContext* pInFmtCtx, int index, int maxWidth = THUMBNAIL_WIDTH, int maxHeight = THUMBNAIL_HEIGHT);
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include <algorithm>
+#include <limits>
+#include "token_bucket.h"
+
+TokenBucket& TokenBucket::global()
+{
+	static TokenBucket bucket;
+	return bucket;
+}
+
+void TokenBucket::configure(int64_t rate, int64_t burst)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_rate = std::max<int64_t>(0, rate);
+	m_burst = std::max<int64_t>(0, burst);
+	m_tokens = double(m_burst);
+	m_last = SteadyClock::now();
+}
+
+bool TokenBucket::enabled() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_rate > 0;
+}
+
+void TokenBucket::refill(SteadyClock::time_point now)
+{
+	if (now > m_last)
+	{
+		double elapsed = std::chrono::duration<double>(now - m_last).count();
+		m_tokens = std::min(double(m_burst), m_tokens + elapsed * m_rate);
+		m_last = now;
+	}
+}
+
+int64_t TokenBucket::available(SteadyClock::time_point now)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_rate <= 0)
+	{
+		return std::numeric_limits<int64_t>::max();
+	}
+
+	refill(now);
+	return m_tokens > 0 ? int64_t(m_tokens) : 0;
+}
+
+void TokenBucket::consume(int64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_rate > 0)
+	{
+		m_tokens -= double(bytes);
+	}
+}
+
+SteadyClock::time_point TokenBucket::ready_time(SteadyClock::time_point now, int64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_rate <= 0)
+	{
+		return now;
+	}
+
+	// 桶容量小于bytes时等到桶满
+	refill(now);
+	double need = std::min(double(bytes), double(m_burst)) - m_tokens;
+	if (need <= 0)
+	{
+		return now;
+	}
+	return now + std::chrono::duration_cast<SteadyClock::duration>(std::chrono::duration<double>(need / m_rate));
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <mutex>
+#include <cstdint>
+#include "stream_scheduler.h"
+
+// 令牌桶: 按固定速率(Byte/s)积累令牌, 最多积累burst字节; 允许透支, 透支部分由之后的等待补足
+// 用于RTP发送整形, 关键帧按峰值速率分段发送, 不再整帧突发
+class TokenBucket
+{
+public:
+	static TokenBucket& global();   // 所有推流共享的总出口限速
+
+	void configure(int64_t rate, int64_t burst);   // rate<=0 表示不限速
+	bool enabled() const;
+
+	int64_t available(SteadyClock::time_point now);   // 当前可发送的字节数, 不限速时返回INT64_MAX
+	void consume(int64_t bytes);
+	SteadyClock::time_point ready_time(SteadyClock::time_point now, int64_t bytes); // 令牌达到bytes字节(最多桶容量)的时间
+
+protected:
+	void refill(SteadyClock::time_point now);
+
+protected:
+	mutable std::mutex m_mutex;    // 总出口限速由多个调度线程同时访问
+	int64_t m_rate = 0;            // 速率(Byte/s)
+	int64_t m_burst = 0;           // 桶容量(Byte)
+	double m_tokens = 0;           // 当前令牌, 可为负(透支)
+	SteadyClock::time_point m_last;
+};
\ No newline at end of file
@@ -0,0 +1,608 @@
+#include <cmath>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include "transcoder.h"
+#include "test_pattern.h"
+#include "mmap_input.h"
+#include "shared_registry.h"
+
+extern "C"
+{
+#include <libavutil/opt.h>
+}
+
+static constexpr size_t FRAME_QUEUE = 8;   // 每档待编码帧数上限, 解码输出以引用方式排队
+
+std::string Rendition::name() const
+{
+	std::string size = "src";
+	if (width > 0 && height > 0)
+	{
+		size = std::to_string(width) + "x" + std::to_string(height);
+	}
+	else if (height > 0)
+	{
+		size = std::to_string(height) + "p";
+	}
+	else if (width > 0)
+	{
+		size = std::to_string(width) + "w";
+	}
+
+	return fmt::format("{}_{}_g{}_{}k", codec, size, gop, bitrate);
+}
+
+TranscodeLadder::~TranscodeLadder()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cond.notify_all();
+
+	for (auto& thread : m_threads)
+	{
+		thread.join();
+	}
+
+	for (auto& output : m_outputs)
+	{
+		for (AVFrame*& frame : output->frames)
+		{
+			av_frame_free(&frame);
+		}
+		for (AVPacket*& packet : output->packets)
+		{
+			av_packet_free(&packet);
+		}
+		sws_freeContext(output->scaler);
+		av_frame_free(&output->scaled);
+		avcodec_parameters_free(&output->codecpar);
+		avcodec_free_context(&output->encoder);
+	}
+
+	av_packet_free(&m_packet);
+	avcodec_free_context(&m_decoder);
+	CloseInputFile(&m_inFmtCtx);
+}
+
+std::shared_ptr<TranscodeLadder> TranscodeLadder::get(const std::string& video, const std::vector<Rendition>& renditions, int loop)
+{
+	// 同一视频、档位和循环次数的推流共享解码, 最后一个推流结束时释放
+	static SharedRegistry<TranscodeLadder> ladders;
+
+	std::string key = video + "|" + std::to_string(loop);
+	for (const auto& rendition : renditions)
+	{
+		key += '|';
+		key += rendition.name();
+	}
+
+	return ladders.get(key, [&]() -> std::shared_ptr<TranscodeLadder> {
+		// 打开需要探测源视频并创建全部编码器, 在注册表锁外进行
+		std::shared_ptr<TranscodeLadder> ladder(new TranscodeLadder);
+		int ret = ladder->open(video, renditions, loop);
+		if (ret != 0)
+		{
+			spdlog::error("Open transcoder {} failed: {}", video, ret);
+			return nullptr;
+		}
+		return ladder;
+	});
+}
+
+int TranscodeLadder::open(const std::string& video, const std::vector<Rendition>& renditions, int loop)
+{
+	AVStream* stream = NULL;
+	const AVCodec* codec = NULL;
+	size_t cores = std::max(1u, std::thread::hardware_concurrency());
+	size_t workers = std::min(renditions.size(), cores);
+
+	m_video = video;
+	m_loop = std::max(loop, 1);
+	if (renditions.empty())
+	{
+		return 10;
+	}
+
+	if (OpenInputFile(&m_inFmtCtx, video) < 0)
+	{
+		return 20;
+	}
+
+	if (avformat_find_stream_info(m_inFmtCtx, NULL) < 0)
+	{
+		return 30;
+	}
+
+	for (unsigned int i = 0; i < m_inFmtCtx->nb_streams; i++)
+	{
+		if (m_inFmtCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+		{
+			m_videoIndex = int(i);
+			stream = m_inFmtCtx->streams[i];
+			break;
+		}
+	}
+
+	if (stream == NULL)
+	{
+		return 40;
+	}
+
+	// 多线程解码(帧级和片级), 解码器自动选择线程数
+	codec = avcodec_find_decoder(stream->codecpar->codec_id);
+	m_decoder = codec ? avcodec_alloc_context3(codec) : NULL;
+	if (m_decoder == NULL || avcodec_parameters_to_context(m_decoder, stream->codecpar) < 0)
+	{
+		return 50;
+	}
+	m_decoder->thread_count = 0;
+	m_decoder->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+	if (avcodec_open2(m_decoder, codec, NULL) < 0)
+	{
+		return 50;
+	}
+
+	m_packet = av_packet_alloc();
+	if (m_packet == NULL)
+	{
+		return 60;
+	}
+
+	// 按平均帧率恒定输出, 没有帧率信息时按25fps
+	m_frameRate = stream->avg_frame_rate.num > 0 && stream->avg_frame_rate.den > 0 ? stream->avg_frame_rate : stream->r_frame_rate;
+	if (m_frameRate.num <= 0 || m_frameRate.den <= 0)
+	{
+		m_frameRate = av_make_q(25, 1);
+	}
+	m_queueLimit = std::max<size_t>(FRAME_QUEUE, size_t(std::ceil(av_q2d(m_frameRate))));
+
+	for (const auto& rendition : renditions)
+	{
+		// 先加入列表, 打开失败时由析构函数释放
+		m_outputs.push_back(std::make_unique<Output>());
+		m_outputs.back()->config = rendition;
+		int ret = open_encoder(*m_outputs.back(), int(std::max<size_t>(1, cores / renditions.size())));
+		if (ret != 0)
+		{
+			spdlog::error("Open encoder {} for {} failed: {}", rendition.name(), video, ret);
+			return 70;
+		}
+	}
+
+	// 一个解码线程, 编码线程数不超过档位数和CPU核心数
+	m_threads.emplace_back(&TranscodeLadder::decode_thread, this);
+	for (size_t i = 0; i < workers; i++)
+	{
+		m_threads.emplace_back(&TranscodeLadder::encode_thread, this);
+	}
+
+	spdlog::info("Transcode {}: {}x{} {}/{} fps -> {} rendition(s), {} encode thread(s)", video, m_decoder->width, m_decoder->height,
+		m_frameRate.num, m_frameRate.den, m_outputs.size(), workers);
+	return 0;
+}
+
+int TranscodeLadder::open_encoder(Output& output, int threads)
+{
+	const Rendition& config = output.config;
+	const AVCodec* codec = FindVideoEncoder(config.codec);
+	AVCodecContext* encoder = NULL;
+	int srcWidth = m_decoder->width;
+	int srcHeight = m_decoder->height;
+	int width = config.width;
+	int height = config.height;
+
+	if (codec == NULL)
+	{
+		return 10;
+	}
+
+	if (srcWidth <= 0 || srcHeight <= 0 || config.bitrate <= 0 || config.gop <= 0)
+	{
+		return 20;
+	}
+
+	// 只给出一边时按源视频宽高比计算另一边
+	if (width <= 0 && height <= 0)
+	{
+		width = srcWidth;
+		height = srcHeight;
+	}
+	else if (width <= 0)
+	{
+		width = int(av_rescale(height, srcWidth, srcHeight));
+	}
+	else if (height <= 0)
+	{
+		height = int(av_rescale(width, srcHeight, srcWidth));
+	}
+
+	encoder = avcodec_alloc_context3(codec);
+	if (encoder == NULL)
+	{
+		return 30;
+	}
+	output.encoder = encoder;
+
+	// 与网络摄像机一致: 不使用B帧, 固定关键帧间隔, 参数集放在extradata中供SDP使用
+	// 各档位由编码线程池并行编码, 单个编码器的线程数按档位数均分CPU核心
+	encoder->width = std::max(2, width & ~1);
+	encoder->height = std::max(2, height & ~1);
+	encoder->pix_fmt = AV_PIX_FMT_YUV420P;
+	encoder->time_base = av_inv_q(m_frameRate);
+	encoder->framerate = m_frameRate;
+	encoder->gop_size = std::max(1, int(config.gop * av_q2d(m_frameRate) + 0.5));
+	encoder->max_b_frames = 0;
+	encoder->bit_rate = int64_t(config.bitrate) * 1000;
+	encoder->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+	encoder->thread_count = threads;
+
+	// 零延迟: 编码一帧即输出一帧, 关闭场景切换插入关键帧
+	av_opt_set(encoder->priv_data, "preset", "veryfast", 0);
+	av_opt_set(encoder->priv_data, "tune", "zerolatency", 0);
+	av_opt_set(encoder->priv_data, "x264-params", "scenecut=0", 0);
+	av_opt_set(encoder->priv_data, "x265-params", "scenecut=0:open-gop=0:log-level=error", 0);
+
+	if (avcodec_open2(encoder, codec, NULL) < 0)
+	{
+		return 40;
+	}
+
+	output.codecpar = avcodec_parameters_alloc();
+	if (output.codecpar == NULL || avcodec_parameters_from_context(output.codecpar, encoder) < 0)
+	{
+		return 50;
+	}
+
+	output.scaled = av_frame_alloc();
+	if (output.scaled == NULL)
+	{
+		return 60;
+	}
+	output.scaled->width = encoder->width;
+	output.scaled->height = encoder->height;
+	output.scaled->format = encoder->pix_fmt;
+	if (av_frame_get_buffer(output.scaled, 0) < 0)
+	{
+		return 60;
+	}
+
+	return 0;
+}
+
+bool TranscodeLadder::attach(size_t i)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Output& output = *m_outputs[i];
+	if (output.attached)
+	{
+		return false;
+	}
+
+	// 解码已结束时没有新帧, 读取方直接结束
+	output.attached = true;
+	output.forceKey = true;
+	output.finished = output.finished || m_decodeEnd;
+	m_cond.notify_all();
+
+	return true;
+}
+
+void TranscodeLadder::detach(size_t i)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Output& output = *m_outputs[i];
+	output.attached = false;
+
+	// 清空编码器的标记保留, 正在编码的帧由编码线程丢弃
+	for (auto it = output.frames.begin(); it != output.frames.end();)
+	{
+		if (*it != NULL)
+		{
+			av_frame_free(&*it);
+			it = output.frames.erase(it);
+			continue;
+		}
+		++it;
+	}
+	for (AVPacket*& packet : output.packets)
+	{
+		av_packet_free(&packet);
+	}
+	output.packets.clear();
+	m_cond.notify_all();
+}
+
+int TranscodeLadder::read(size_t i, AVPacket* packet)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	Output& output = *m_outputs[i];
+	if (output.packets.empty())
+	{
+		if (!output.finished)
+		{
+			return AVERROR(EAGAIN);
+		}
+		return m_error < 0 ? m_error : AVERROR_EOF;
+	}
+
+	AVPacket* front = output.packets.front();
+	output.packets.pop_front();
+	av_packet_move_ref(packet, front);
+	av_packet_free(&front);
+
+	// 队列有空位, 唤醒解码线程
+	if (output.packets.size() + 1 == m_queueLimit)
+	{
+		m_cond.notify_all();
+	}
+
+	return 0;
+}
+
+bool TranscodeLadder::can_decode() const
+{
+	bool attached = false;
+	for (const auto& output : m_outputs)
+	{
+		if (output->attached)
+		{
+			if (output->frames.size() >= FRAME_QUEUE || output->packets.size() >= m_queueLimit)
+			{
+				return false;
+			}
+			attached = true;
+		}
+	}
+
+	return attached;
+}
+
+TranscodeLadder::Output* TranscodeLadder::next_output()
+{
+	for (size_t n = 0; n < m_outputs.size(); n++)
+	{
+		Output& output = *m_outputs[(m_nextOutput + n) % m_outputs.size()];
+		if (!output.busy && !output.frames.empty())
+		{
+			m_nextOutput = (m_nextOutput + n + 1) % m_outputs.size();
+			return &output;
+		}
+	}
+
+	return NULL;
+}
+
+int TranscodeLadder::decode_frame(AVFrame* frame)
+{
+	while (true)
+	{
+		int ret = avcodec_receive_frame(m_decoder, frame);
+		if (ret >= 0)
+		{
+			return 0;
+		}
+
+		if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF)
+		{
+			return ret;
+		}
+
+		// 本轮解码完成, 重新打开文件开始下一轮
+		if (ret == AVERROR_EOF)
+		{
+			if (++m_pass >= m_loop)
+			{
+				return AVERROR_EOF;
+			}
+
+			avcodec_flush_buffers(m_decoder);
+			CloseInputFile(&m_inFmtCtx);
+			if (OpenInputFile(&m_inFmtCtx, m_video) < 0)
+			{
+				return AVERROR(EIO);
+			}
+			continue;
+		}
+
+		// 文件结束, 送入NULL取出解码器中缓存的帧
+		if (av_read_frame(m_inFmtCtx, m_packet) < 0)
+		{
+			ret = avcodec_send_packet(m_decoder, NULL);
+			if (ret < 0)
+			{
+				return ret;
+			}
+			continue;
+		}
+
+		// 损坏的帧跳过, 存档文件中常见
+		if (m_packet->stream_index == m_videoIndex)
+		{
+			avcodec_send_packet(m_decoder, m_packet);
+		}
+		av_packet_unref(m_packet);
+	}
+}
+
+int TranscodeLadder::encode_frame(Output& output, AVFrame* frame, std::vector<AVPacket*>& packets)
+{
+	AVCodecContext* encoder = output.encoder;
+	AVFrame* input = frame;
+
+	// 源格式或尺寸与档位不同时缩放, 相同时直接编码解码输出
+	if (frame != NULL && (frame->width != encoder->width || frame->height != encoder->height || frame->format != encoder->pix_fmt))
+	{
+		output.scaler = sws_getCachedContext(output.scaler, frame->width, frame->height, AVPixelFormat(frame->format),
+			encoder->width, encoder->height, encoder->pix_fmt, SWS_BILINEAR, NULL, NULL, NULL);
+		if (output.scaler == NULL || av_frame_make_writable(output.scaled) < 0)
+		{
+			return AVERROR(ENOMEM);
+		}
+
+		sws_scale(output.scaler, frame->data, frame->linesize, 0, frame->height, output.scaled->data, output.scaled->linesize);
+		output.scaled->pts = frame->pts;
+		output.scaled->pict_type = frame->pict_type;
+		input = output.scaled;
+	}
+
+	int ret = avcodec_send_frame(encoder, input);
+	if (ret < 0)
+	{
+		return ret;
+	}
+
+	while (true)
+	{
+		AVPacket* packet = av_packet_alloc();
+		if (packet == NULL)
+		{
+			return AVERROR(ENOMEM);
+		}
+
+		ret = avcodec_receive_packet(encoder, packet);
+		if (ret < 0)
+		{
+			av_packet_free(&packet);
+			break;
+		}
+
+		if (packet->duration <= 0)
+		{
+			packet->duration = 1;
+		}
+		packet->stream_index = 0;
+		packets.push_back(packet);
+	}
+
+	return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+void TranscodeLadder::decode_thread()
+{
+	AVFrame* frame = av_frame_alloc();
+	int ret = frame != NULL ? 0 : AVERROR(ENOMEM);
+
+	while (ret >= 0)
+	{
+		// 等待有档位接入且各档位队列有空位
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cond.wait(lock, [this]() { return m_stop || can_decode(); });
+			if (m_stop)
+			{
+				break;
+			}
+		}
+
+		ret = decode_frame(frame);
+		if (ret < 0)
+		{
+			break;
+		}
+
+		// 时间戳按恒定帧率重新编号; 源视频的帧类型不传给编码器, 关键帧间隔由编码器决定
+		frame->pts = m_frameIndex++;
+		frame->pict_type = AV_PICTURE_TYPE_NONE;
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (auto& output : m_outputs)
+			{
+				if (!output->attached)
+				{
+					continue;
+				}
+
+				AVFrame* clone = av_frame_clone(frame);
+				if (clone == NULL)
+				{
+					continue;
+				}
+
+				// 新接入的档位从关键帧开始
+				if (output->forceKey)
+				{
+					clone->pict_type = AV_PICTURE_TYPE_I;
+					output->forceKey = false;
+				}
+				output->frames.push_back(clone);
+			}
+		}
+		av_frame_unref(frame);
+		m_cond.notify_all();
+	}
+	av_frame_free(&frame);
+
+	// 清空各档位编码器, 未接入的档位直接结束
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (ret != AVERROR_EOF && !m_stop)
+	{
+		spdlog::error("Transcode {}: decode failed: {}", m_video, ret);
+		m_error = ret;
+	}
+	m_decodeEnd = true;
+	for (auto& output : m_outputs)
+	{
+		if (output->attached)
+		{
+			output->frames.push_back(NULL);
+		}
+		else
+		{
+			output->finished = true;
+		}
+	}
+	m_cond.notify_all();
+}
+
+void TranscodeLadder::encode_thread()
+{
+	std::vector<AVPacket*> packets;
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		// 取一个空闲档位的下一帧, 同一档位的帧按顺序由一个线程编码
+		Output* output = NULL;
+		m_cond.wait(lock, [this, &output]() { return m_stop || (output = next_output()) != NULL; });
+		if (m_stop)
+		{
+			break;
+		}
+
+		AVFrame* frame = output->frames.front();
+		output->frames.pop_front();
+		output->busy = true;
+		lock.unlock();
+
+		bool flush = frame == NULL;
+		int ret = output->finished ? 0 : encode_frame(*output, frame, packets);
+		av_frame_free(&frame);
+
+		lock.lock();
+		output->busy = false;
+		if (ret < 0)
+		{
+			spdlog::error("Transcode {}: encode {} failed: {}", m_video, output->config.name(), ret);
+			m_error = ret;
+		}
+
+		// 档位已断开时丢弃编码结果; 清空编码器或出错后该档位结束
+		for (AVPacket*& packet : packets)
+		{
+			if (output->attached)
+			{
+				output->packets.push_back(packet);
+			}
+			else
+			{
+				av_packet_free(&packet);
+			}
+		}
+		packets.clear();
+		output->finished = output->finished || flush || ret < 0;
+		m_cond.notify_all();
+	}
+}
\ No newline at end of file
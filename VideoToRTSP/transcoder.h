@@ -0,0 +1,104 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+extern "C"
+{
+#include "libavformat/avformat.h"
+#include "libavcodec/avcodec.h"
+#include "libswscale/swscale.h"
+};
+
+// 转码档位: 如主码流1080p、子码流720p/360p
+struct Rendition
+{
+	std::string codec = "h264";  // h264 / hevc
+	int width = 0;               // 画面宽度, 0表示按高度保持宽高比; 宽高都为0时与源视频相同
+	int height = 0;              // 画面高度, 0表示按宽度保持宽高比
+	int bitrate = 2000;          // 码率(kbps)
+	double gop = 2.0;            // 关键帧间隔(秒)
+
+	std::string name() const;    // 如 h264_720p_g2_2000k, 用于日志和指标
+};
+
+// 转码梯度: 源视频只解码一次(多线程解码), 每帧缩放后由编码线程池分别编码为各档位, 每个档位由一个推流器读取
+// CPU占用与源视频数量成正比, 与输出档位和流地址数量无关; 用于把MPEG-4/MJPEG等存档模拟成多码流网络摄像机
+// 按源视频帧率恒定输出, 不使用B帧, 固定关键帧间隔; 只向已接入的档位送帧, 最慢的档位读取方决定解码进度
+class TranscodeLadder
+{
+public:
+	~TranscodeLadder();
+
+	TranscodeLadder(const TranscodeLadder&) = delete;
+	TranscodeLadder& operator=(const TranscodeLadder&) = delete;
+
+	// 视频、档位和循环次数相同的推流共享同一个转码梯度, 最后一个推流结束时释放; 打开失败返回nullptr
+	static std::shared_ptr<TranscodeLadder> get(const std::string& video, const std::vector<Rendition>& renditions, int loop);
+
+	size_t size() const { return m_outputs.size(); }
+	const AVCodecParameters* codecpar(size_t i) const { return m_outputs[i]->codecpar; }  // extradata为Annex-B参数集
+	AVRational time_base() const { return av_inv_q(m_frameRate); }                        // 帧时间戳以帧为单位
+	AVRational frame_rate() const { return m_frameRate; }
+
+	bool attach(size_t i);   // 开始接收第i档的输出, 从下一个关键帧开始; 该档位已被读取时返回false
+	void detach(size_t i);   // 停止接收, 丢弃未读取的帧
+	int read(size_t i, AVPacket* packet);  // 取第i档的下一帧: 成功返回0, 编码未就绪返回AVERROR(EAGAIN), 全部轮次结束返回AVERROR_EOF
+
+protected:
+	// 一个输出档位, 同一时刻只由一个编码线程处理
+	struct Output
+	{
+		Rendition config;
+		AVCodecContext* encoder = NULL;
+		AVCodecParameters* codecpar = NULL;
+		SwsContext* scaler = NULL;       // 源格式或尺寸不同时缩放
+		AVFrame* scaled = NULL;          // 缩放后的帧
+		bool attached = false;           // 有推流器读取
+		bool forceKey = false;           // 下一帧编码为关键帧
+		bool busy = false;               // 编码线程正在处理
+		bool finished = false;           // 编码器已清空, 不再有新帧
+		std::deque<AVFrame*> frames;     // 待编码的帧(引用解码输出), NULL表示清空编码器
+		std::deque<AVPacket*> packets;   // 待读取的编码帧
+	};
+
+	TranscodeLadder() = default;
+	int open(const std::string& video, const std::vector<Rendition>& renditions, int loop);  // 成功返回0
+	int open_encoder(Output& output, int threads);  // threads: 编码器内部线程数; 成功返回0
+	int decode_frame(AVFrame* frame);            // 解码下一帧, 处理循环; 全部轮次结束返回AVERROR_EOF
+	int encode_frame(Output& output, AVFrame* frame, std::vector<AVPacket*>& packets);  // frame为NULL时清空编码器
+	bool can_decode() const;                     // 有已接入的档位, 且各档位队列都未满(需持有m_mutex)
+	Output* next_output();                       // 取一个有待编码帧且空闲的档位(需持有m_mutex)
+	void decode_thread();
+	void encode_thread();
+
+protected:
+	std::string m_video;
+	int m_loop = 1;                          // 循环次数
+	AVRational m_frameRate = { 25, 1 };
+	size_t m_queueLimit = 25;                // 每档待读取帧数上限(1秒), 超过时暂停解码
+
+	/**** 只在解码线程中访问 ****/
+	AVFormatContext* m_inFmtCtx = NULL;
+	AVCodecContext* m_decoder = NULL;
+	AVPacket* m_packet = NULL;
+	int m_videoIndex = -1;
+	int m_pass = 0;                          // 已完成的轮次
+	int64_t m_frameIndex = 0;                // 输出帧序号, 即编码时间戳
+
+	/**** 以下成员由m_mutex保护 ****/
+	std::mutex m_mutex;
+	std::condition_variable m_cond;          // 队列变化: 唤醒解码线程和编码线程
+	bool m_stop = false;
+	bool m_decodeEnd = false;                // 解码结束(全部轮次完成或出错)
+	int m_error = 0;                         // 解码或编码错误, 已编码的帧读完后返回
+	size_t m_nextOutput = 0;                 // 轮流分配编码线程
+	std::vector<std::unique_ptr<Output>> m_outputs;
+
+	std::vector<std::thread> m_threads;      // 解码线程和编码线程池
+};
\ No newline at end of file
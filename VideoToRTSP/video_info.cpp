@@ -1,129 +1,105 @@
+#include <cstring>
 #include <filesystem>
-#include <windows.h>
 #include "video_info.h"
+#include "video_info_cache.h"
+#include "mmap_input.h"
+#include "annexb_stream.h"
+#include "shared_registry.h"
+#ifndef VIDEOTORTSP_NO_QT
+#include "thumbnail.h"
+#endif
 
 extern "C"
 {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
-#include <libavutil/imgutils.h>
-#include <libswscale/swscale.h>
 }
 
-static std::string toUtf8(const std::string& str)
-{
-	int nwLen = MultiByteToWideChar(CP_ACP, 0, str.c_str(), -1, NULL, 0);
-
-	wchar_t* pwBuf = new wchar_t[nwLen + 1]; // 一定要加1，不然会出现尾巴
-	ZeroMemory(pwBuf, nwLen * 2 + 2);
-
-	MultiByteToWideChar(CP_ACP, 0, str.c_str(), str.length(), pwBuf, nwLen);
-
-	int nLen = WideCharToMultiByte(CP_UTF8, 0, pwBuf, -1, NULL, NULL, NULL, NULL);
-
-	char* pBuf = new char[nLen + 1];
-	ZeroMemory(pBuf, nLen + 1);
-
-	WideCharToMultiByte(CP_UTF8, 0, pwBuf, nwLen, pBuf, nLen, NULL, NULL);
-
-	std::string retStr(pBuf);
-
-	delete[] pwBuf;
-	delete[] pBuf;
+static constexpr int64_t PROBE_SIZE = 2 * 1024 * 1024;         // 探测数据量上限(Byte)
+static constexpr int64_t PROBE_DURATION = 2 * AV_TIME_BASE;      // 探测时长上限(微秒)
+static constexpr int ESTIMATE_PACKETS = 300;                     // 估算时长时最多读取的帧数
+static constexpr int64_t ESTIMATE_BYTES = 16 * 1024 * 1024;      // 估算时长时最多读取的数据量(Byte)
+static constexpr int GOP_PACKETS = 3000;                         // 统计GOP时长时最多读取的帧数
 
-	pwBuf = NULL;
-	pBuf = NULL;
-
-	return retStr;
-}
-
-// 解码一帧视频
-static QImage decode_one_frame(AVFormatContext* pInFmtCtx, int index)
+// 抽样读取若干帧, 按平均帧大小和文件长度估算时长
+static double estimate_duration(AVFormatContext* pInFmtCtx, int index, int64_t size, double fps)
 {
-	QImage image;
-
-	AVCodecParameters* codecpar = pInFmtCtx->streams[index]->codecpar;
-	AVCodecContext* codecContext = NULL;
-	const AVCodec* codec = NULL;
+	int64_t bytes = 0;  // 抽样数据量
+	int frames = 0;     // 抽样视频帧数
 
-	codec = avcodec_find_decoder(codecpar->codec_id);
-	if (!codec)
+	AVPacket packet;
+	for (int i = 0; i < ESTIMATE_PACKETS && bytes < ESTIMATE_BYTES; i++)
 	{
-		goto end;
-	}
+		if (av_read_frame(pInFmtCtx, &packet) < 0)
+		{
+			break;
+		}
 
-	codecContext = avcodec_alloc_context3(codec);
-	if (!codecContext)
-	{
-		goto end;
+		bytes += packet.size;
+		if (packet.stream_index == index)
+		{
+			frames++;
+		}
+		av_packet_unref(&packet);
 	}
 
-	if (avcodec_parameters_to_context(codecContext, codecpar) < 0)
+	if (bytes <= 0 || frames <= 0 || fps <= 0)
 	{
-		goto end;
+		return 0;
 	}
 
-	if (avcodec_open2(codecContext, codec, nullptr) < 0)
-	{
-		goto end;
-	}
+	return size / double(bytes) * frames / fps;
+}
 
-	AVPacket packet;
-	while (av_read_frame(pInFmtCtx, &packet) >= 0)
+// Annex-B裸流: 按帧索引得到精确帧数, 帧率取自VUI, 不需要ffmpeg逐帧统计
+static bool probe_annexb(const std::string& video, VideoInfo& info)
+{
+	std::shared_ptr<const AnnexBStream> stream = AnnexBStream::open(video);
+	if (!stream)
 	{
-		if (packet.stream_index == index && (packet.flags & AV_PKT_FLAG_KEY))
-		{
-			AVFrame* frame = av_frame_alloc();
-			int ret = avcodec_send_packet(codecContext, &packet);
-			if (ret < 0)
-			{
-				continue;
-			}
-
-			ret = avcodec_receive_frame(codecContext, frame);
-			if (ret == 0)
-			{
-				int width = codecpar->width;
-				int height = codecpar->height;
-
-				int size = av_image_get_buffer_size(AV_PIX_FMT_RGB24, width, height, 1);
-				uint8_t* outBuf = static_cast<uint8_t*>(av_malloc(size));
-				AVFrame* frameOut = av_frame_alloc();
-				av_image_fill_arrays(frameOut->data, frameOut->linesize, outBuf, AV_PIX_FMT_RGB24, width, height, 1);
-
-				SwsContext* swsCtx = sws_getContext(width, height, codecContext->pix_fmt, width, height, AV_PIX_FMT_RGB24, SWS_BICUBIC, NULL, NULL, NULL);
-				auto srcSlice = static_cast<const uint8_t* const*>(frame->data);
-				sws_scale(swsCtx, srcSlice, frame->linesize, 0, height, frameOut->data, frameOut->linesize);
-
-				image = QImage(static_cast<uchar*>(frameOut->data[0]), width, height, QImage::Format_RGB888).copy();
-
-				av_frame_unref(frameOut);
-				av_frame_free(&frameOut);
-
-				av_free(outBuf);
-				sws_freeContext(swsCtx);
-
-				av_packet_unref(&packet);
-				av_frame_free(&frame);
-
-				break;
-			}
-		}
+		return false;
 	}
 
-end:
-	if (codecContext)
+	info.url = video;
+	info.size = stream->bytes();
+	info.fps = av_q2d(stream->frame_rate());
+	info.duration = stream->duration();
+	info.exact_duration = true;
+	info.width = stream->codecpar()->width;
+	info.height = stream->codecpar()->height;
+	info.stream_num = 1;
+	info.video_index = 0;
+	info.encode = stream->codecpar()->codec_id == AV_CODEC_ID_HEVC ? EncodeType::HEVC : EncodeType::H264;
+	info.gop = stream->gop_duration();
+
+	// 缩略图仍由ffmpeg解码第一个关键帧
+#ifndef VIDEOTORTSP_NO_QT
+	AVFormatContext* pInFmtCtx = NULL;
+	AVDictionary* options = NULL;
+	av_dict_set_int(&options, "probesize", PROBE_SIZE, 0);
+	av_dict_set_int(&options, "analyzeduration", PROBE_DURATION, 0);
+	int ret = OpenInputFile(&pInFmtCtx, video, &options);
+	av_dict_free(&options);
+	if (ret >= 0 && avformat_find_stream_info(pInFmtCtx, 0) == 0)
 	{
-		avcodec_free_context(&codecContext);
+		info.image = DecodeThumbnail(pInFmtCtx, 0);
 	}
+	CloseInputFile(&pInFmtCtx);
+#endif
 
-	return image;
+	return true;
 }
 
-VideoInfo GetVideoInfo(const std::string& video)
+// 调用ffmpeg探测视频信息
+static VideoInfo probe_video_info(const std::string& video)
 {
 	VideoInfo info;
 
+	if (probe_annexb(video, info))
+	{
+		return info;
+	}
+
 	AVFormatContext* pInFmtCtx = NULL;
 	AVStream* pVideoStream = NULL;
 	AVCodecParameters* codecpar = NULL;
@@ -136,8 +112,14 @@ VideoInfo GetVideoInfo(const std::string& video)
 	info.url = video;
 	info.size = std::filesystem::file_size(video);
 
+	// 限制探测数据量, 大文件也能快速返回
+	AVDictionary* options = NULL;
+	av_dict_set_int(&options, "probesize", PROBE_SIZE, 0);
+	av_dict_set_int(&options, "analyzeduration", PROBE_DURATION, 0);
+
 	// 打开文件
-	int ret = avformat_open_input(&pInFmtCtx, toUtf8(video).c_str(), NULL, NULL); // ffmpeg要以UTF-8格式作为输入
+	int ret = OpenInputFile(&pInFmtCtx, video, &options);
+	av_dict_free(&options);
 	if (ret < 0)
 	{
 		goto end;
@@ -177,23 +159,11 @@ VideoInfo GetVideoInfo(const std::string& video)
 	{
 		info.duration = av_q2d(pVideoStream->time_base) * pVideoStream->duration;
 	}
-	else
+	else if (pInFmtCtx->duration > 0)
 	{
-		// 无法直接通过封装信息获取时长, 通过读取帧数来计算
-		int cnt = 0;
-		AVPacket packet;
-		while (true)
-		{
-			if (av_read_frame(pInFmtCtx, &packet) < 0)
-			{
-				av_packet_unref(&packet);
-				break;
-			}
-
-			cnt++;
-			av_packet_unref(&packet);
-		}
-		info.duration = cnt / info.fps;
+		// 封装层时长, TS等格式由ffmpeg读取文件末尾时间戳得到, 按码率推算的为估算值
+		info.duration = pInFmtCtx->duration / double(AV_TIME_BASE);
+		info.exact_duration = pInFmtCtx->duration_estimation_method != AVFMT_DURATION_FROM_BITRATE;
 	}
 
 	// 编码格式
@@ -207,15 +177,326 @@ VideoInfo GetVideoInfo(const std::string& video)
 		info.encode = EncodeType::HEVC;
 	}
 
-	// 解码一帧视频
-	info.image = decode_one_frame(pInFmtCtx, info.video_index);
+	// 缩略图, 无界面版本不需要
+#ifndef VIDEOTORTSP_NO_QT
+	info.image = DecodeThumbnail(pInFmtCtx, info.video_index);
+#endif
+
+	// 无法通过封装信息获取时长(裸流等), 抽样估算, 精确时长由CountVideoDuration后台统计
+	if (info.duration <= 0)
+	{
+		info.duration = estimate_duration(pInFmtCtx, info.video_index, info.size, info.fps);
+		info.exact_duration = false;
+	}
 
 end:
-	if (pInFmtCtx)
+	CloseInputFile(&pInFmtCtx);
+
+	return info;
+}
+
+VideoInfo GetVideoInfo(const std::string& video)
+{
+	VideoInfo info;
+	if (VideoInfoCache::instance().find(video, info))
 	{
-		avio_closep(&pInFmtCtx->pb);
-		avformat_close_input(&pInFmtCtx);
+		return info;
+	}
+
+	info = probe_video_info(video);
+	if (info.video_index != -1)
+	{
+		// 批量推流按GOP时长错开起始相位, 在后台探测时统计并随视频信息缓存; Annex-B裸流已由索引得到
+		if (info.encode != EncodeType::Other && !AnnexBStream::is_annexb(video))
+		{
+			info.gop = GetGopDuration(video);
+		}
+		VideoInfoCache::instance().insert(info);
 	}
 
 	return info;
+}
+
+double CountVideoDuration(const std::string& video, const std::atomic_bool* cancel)
+{
+	std::shared_ptr<const AnnexBStream> stream = AnnexBStream::open(video);
+	if (stream)
+	{
+		return stream->duration();
+	}
+
+	AVFormatContext* pInFmtCtx = NULL;
+	int index = -1;
+	int64_t cnt = 0;
+	double duration = -1;
+
+	if (OpenInputFile(&pInFmtCtx, video) < 0)
+	{
+		return -1;
+	}
+
+	if (avformat_find_stream_info(pInFmtCtx, NULL) != 0)
+	{
+		goto end;
+	}
+
+	for (unsigned int i = 0; i < pInFmtCtx->nb_streams; i++)
+	{
+		if (index == -1 && pInFmtCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+		{
+			index = i;
+		}
+		else
+		{
+			// 只统计视频帧
+			pInFmtCtx->streams[i]->discard = AVDISCARD_ALL;
+		}
+	}
+
+	if (index == -1 || av_q2d(pInFmtCtx->streams[index]->avg_frame_rate) <= 0)
+	{
+		goto end;
+	}
+
+	AVPacket packet;
+	while (av_read_frame(pInFmtCtx, &packet) >= 0)
+	{
+		if (packet.stream_index == index)
+		{
+			cnt++;
+		}
+		av_packet_unref(&packet);
+
+		if (cancel && *cancel)
+		{
+			goto end;
+		}
+	}
+	duration = cnt / av_q2d(pInFmtCtx->streams[index]->avg_frame_rate);
+
+end:
+	CloseInputFile(&pInFmtCtx);
+
+	return duration;
+}
+
+double GetGopDuration(const std::string& video)
+{
+	std::shared_ptr<const AnnexBStream> stream = AnnexBStream::open(video);
+	if (stream)
+	{
+		return stream->gop_duration();
+	}
+
+	AVFormatContext* pInFmtCtx = NULL;
+	int index = -1;
+	int64_t first = AV_NOPTS_VALUE;
+	double gop = 0;
+	AVPacket packet;
+
+	if (OpenInputFile(&pInFmtCtx, video) < 0)
+	{
+		return 0;
+	}
+
+	if (avformat_find_stream_info(pInFmtCtx, NULL) != 0)
+	{
+		goto end;
+	}
+
+	for (unsigned int i = 0; i < pInFmtCtx->nb_streams; i++)
+	{
+		if (index == -1 && pInFmtCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+		{
+			index = i;
+		}
+		else
+		{
+			pInFmtCtx->streams[i]->discard = AVDISCARD_ALL;
+		}
+	}
+
+	if (index == -1)
+	{
+		goto end;
+	}
+
+	for (int i = 0; i < GOP_PACKETS && av_read_frame(pInFmtCtx, &packet) >= 0; i++)
+	{
+		int64_t ts = packet.dts != AV_NOPTS_VALUE ? packet.dts : packet.pts;
+		bool key = packet.stream_index == index && (packet.flags & AV_PKT_FLAG_KEY) && ts != AV_NOPTS_VALUE;
+		av_packet_unref(&packet);
+
+		if (!key)
+		{
+			continue;
+		}
+
+		if (first == AV_NOPTS_VALUE)
+		{
+			first = ts;
+		}
+		else if (ts > first)
+		{
+			gop = (ts - first) * av_q2d(pInFmtCtx->streams[index]->time_base);
+			break;
+		}
+	}
+
+end:
+	CloseInputFile(&pInFmtCtx);
+
+	return gop;
+}
+
+// MP4在打开时已将样本表读入索引, 直接取关键帧; 其他格式的索引不完整或没有索引, 返回false
+static bool container_keyframes(AVFormatContext* pInFmtCtx, int index, std::vector<KeyFrame>& keys)
+{
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+	AVStream* stream = pInFmtCtx->streams[index];
+	int count = avformat_index_get_entries_count(stream);
+	if (std::strstr(pInFmtCtx->iformat->name, "mp4") == NULL || count <= 0)
+	{
+		return false;
+	}
+
+	double timeBase = av_q2d(stream->time_base);
+	int64_t first = avformat_index_get_entry(stream, 0)->timestamp;
+	for (int i = 0; i < count; i++)
+	{
+		const AVIndexEntry* entry = avformat_index_get_entry(stream, i);
+		if (entry->flags & AVINDEX_KEYFRAME)
+		{
+			KeyFrame key;
+			key.time = (entry->timestamp - first) * timeBase;
+			key.dts = entry->timestamp;
+			key.pos = entry->pos;
+			keys.push_back(key);
+		}
+	}
+
+	return !keys.empty();
+#else
+	return false;
+#endif
+}
+
+// 读取整个文件建立关键帧索引
+static std::vector<KeyFrame> build_keyframe_index(const std::string& video)
+{
+	std::vector<KeyFrame> keys;
+	AVFormatContext* pInFmtCtx = NULL;
+	int index = -1;
+	int64_t first = AV_NOPTS_VALUE;
+	double timeBase = 0;
+	AVPacket packet;
+
+	if (OpenInputFile(&pInFmtCtx, video) < 0)
+	{
+		return keys;
+	}
+
+	if (avformat_find_stream_info(pInFmtCtx, NULL) != 0)
+	{
+		goto end;
+	}
+
+	for (unsigned int i = 0; i < pInFmtCtx->nb_streams; i++)
+	{
+		if (index == -1 && pInFmtCtx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO)
+		{
+			index = i;
+		}
+		else
+		{
+			pInFmtCtx->streams[i]->discard = AVDISCARD_ALL;
+		}
+	}
+
+	if (index == -1 || container_keyframes(pInFmtCtx, index, keys))
+	{
+		goto end;
+	}
+
+	timeBase = av_q2d(pInFmtCtx->streams[index]->time_base);
+	while (av_read_frame(pInFmtCtx, &packet) >= 0)
+	{
+		int64_t ts = packet.dts != AV_NOPTS_VALUE ? packet.dts : packet.pts;
+		if (packet.stream_index == index && ts != AV_NOPTS_VALUE)
+		{
+			if (first == AV_NOPTS_VALUE)
+			{
+				first = ts;
+			}
+
+			if (packet.flags & AV_PKT_FLAG_KEY)
+			{
+				KeyFrame key;
+				key.time = (ts - first) * timeBase;
+				key.dts = ts;
+				key.pos = packet.pos;
+				keys.push_back(key);
+			}
+		}
+		av_packet_unref(&packet);
+	}
+
+end:
+	CloseInputFile(&pInFmtCtx);
+
+	return keys;
+}
+
+std::vector<KeyFrame> GetKeyframeIndex(const std::string& video)
+{
+	std::vector<KeyFrame> keys;
+
+	// Annex-B裸流的帧索引已在内存中, 不需要缓存
+	std::shared_ptr<const AnnexBStream> stream = AnnexBStream::open(video);
+	if (stream)
+	{
+		double fps = av_q2d(stream->frame_rate());
+		for (size_t i = 0; i < stream->size(); i++)
+		{
+			if (stream->at(i).key)
+			{
+				KeyFrame key;
+				key.time = i / fps;
+				key.dts = int64_t(i);
+				key.pos = stream->at(i).offset;
+				keys.push_back(key);
+			}
+		}
+		return keys;
+	}
+
+	if (VideoInfoCache::instance().find_keyframes(video, keys))
+	{
+		return keys;
+	}
+
+	// 建立索引需要读取整个文件, 同一视频只建立一次, 同时请求的推流器等待同一个结果
+	static SharedRegistry<const std::vector<KeyFrame>> builds;
+	std::shared_ptr<const std::vector<KeyFrame>> built = builds.get(video, [&video]() -> std::shared_ptr<const std::vector<KeyFrame>>
+		{
+			// 等待注册表期间其他调用方可能已建立完成
+			std::vector<KeyFrame> index;
+			if (!VideoInfoCache::instance().find_keyframes(video, index))
+			{
+				index = build_keyframe_index(video);
+				if (index.empty())
+				{
+					return nullptr;
+				}
+				VideoInfoCache::instance().insert_keyframes(video, index);
+			}
+
+			return std::make_shared<const std::vector<KeyFrame>>(std::move(index));
+		});
+	if (built)
+	{
+		keys = *built;
+	}
+
+	return keys;
 }
\ No newline at end of file
@@ -1,7 +1,11 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <atomic>
+#ifndef VIDEOTORTSP_NO_QT
 #include <QImage>
+#endif
 
 enum class EncodeType
 {
@@ -15,13 +19,35 @@ struct VideoInfo
 	std::string url;         // 视频路径
 	int64_t size = 0;        // 文件长度(Byte)
 	double duration = 0;     // 视频时长(秒)
+	bool exact_duration = true; // 时长是否精确, false表示按码率或抽样估算
 	double fps = 0;          // 帧率
 	int width = 0;           // 画面宽度
 	int height = 0;          // 画面高度
 	int stream_num = 0;      // 流数量
 	int video_index = -1;    // 视频流索引
-	EncodeType encode;       // 视频流编码格式
-	QImage image;            // 解码一帧图片
+	EncodeType encode = EncodeType::Other; // 视频流编码格式
+	double gop = 0;          // 前两个关键帧的间隔(秒), 0表示未知; 转码推送的视频不统计
+#ifndef VIDEOTORTSP_NO_QT
+	QImage image;            // 缩略图, 无界面版本(VIDEOTORTSP_NO_QT)不生成
+#endif
 };
 
-VideoInfo GetVideoInfo(const std::string& video);
\ No newline at end of file
+// 关键帧索引项
+struct KeyFrame
+{
+	double time = 0;         // 相对第一帧的时间(秒)
+	int64_t dts = 0;         // 原始DTS(视频流时间基), Annex-B裸流为帧序号
+	int64_t pos = -1;        // 在文件中的位置(Byte), 未知时为-1
+};
+
+VideoInfo GetVideoInfo(const std::string& video);
+
+// 关键帧索引, 与视频信息一起缓存; MP4直接取自样本表, 其他格式首次调用时需完整读取一遍文件
+std::vector<KeyFrame> GetKeyframeIndex(const std::string& video);
+
+// 逐帧统计视频时长(较慢), 用于GetVideoInfo只能估算时长的文件; cancel置位时返回-1
+double CountVideoDuration(const std::string& video, const std::atomic_bool* cancel = nullptr);
+
+// 读取开头的视频帧, 返回前两个关键帧的间隔(秒); 只有一个关键帧或读取失败时返回0
+// GetVideoInfo已统计并缓存到VideoInfo::gop, 界面线程不应直接调用
+double GetGopDuration(const std::string& video);
\ No newline at end of file
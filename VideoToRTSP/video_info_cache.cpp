@@ -0,0 +1,357 @@
+#include <fstream>
+#include <filesystem>
+#ifndef VIDEOTORTSP_NO_QT
+#include <QBuffer>
+#include <QByteArray>
+#endif
+#include "video_info_cache.h"
+
+static constexpr uint32_t CACHE_MAGIC = 0x43525456;  // "VTRC"
+static constexpr uint32_t CACHE_VERSION = 4;
+static constexpr uint32_t MAX_KEYFRAMES = 16 * 1024 * 1024;  // 关键帧数量上限, 超过视为文件损坏
+static constexpr uint32_t MAX_PATH_BYTES = 32 * 1024;        // 视频路径长度上限, 超过视为文件损坏
+static constexpr uint32_t MAX_IMAGE_BYTES = 8 * 1024 * 1024; // 缩略图长度上限, 超过视为文件损坏
+
+static void write_string(std::ostream& os, const std::string& str)
+{
+	uint32_t len = static_cast<uint32_t>(str.size());
+	os.write(reinterpret_cast<const char*>(&len), sizeof(len));
+	os.write(str.data(), len);
+}
+
+// 长度超过maxLen视为文件损坏, 不按损坏的长度申请内存
+static bool read_string(std::istream& is, std::string& str, uint32_t maxLen)
+{
+	uint32_t len = 0;
+	if (!is.read(reinterpret_cast<char*>(&len), sizeof(len)) || len > maxLen)
+	{
+		return false;
+	}
+
+	str.resize(len);
+	return bool(is.read(str.data(), len));
+}
+
+template<typename T>
+static void write_pod(std::ostream& os, const T& value)
+{
+	os.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static bool read_pod(std::istream& is, T& value)
+{
+	return bool(is.read(reinterpret_cast<char*>(&value), sizeof(T)));
+}
+
+// 关键帧索引: 是否已建立、个数, 每项为时间、DTS和文件位置
+static void write_keyframes(std::ostream& os, bool indexed, const std::vector<KeyFrame>& keys)
+{
+	write_pod(os, static_cast<uint8_t>(indexed));
+	write_pod(os, static_cast<uint32_t>(keys.size()));
+	for (const KeyFrame& key : keys)
+	{
+		write_pod(os, key.time);
+		write_pod(os, key.dts);
+		write_pod(os, key.pos);
+	}
+}
+
+static bool read_keyframes(std::istream& is, bool& indexed, std::vector<KeyFrame>& keys)
+{
+	uint8_t flag = 0;
+	uint32_t count = 0;
+	if (!read_pod(is, flag) || !read_pod(is, count) || count > MAX_KEYFRAMES)
+	{
+		return false;
+	}
+
+	indexed = flag != 0;
+	keys.resize(count);
+	for (KeyFrame& key : keys)
+	{
+		if (!read_pod(is, key.time) || !read_pod(is, key.dts) || !read_pod(is, key.pos))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+#ifndef VIDEOTORTSP_NO_QT
+// 缩略图以JPG编码保存
+static std::string encode_image(const QImage& image)
+{
+	if (image.isNull())
+	{
+		return std::string();
+	}
+
+	QByteArray bytes;
+	QBuffer buffer(&bytes);
+	buffer.open(QIODevice::WriteOnly);
+	if (!image.save(&buffer, "JPG", 85))
+	{
+		bytes.clear();
+		buffer.seek(0);
+		image.save(&buffer, "PNG");
+	}
+
+	return bytes.toStdString();
+}
+
+static QImage decode_image(const std::string& bytes)
+{
+	QImage image;
+	if (!bytes.empty())
+	{
+		image.loadFromData(reinterpret_cast<const uchar*>(bytes.data()), static_cast<int>(bytes.size()));
+	}
+
+	return image;
+}
+#endif
+
+VideoInfoCache& VideoInfoCache::instance()
+{
+	static VideoInfoCache cache;
+	return cache;
+}
+
+VideoInfoCache::~VideoInfoCache()
+{
+	save();
+}
+
+bool VideoInfoCache::file_stamp(const std::string& video, int64_t& size, int64_t& mtime)
+{
+	std::error_code ec;
+	size = std::filesystem::file_size(video, ec);
+	if (ec)
+	{
+		return false;
+	}
+
+	mtime = std::filesystem::last_write_time(video, ec).time_since_epoch().count();
+	return !ec;
+}
+
+bool VideoInfoCache::load(const std::string& file)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_file = file;
+	m_entries.clear();
+	m_dirty = false;
+
+	std::ifstream is(std::filesystem::path(file), std::ios::binary);
+	if (!is)
+	{
+		return false;
+	}
+
+	uint32_t magic = 0;
+	uint32_t version = 0;
+	uint32_t count = 0;
+	if (!read_pod(is, magic) || !read_pod(is, version) || !read_pod(is, count) || magic != CACHE_MAGIC || version != CACHE_VERSION)
+	{
+		// 格式不兼容, 丢弃旧缓存
+		m_dirty = true;
+		return false;
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		Entry entry;
+		VideoInfo& info = entry.info;
+		int32_t encode = 0;
+		uint8_t exact = 0;
+
+		bool ok = read_string(is, info.url, MAX_PATH_BYTES)
+			&& read_pod(is, entry.size)
+			&& read_pod(is, entry.mtime)
+			&& read_pod(is, info.size)
+			&& read_pod(is, info.duration)
+			&& read_pod(is, exact)
+			&& read_pod(is, info.fps)
+			&& read_pod(is, info.width)
+			&& read_pod(is, info.height)
+			&& read_pod(is, info.stream_num)
+			&& read_pod(is, info.video_index)
+			&& read_pod(is, encode)
+			&& read_pod(is, info.gop)
+			&& read_string(is, entry.image, MAX_IMAGE_BYTES)
+			&& read_keyframes(is, entry.indexed, entry.keyframes);
+		if (!ok)
+		{
+			// 文件损坏(截断或长度字段异常), 丢弃整个缓存, 保存时重写
+			m_entries.clear();
+			m_dirty = true;
+			return false;
+		}
+
+		// 文件已变化或被删除
+		int64_t size = 0;
+		int64_t mtime = 0;
+		if (!file_stamp(info.url, size, mtime) || size != entry.size || mtime != entry.mtime)
+		{
+			m_dirty = true;
+			continue;
+		}
+
+		info.exact_duration = exact != 0;
+		info.encode = static_cast<EncodeType>(encode);
+#ifndef VIDEOTORTSP_NO_QT
+		info.image = decode_image(entry.image);
+#endif
+		m_entries[info.url] = std::move(entry);
+	}
+
+	return true;
+}
+
+bool VideoInfoCache::save()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_dirty || m_file.empty())
+	{
+		return true;
+	}
+
+	// 先写临时文件再替换, 避免写入中断损坏缓存
+	std::filesystem::path path(m_file);
+	std::filesystem::path tmp(m_file + ".tmp");
+	{
+		std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+		if (!os)
+		{
+			return false;
+		}
+
+		write_pod(os, CACHE_MAGIC);
+		write_pod(os, CACHE_VERSION);
+		write_pod(os, static_cast<uint32_t>(m_entries.size()));
+
+		for (const auto& [url, entry] : m_entries)
+		{
+			const VideoInfo& info = entry.info;
+			write_string(os, info.url);
+			write_pod(os, entry.size);
+			write_pod(os, entry.mtime);
+			write_pod(os, info.size);
+			write_pod(os, info.duration);
+			write_pod(os, static_cast<uint8_t>(info.exact_duration));
+			write_pod(os, info.fps);
+			write_pod(os, info.width);
+			write_pod(os, info.height);
+			write_pod(os, info.stream_num);
+			write_pod(os, info.video_index);
+			write_pod(os, static_cast<int32_t>(info.encode));
+			write_pod(os, info.gop);
+			write_string(os, entry.image);
+			write_keyframes(os, entry.indexed, entry.keyframes);
+		}
+
+		if (!os)
+		{
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tmp, path, ec);
+	if (ec)
+	{
+		return false;
+	}
+
+	m_dirty = false;
+	return true;
+}
+
+bool VideoInfoCache::find(const std::string& video, VideoInfo& info)
+{
+	int64_t size = 0;
+	int64_t mtime = 0;
+	if (!file_stamp(video, size, mtime))
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_entries.find(video);
+	if (it == m_entries.end() || it->second.size != size || it->second.mtime != mtime)
+	{
+		return false;
+	}
+
+	info = it->second.info;
+	return true;
+}
+
+void VideoInfoCache::insert(const VideoInfo& info)
+{
+	Entry entry;
+	if (!file_stamp(info.url, entry.size, entry.mtime))
+	{
+		return;
+	}
+	entry.info = info;
+#ifndef VIDEOTORTSP_NO_QT
+	entry.image = encode_image(info.image);
+#endif
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// 更新视频信息(如后台统计出精确时长)时保留文件未变化的关键帧索引
+	auto it = m_entries.find(info.url);
+	if (it != m_entries.end() && it->second.size == entry.size && it->second.mtime == entry.mtime)
+	{
+		entry.indexed = it->second.indexed;
+		entry.keyframes = std::move(it->second.keyframes);
+	}
+
+	m_entries[info.url] = std::move(entry);
+	m_dirty = true;
+}
+
+bool VideoInfoCache::find_keyframes(const std::string& video, std::vector<KeyFrame>& keys)
+{
+	int64_t size = 0;
+	int64_t mtime = 0;
+	if (!file_stamp(video, size, mtime))
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_entries.find(video);
+	if (it == m_entries.end() || !it->second.indexed || it->second.size != size || it->second.mtime != mtime)
+	{
+		return false;
+	}
+
+	keys = it->second.keyframes;
+	return true;
+}
+
+void VideoInfoCache::insert_keyframes(const std::string& video, const std::vector<KeyFrame>& keys)
+{
+	int64_t size = 0;
+	int64_t mtime = 0;
+	if (!file_stamp(video, size, mtime))
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto it = m_entries.find(video);
+	if (it == m_entries.end() || it->second.size != size || it->second.mtime != mtime)
+	{
+		return;
+	}
+
+	it->second.indexed = true;
+	it->second.keyframes = keys;
+	m_dirty = true;
+}
\ No newline at end of file
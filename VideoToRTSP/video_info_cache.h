@@ -0,0 +1,44 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <unordered_map>
+#include "video_info.h"
+
+// 视频信息持久化缓存: 以路径、文件长度和修改时间为键, 命中时不再调用ffmpeg探测和解码
+class VideoInfoCache
+{
+public:
+	static VideoInfoCache& instance();
+
+	bool load(const std::string& file);   // 读取缓存文件, 之后save()写回该文件
+	bool save();                           // 有修改时写回缓存文件
+
+	bool find(const std::string& video, VideoInfo& info);  // 文件长度或修改时间变化视为未命中
+	void insert(const VideoInfo& info);
+
+	bool find_keyframes(const std::string& video, std::vector<KeyFrame>& keys);     // 没有缓存索引时返回false
+	void insert_keyframes(const std::string& video, const std::vector<KeyFrame>& keys); // 索引附属于视频信息, 视频信息未缓存时忽略
+
+protected:
+	VideoInfoCache() = default;
+	~VideoInfoCache();
+
+	struct Entry
+	{
+		int64_t size = 0;     // 文件长度(Byte)
+		int64_t mtime = 0;    // 修改时间
+		VideoInfo info;
+		std::string image;    // 编码后的缩略图, 保存时不再重复编码
+		bool indexed = false; // 是否已建立关键帧索引
+		std::vector<KeyFrame> keyframes;
+	};
+
+	static bool file_stamp(const std::string& video, int64_t& size, int64_t& mtime);
+
+protected:
+	std::mutex m_mutex;
+	std::string m_file;                                // 缓存文件
+	std::unordered_map<std::string, Entry> m_entries;  // 视频路径 -> 缓存项
+	bool m_dirty = false;                              // 是否有未保存的修改
+};
\ No newline at end of file
@@ -1,4 +1,6 @@
 #include <filesystem>
+#include <map>
+#include <algorithm>
 #include <QHeaderView>
 #include <QPushButton>
 #include <QComboBox>
@@ -11,8 +13,12 @@
 #include <QToolTip>
 #include <QDateTime>
 #include <QDesktopServices>
+#include <QDirIterator>
+#include <QTimer>
 #include <spdlog/spdlog.h>
 #include "video_table_widget.h"
+#include "video_info_cache.h"
+#include "annexb_stream.h"
 
 static int count = 1;
 
@@ -36,6 +42,48 @@ static QStringList getLocalIPs()
 	return ips;
 }
 
+// 推流状态单元格中保存的采样数据
+static constexpr int START_TIME_ROLE = Qt::UserRole;        // 开始推流时间(毫秒)
+static constexpr int SAMPLE_TIME_ROLE = Qt::UserRole + 1;   // 上次采样时间(毫秒)
+static constexpr int SAMPLE_BYTES_ROLE = Qt::UserRole + 2;  // 上次采样时已发送数据量(Byte)
+static constexpr int BITRATE_ROLE = Qt::UserRole + 3;       // 码率(bps)
+
+static constexpr int STATS_INTERVAL = 250;                  // 推流状态刷新间隔(毫秒)
+
+// 支持的视频文件后缀: 封装格式, 以及按裸流推送的H.264/H.265文件(与AnnexBStream使用同一列表)
+static bool isVideoFile(const QFileInfo& fileInfo)
+{
+	QString suffix = fileInfo.suffix().toLower(); // 文件后缀
+	if (suffix == "ts" || suffix == "mp4" || suffix == "flv" || suffix == "avi" || suffix == "mkv" || suffix == "mov")
+	{
+		return true;
+	}
+
+	return AnnexBStream::is_annexb(fileInfo.fileName().toLocal8Bit().toStdString());
+}
+
+// 是否为同一文件: 同一文件可能以不同的路径写法(分隔符、大小写、相对路径)多次加入
+static bool sameFile(const std::string& a, const std::string& b)
+{
+	if (a == b)
+	{
+		return true;
+	}
+
+	std::error_code ec;
+	return std::filesystem::equivalent(std::filesystem::path(a), std::filesystem::path(b), ec) && !ec;
+}
+
+// H.264/H.265以外的编码格式转码为同尺寸H.264, 码率按约0.07 bit/像素估算
+static Rendition transcodeRendition(const VideoInfo& videoInfo)
+{
+	double fps = videoInfo.fps > 0 ? videoInfo.fps : 25;
+	Rendition rendition;
+	rendition.bitrate = int(std::clamp(videoInfo.width * videoInfo.height * fps * 0.07 / 1000, 500.0, 8000.0));
+
+	return rendition;
+}
+
 static std::string toString(EncodeType encode)
 {
 	std::string type;
@@ -61,7 +109,7 @@ static QString toString(const VideoInfo& videoInfo)
 
 	info += "视频: " + QString::fromLocal8Bit(videoInfo.url) + "\n";
 	info += "文件: " + QString::number(videoInfo.size / 1024.0 / 1024) + " MB\n";
-	info += "时长: " + QString::number(videoInfo.duration) + " 秒\n";
+	info += "时长: " + QString::number(videoInfo.duration) + " 秒" + (videoInfo.exact_duration ? "" : " (估算)") + "\n";
 	info += "帧率: " + QString::number(videoInfo.fps) + " fps\n";
 	info += "宽高: " + QString::number(videoInfo.width) + "x" + QString::number(videoInfo.height) + "\n";
 	info += "编码格式: " + QString::fromStdString(toString(videoInfo.encode));
@@ -123,38 +171,41 @@ VideoTableWidget::VideoTableWidget(QWidget* parent) : QTableWidget(parent)
 	QFont font2("Microsoft YaHei");
 	font2.setPointSize(9);
 	QToolTip::setFont(font2);
+
+	// 定时采样推流统计, 推流线程不直接操作界面
+	QTimer* timer = new QTimer(this);
+	connect(timer, &QTimer::timeout, this, &VideoTableWidget::onStatsTimer);
+	timer->start(STATS_INTERVAL);
 }
 
 VideoTableWidget::~VideoTableWidget()
 {
+	// 丢弃尚未开始的后台任务, 只等待正在执行的任务
+	m_quit = true;
+	m_probePool.clear();
+	m_pool.clear();
+	m_probePool.waitForDone();
+	m_pool.waitForDone();
+
 	stopAll();
 	spdlog::info("Program exit");
 }
 
-// 添加推流视频
+// 添加推流视频: 先插入占位行, 视频信息由后台线程探测后填充
 void VideoTableWidget::addTableItem(const QString& video)
 {
 	std::filesystem::path videoPath(video.toLocal8Bit().toStdString());
 
 	QFileInfo fileInfo(video);
-	QString suffix = fileInfo.suffix(); // 文件后缀
-	if (suffix != "ts" && suffix != "mp4" && suffix != "h264" && suffix != "h265" && suffix != "flv" && suffix != "avi")
+	if (!isVideoFile(fileInfo))
 	{
 		spdlog::error("非视频文件: {}", videoPath.filename().string());
 		QMessageBox::about(nullptr, "错误", "非视频文件: " + fileInfo.fileName());
 		return;
 	}
 
-	// 视频信息
-	VideoInfo videoInfo = GetVideoInfo(videoPath.string());
-	if (videoInfo.encode != EncodeType::H264 && videoInfo.encode != EncodeType::HEVC)
-	{
-		spdlog::error("不支持的视频编码格式: {}", videoPath.filename().string());
-		QMessageBox::about(nullptr, "错误", "不支持的视频编码格式: " + fileInfo.fileName());
-		return;
-	}
-
-	spdlog::info("Add video: [{}], Duration: {} s, {}x{}, fps: {}, Encode: {}", videoPath.filename().string(), videoInfo.duration, videoInfo.width, videoInfo.height, videoInfo.fps, toString(videoInfo.encode));
+	VideoInfo videoInfo;
+	videoInfo.url = videoPath.string();
 
 	/**** 添加数据 ****/
 	int row = this->rowCount();
@@ -183,12 +234,13 @@ void VideoTableWidget::addTableItem(const QString& video)
 	this->setItem(row, 2, new QTableWidgetItem(url));
 
 	// [4] 状态
-	this->setItem(row, 4, new QTableWidgetItem("Stop"));
+	this->setItem(row, 4, new QTableWidgetItem("探测中..."));
 
 	// [5] 推流
 	QPushButton* pushBtn = new QPushButton("推流");
 	// 设置border-radius后background-color才能生效
 	pushBtn->setStyleSheet("QPushButton{border-radius: 0px;} QPushButton:hover {color: white; background-color: green; border-radius: 0px;}");
+	pushBtn->setEnabled(false); // 探测完成后才能推流
 	this->setCellWidget(row, 5, pushBtn);
 	connect(pushBtn, &QPushButton::clicked, this, &VideoTableWidget::onPushButtonClicked);
 
@@ -198,8 +250,25 @@ void VideoTableWidget::addTableItem(const QString& video)
 	this->setCellWidget(row, 6, delBtn);
 	connect(delBtn, &QPushButton::clicked, this, &VideoTableWidget::onDelButtonClicked);
 
+	// 同一视频共用一个推流器, 只解复用一次, 分发到多个流地址
+	// 转码档位只能由一个推流器读取, 同一文件的多行必须共用推流器, 否则后开始的一行无法接入转码器
+	std::shared_ptr<RtspSender> sender;
+	for (int i = 0; i < m_videos.size(); i++)
+	{
+		if (sameFile(m_videos[i].url, videoInfo.url))
+		{
+			sender = m_senders[i];
+			break;
+		}
+	}
+
+	if (!sender)
+	{
+		sender = std::make_shared<RtspSender>();
+	}
+
 	m_videos.append(videoInfo);
-	m_senders.emplaceBack(std::make_shared<RtspSender>());
+	m_senders.append(sender);
 
 	/**** 单元格样式 ****/
 	// 文本对齐
@@ -220,15 +289,154 @@ void VideoTableWidget::addTableItem(const QString& video)
 	this->item(row, 1)->setFlags(this->item(row, 1)->flags() & (~Qt::ItemIsEditable));
 	this->item(row, 4)->setFlags(this->item(row, 4)->flags() & (~Qt::ItemIsEditable));
 
-	spdlog::info("Add video: [{}] success", videoPath.filename().string());
+	// 后台探测视频信息, 按编号找回对应行(期间行可能被删除)
+	int id = m_importId++;
+	this->item(row, 1)->setData(Qt::UserRole, id);
+	m_importing++;
+
+	std::string path = videoInfo.url;
+	m_probePool.start([this, id, path]()
+		{
+			if (m_quit)
+			{
+				return;
+			}
+
+			VideoInfo info = GetVideoInfo(path);
+			if (m_quit)
+			{
+				return;
+			}
+
+			// 回到GUI线程填充
+			QMetaObject::invokeMethod(this, [this, id, info]() { onProbed(id, info); }, Qt::QueuedConnection);
+		});
+}
+
+// 视频信息探测完成
+void VideoTableWidget::onProbed(int id, const VideoInfo& videoInfo)
+{
+	m_importing--;
+
+	int row = -1;
+	for (int i = 0; i < this->rowCount(); i++)
+	{
+		if (this->item(i, 1)->data(Qt::UserRole).toInt() == id)
+		{
+			row = i;
+			break;
+		}
+	}
+
+	if (row >= 0)
+	{
+		std::string fileName = std::filesystem::path(m_videos[row].url).filename().string();
+		if (videoInfo.video_index == -1)
+		{
+			spdlog::error("没有视频流: {}", fileName);
+			m_importErrors << this->item(row, 1)->text();
+			removeVideo(row);
+		}
+		else
+		{
+			spdlog::info("Add video: [{}], Duration: {} s, {}x{}, fps: {}, Encode: {}{}", fileName, videoInfo.duration, videoInfo.width, videoInfo.height, videoInfo.fps,
+				toString(videoInfo.encode), videoInfo.encode == EncodeType::Other ? " (transcode)" : "");
+
+			m_videos[row] = videoInfo;
+			this->item(row, 4)->setText("Stop");
+			this->cellWidget(row, 5)->setEnabled(true);
+
+			spdlog::info("Add video: [{}] success", fileName);
+
+			// 时长为估算值, 后台逐帧统计
+			if (!videoInfo.exact_duration)
+			{
+				countDuration(videoInfo);
+			}
+		}
+	}
+
+	// 本批导入完成
+	if (m_importing == 0)
+	{
+		VideoInfoCache::instance().save();
+
+		if (!m_importErrors.isEmpty())
+		{
+			QMessageBox::about(nullptr, "错误", "没有视频流:\n" + m_importErrors.join("\n"));
+			m_importErrors.clear();
+		}
+	}
 }
 
+// 移除一行数据
+void VideoTableWidget::removeVideo(int row)
+{
+	// 仍在结束中的推流器(如正在打开)移到待释放列表, 由定时器在结束后释放, 析构时不阻塞界面
+	if (m_senders[row].use_count() == 1 && m_senders[row]->running())
+	{
+		m_retired.append(m_senders[row]);
+	}
+	m_senders.removeAt(row);
+	m_videos.removeAt(row);
+	this->removeRow(row);
+
+	// 刷新序号
+	int cnt = this->rowCount();
+	for (int i = 0; i < cnt; i++)
+	{
+		this->item(i, 0)->setText(QString::number(i + 1));
+	}
+}
+
+void VideoTableWidget::countDuration(const VideoInfo& videoInfo)
+{
+	std::string video = videoInfo.url;
+	m_pool.start([this, video]()
+		{
+			double duration = CountVideoDuration(video, &m_quit);
+			if (duration <= 0 || m_quit)
+			{
+				return;
+			}
+
+			// 回到GUI线程更新
+			QMetaObject::invokeMethod(this, [this, video, duration]() { updateDuration(video, duration); }, Qt::QueuedConnection);
+		});
+}
+
+void VideoTableWidget::updateDuration(const std::string& video, double duration)
+{
+	for (auto& info : m_videos)
+	{
+		if (info.url == video)
+		{
+			info.duration = duration;
+			info.exact_duration = true;
+			VideoInfoCache::instance().insert(info);
+		}
+	}
+	VideoInfoCache::instance().save();
+
+	spdlog::info("Update duration: [{}], Duration: {} s", std::filesystem::path(video).filename().string(), duration);
+}
+
+// 全部停止: 直接停止推流器, 不逐个地址等待调度线程移除
 void VideoTableWidget::stopAll()
 {
 	for (const auto& sender : m_senders)
 	{
 		sender->stop();
 	}
+
+	for (int row = 0; row < this->rowCount(); row++)
+	{
+		QPushButton* button = dynamic_cast<QPushButton*>(this->cellWidget(row, 5));
+		if (button && button->text() == "停止")
+		{
+			setRowStopped(row);
+		}
+	}
 }
 
 // 删除一行数据
@@ -248,20 +456,11 @@ void VideoTableWidget::onDelButtonClicked()
 	std::string video = m_videos[row].url;
 	std::string url = this->item(row, 2)->text().toStdString();
 
-	// 停止推流
-	m_senders[row]->stop();
+	// 停止推流, 不等待; 最后一个流地址移除后推流器自行结束
+	m_senders[row]->remove_output(url);
 	spdlog::info("Stop {}", url);
 
-	m_senders.removeAt(row);
-	m_videos.removeAt(row);
-	this->removeRow(row);
-
-	// 刷新序号
-	int cnt = this->rowCount();
-	for (int i = 0; i < cnt; i++)
-	{
-		this->item(row, 0)->setText(QString::number(i + 1));
-	}
+	removeVideo(row);
 
 	spdlog::info("Delete {} success", video);
 }
@@ -282,66 +481,188 @@ void VideoTableWidget::onPushButtonClicked()
 
 	if (button->text() == "推流")
 	{
-		RTSPConfig config;
-		config.video = m_videos.at(row).url;
-		config.url = this->item(row, 2)->text().toStdString(); // 流地址
-		config.loop = 1000000;
+		startRow(row, 0);
+	}
+	else
+	{
+		stopRow(row);
+	}
+}
 
-		double duration = m_videos.at(row).duration;  // 视频时长
-		QDateTime startTime = QDateTime::currentDateTime();
-		QTableWidgetItem* item = this->item(row, 4);
+// 开始推流一行, delayMs: 推流器未运行时延迟开始, 已运行时该地址相对其他地址延迟
+void VideoTableWidget::startRow(int row, int delayMs)
+{
+	QPushButton* button = dynamic_cast<QPushButton*>(this->cellWidget(row, 5));
 
-		config.callback = [item, startTime, duration](double p)
-			{
-				QDateTime curTime = QDateTime::currentDateTime();
-				int seconds = startTime.secsTo(curTime);
-				int h = seconds / 3600;
-				int m = seconds % 3600 / 60;
-				int s = seconds % 60;
-
-				QString txt;
-				if (duration > 5000)
-				{
-					txt = "[" + QString("%1:%2:%3").arg(h).arg(m, 2, 10, QLatin1Char('0')).arg(s, 2, 10, QLatin1Char('0')) + "]  " + QString::number(p * 100, 'f', 2) + " %";
-				}
-				else if (duration > 500)
-				{
-					txt = "[" + QString("%1:%2:%3").arg(h).arg(m, 2, 10, QLatin1Char('0')).arg(s, 2, 10, QLatin1Char('0')) + "]  " + QString::number(p * 100, 'f', 1) + " %";
-				}
-				else
-				{
-					txt = "[" + QString("%1:%2:%3").arg(h).arg(m, 2, 10, QLatin1Char('0')).arg(s, 2, 10, QLatin1Char('0')) + "]  " + QString::number(int(p * 100 + 0.5)) + " %";
-				}
+	RTSPConfig config;
+	config.video = m_videos.at(row).url;
+	config.url = this->item(row, 2)->text().toStdString(); // 流地址
+	config.loop = 1000000;
+	config.start_delay_ms = delayMs;
+
+	// 其他编码格式转码推送
+	if (m_videos.at(row).encode == EncodeType::Other)
+	{
+		config.source = SourceType::Transcode;
+		config.ladder = { transcodeRendition(m_videos.at(row)) };
+	}
 
-				item->setText(txt);
-				item->setForeground(QColor(0, 127, 0));
-			};
+	// 推流状态由定时器采样刷新
+	QTableWidgetItem* item = this->item(row, 4);
+	qint64 now = QDateTime::currentMSecsSinceEpoch();
+	item->setData(START_TIME_ROLE, now);
+	item->setData(SAMPLE_TIME_ROLE, now);
+	item->setData(SAMPLE_BYTES_ROLE, qint64(m_senders[row]->stats().bytes.load(std::memory_order_relaxed)));
+	item->setData(BITRATE_ROLE, 0.0);
 
-		spdlog::info("Start to push {}", config.url);
+	spdlog::info("Start to push {}", config.url);
+	if (!m_senders[row]->add_output(config.url, delayMs))
+	{
 		m_senders[row]->async_send_rtsp(config); // 推流
+	}
+
+	button->setText("停止");
+	QComboBox* comboBox = dynamic_cast<QComboBox*>(this->cellWidget(row, 3));
+	comboBox->setEnabled(false);
+	comboBox->setStyleSheet("QComboBox{border-radius: 0px;color:#aaaaaa;} QComboBox::drop-down {border: none;} QComboBox::hover {background-color: green;}");
 
-		button->setText("停止");
-		QComboBox* comboBox = dynamic_cast<QComboBox*>(this->cellWidget(row, 3));
-		comboBox->setEnabled(false);
-		comboBox->setStyleSheet("QComboBox{border-radius: 0px;color:#aaaaaa;} QComboBox::drop-down {border: none;} QComboBox::hover {background-color: green;}");
+	spdlog::info("Push {} success", config.url);
+}
 
-		spdlog::info("Push {} success", config.url);
+// 停止推流一行, 同一视频的其他流地址继续推流
+void VideoTableWidget::stopRow(int row)
+{
+	std::string url = this->item(row, 2)->text().toStdString();
+	spdlog::info("Start to stop {}", url);
+
+	// 不等待推流器关闭输出(推流器可能正在等待开始或打开中), 最后一个流地址移除后推流器自行结束
+	m_senders[row]->remove_output(url);
+
+	setRowStopped(row);
+	spdlog::info("Stop {} success", url);
+}
+
+void VideoTableWidget::setRowStopped(int row)
+{
+	QPushButton* button = dynamic_cast<QPushButton*>(this->cellWidget(row, 5));
+	button->setText("推流");
+	this->item(row, 4)->setText("Stop");
+	this->item(row, 4)->setForeground(QColor(0, 0, 0));
+
+	QComboBox* comboBox = dynamic_cast<QComboBox*>(this->cellWidget(row, 3));
+	comboBox->setEnabled(true);
+	comboBox->setStyleSheet("QComboBox{border-radius: 0px;color:black;} QComboBox::drop-down {border: none;} QComboBox::hover {background-color: green;}");
+}
+
+// 全部推流: 各行开始时间在一个GOP内均匀错开, 关键帧不在同一时刻突发
+void VideoTableWidget::startAll()
+{
+	QList<int> rows;
+	for (int row = 0; row < this->rowCount(); row++)
+	{
+		QPushButton* button = dynamic_cast<QPushButton*>(this->cellWidget(row, 5));
+		if (button && button->isEnabled() && button->text() == "推流")
+		{
+			rows << row;
+		}
 	}
-	else
+
+	std::map<RtspSender*, int> phases;               // 推流器 -> 本批第一行的相位(毫秒)
+	for (int i = 0; i < rows.size(); i++)
+	{
+		int row = rows[i];
+
+		// GOP时长在后台探测时已统计; 无法统计(如全部为关键帧)时按1秒错开, 转码推送时按编码器的关键帧间隔
+		double gop = m_videos[row].encode == EncodeType::Other ? Rendition().gop : m_videos[row].gop;
+		if (gop <= 0)
+		{
+			gop = 1.0;
+		}
+
+		int phase = int(gop * 1000 * i / rows.size());
+
+		// 同一推流器的后续行按相对第一行的相位延迟; 推流器已在运行时相位从0算起
+		RtspSender* sender = m_senders[row].get();
+		if (phases.count(sender) == 0)
+		{
+			phases[sender] = sender->output_count() > 0 ? 0 : phase;
+			startRow(row, phase);
+		}
+		else
+		{
+			startRow(row, phase - phases[sender]);
+		}
+	}
+
+	spdlog::info("Start all: {} streams", rows.size());
+}
+
+// 刷新推流进度
+void VideoTableWidget::onStatsTimer()
+{
+	qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+	// 释放已结束的推流器
+	for (int i = m_retired.size() - 1; i >= 0; i--)
+	{
+		if (!m_retired[i]->running())
+		{
+			m_retired.removeAt(i);
+		}
+	}
+
+	int cnt = this->rowCount();
+	for (int row = 0; row < cnt; row++)
 	{
-		std::string url = this->item(row, 2)->text().toStdString();
-		spdlog::info("Start to stop {}", url);
+		QPushButton* button = dynamic_cast<QPushButton*>(this->cellWidget(row, 5));
+		if (button == nullptr || button->text() != "停止")
+		{
+			continue;
+		}
+
+		const SenderStats& stats = m_senders[row]->stats();
+		int64_t bytes = stats.bytes.load(std::memory_order_relaxed);
+		int64_t position = stats.position.load(std::memory_order_relaxed);
+
+		// 码率
+		QTableWidgetItem* item = this->item(row, 4);
+		qint64 sampleTime = item->data(SAMPLE_TIME_ROLE).toLongLong();
+		qint64 sampleBytes = item->data(SAMPLE_BYTES_ROLE).toLongLong();
+		if (now > sampleTime && bytes >= sampleBytes)
+		{
+			item->setData(BITRATE_ROLE, (bytes - sampleBytes) * 8 * 1000.0 / (now - sampleTime));
+		}
+		item->setData(SAMPLE_TIME_ROLE, now);
+		item->setData(SAMPLE_BYTES_ROLE, qint64(bytes));
 
-		m_senders[row]->stop(); // 停止推流
+		// 进度
+		double duration = m_videos.at(row).duration;  // 视频时长
+		double p = duration > 0 ? position / 1000000.0 / duration : 0;
 
-		button->setText("推流");
-		this->item(row, 4)->setText("Stop");
-		this->item(row, 4)->setForeground(QColor(0, 0, 0));
+		int seconds = int((now - item->data(START_TIME_ROLE).toLongLong()) / 1000);
+		int h = seconds / 3600;
+		int m = seconds % 3600 / 60;
+		int s = seconds % 60;
 
-		QComboBox* comboBox = dynamic_cast<QComboBox*>(this->cellWidget(row, 3));
-		comboBox->setEnabled(true);
-		comboBox->setStyleSheet("QComboBox{border-radius: 0px;color:black;} QComboBox::drop-down {border: none;} QComboBox::hover {background-color: green;}");
-		spdlog::info("Stop {} success", url);
+		QString txt;
+		if (duration > 5000)
+		{
+			txt = "[" + QString("%1:%2:%3").arg(h).arg(m, 2, 10, QLatin1Char('0')).arg(s, 2, 10, QLatin1Char('0')) + "]  " + QString::number(p * 100, 'f', 2) + " %";
+		}
+		else if (duration > 500)
+		{
+			txt = "[" + QString("%1:%2:%3").arg(h).arg(m, 2, 10, QLatin1Char('0')).arg(s, 2, 10, QLatin1Char('0')) + "]  " + QString::number(p * 100, 'f', 1) + " %";
+		}
+		else
+		{
+			txt = "[" + QString("%1:%2:%3").arg(h).arg(m, 2, 10, QLatin1Char('0')).arg(s, 2, 10, QLatin1Char('0')) + "]  " + QString::number(int(p * 100 + 0.5)) + " %";
+		}
+
+		if (item->text() != txt)
+		{
+			item->setText(txt);
+		}
+		item->setForeground(QColor(0, 127, 0));
 	}
 }
 
@@ -392,7 +713,23 @@ void VideoTableWidget::dropEvent(QDropEvent* event)
 		for (const auto& url : mimeData->urls())
 		{
 			QString fileName = url.toLocalFile();
-			addTableItem(fileName);
+			if (QFileInfo(fileName).isDir())
+			{
+				// 文件夹: 递归添加其中的视频文件
+				QDirIterator it(fileName, QDir::Files, QDirIterator::Subdirectories);
+				while (it.hasNext())
+				{
+					QString file = it.next();
+					if (isVideoFile(QFileInfo(file)))
+					{
+						addTableItem(file);
+					}
+				}
+			}
+			else
+			{
+				addTableItem(fileName);
+			}
 		}
 	}
 }
@@ -447,7 +784,15 @@ void VideoTableWidget::showToolTip(QMouseEvent* event)
 		}
 		else if (col == 4)
 		{
-			QToolTip::showText(event->globalPosition().toPoint(), "推流状态");
+			QString txt = "推流状态";
+			QPushButton* button = dynamic_cast<QPushButton*>(this->cellWidget(row, 5));
+			if (button && button->text() == "停止")
+			{
+				const SenderStats& stats = m_senders[row]->stats();
+				txt += "\n帧数: " + QString::number(stats.frames.load(std::memory_order_relaxed));
+				txt += "\n码率: " + QString::number(this->item(row, 4)->data(BITRATE_ROLE).toDouble() / 1000, 'f', 0) + " kbps";
+			}
+			QToolTip::showText(event->globalPosition().toPoint(), txt);
 		}
 		else if (col == 5 || col == 6)
 		{
@@ -4,7 +4,9 @@
 #include <QFileInfo>
 #include <QEvent>
 #include <QMouseEvent>
+#include <QThreadPool>
 #include <memory>
+#include <atomic>
 #include "video_info.h"
 #include "send_rtsp.h"
 
@@ -15,12 +17,18 @@ public:
 	~VideoTableWidget();
 
 	void addTableItem(const QString& video);
+	void startAll();   // 全部推流, 各行关键帧相位错开
 	void stopAll();
 
 protected:
 	void onPushButtonClicked();    // 推流button
 	void onDelButtonClicked();     // 删除button
 	void onActivated(int index);   // IP comboBox
+	void onStatsTimer();           // 定时刷新推流状态
+
+	void startRow(int row, int delayMs);
+	void stopRow(int row);
+	void setRowStopped(int row);   // 推流button和状态恢复为未推流
 
 	void dragEnterEvent(QDragEnterEvent* event) override;    // 文件拖拽: 进入
 	void dragMoveEvent(QDragMoveEvent* event) override;      // 文件拖拽: 移动
@@ -32,7 +40,22 @@ protected:
 
 	void showToolTip(QMouseEvent* event);
 
+	void onProbed(int id, const VideoInfo& videoInfo);               // 后台探测完成, 填充对应行
+	void removeVideo(int row);                                       // 移除一行数据
+
+	void countDuration(const VideoInfo& videoInfo);                  // 后台统计精确时长
+	void updateDuration(const std::string& video, double duration);  // 更新视频时长
+
 protected:
 	QList<VideoInfo> m_videos;
-	QList<std::shared_ptr<RtspSender>> m_senders;  // 推流器
+	QList<std::shared_ptr<RtspSender>> m_senders;  // 推流器, 同一视频的行共用
+	QList<std::shared_ptr<RtspSender>> m_retired;  // 已删除行的推流器, 结束后由定时器释放
+
+	QThreadPool m_probePool;          // 并行探测导入的视频
+	int m_importId = 0;               // 导入编号, 用于探测完成后找回对应行
+	int m_importing = 0;              // 正在探测的视频数量
+	QStringList m_importErrors;       // 本批导入失败的视频
+
+	QThreadPool m_pool;               // 后台任务
+	std::atomic_bool m_quit = false;  // 退出时取消后台任务
 };
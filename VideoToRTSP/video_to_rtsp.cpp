@@ -1,43 +1,40 @@
 #include <QMessageBox>
 #include <QDir>
-#include <filesystem>
+#include <QToolBar>
 #include <spdlog/spdlog.h>
 #include "video_to_rtsp.h"
+#include "rtsp_server.h"
+
+// 内置RTSP服务端口, 与推流地址中的端口一致
+static constexpr int RTSP_PORT = 8554;
+static constexpr size_t GOP_CACHE_LIMIT = 4 * 1024 * 1024;   // 每路GOP缓存上限, 新客户端从最近的关键帧立即开始; 不超过客户端未发送数据上限
 
 VideoToRTSP::VideoToRTSP(QWidget* parent)
 	: QMainWindow(parent),
-	ui(new Ui::VideoToRTSPClass()),
-	mediamtx(new QProcess)
+	ui(new Ui::VideoToRTSPClass())
 {
 	ui->setupUi(this);
 
-	if (std::filesystem::exists("mediamtx.exe"))
-	{
-		// 启动mediamtx推流服务
-		mediamtx->start("mediamtx.exe");
-		if (!mediamtx->waitForStarted())
-		{
-			spdlog::error("无法启动推流服务");
-			QMessageBox::about(nullptr, "错误", "无法启动推流服务");
-		}
-		else
-		{
-			spdlog::info("Start mediamtx.exe success");
-		}
-	}
-	else
+	// 批量推流/停止
+	QToolBar* toolBar = addToolBar("推流");
+	toolBar->setMovable(false);
+	toolBar->addAction("全部推流", ui->tableWidget, &VideoTableWidget::startAll);
+	toolBar->addAction("全部停止", ui->tableWidget, &VideoTableWidget::stopAll);
+
+	// 启动内置RTSP服务
+	RtspServer::instance().set_gop_cache(GOP_CACHE_LIMIT);
+	if (!RtspServer::instance().start(RTSP_PORT))
 	{
-		spdlog::error("Can not find mediamtx.exe");
-		QMessageBox::about(nullptr, "错误", "Can not find mediamtx.exe");
+		spdlog::error("无法启动推流服务");
+		QMessageBox::about(nullptr, "错误", "无法启动推流服务, 端口8554被占用");
 	}
 }
 
 VideoToRTSP::~VideoToRTSP()
 {
 	ui->tableWidget->stopAll();
-	mediamtx->kill();
-	spdlog::info("Stop mediamtx.exe");
+	RtspServer::instance().stop();
+	spdlog::info("Stop RTSP server");
 
-	delete mediamtx;
 	delete ui;
 }
\ No newline at end of file
@@ -1,7 +1,6 @@
 #pragma once
 
 #include <QtWidgets/QMainWindow>
-#include <QProcess>
 #include "ui_video_to_rtsp.h"
 
 QT_BEGIN_NAMESPACE
@@ -18,5 +17,4 @@ public:
 
 private:
 	Ui::VideoToRTSPClass* ui;
-	QProcess* mediamtx;
-};
+};
\ No newline at end of file
@@ -0,0 +1,55 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+#include "cpu_time.h"
+
+#ifdef _WIN32
+// FILETIME单位为100纳秒
+static int64_t filetime_us(const FILETIME& time)
+{
+	ULARGE_INTEGER value;
+	value.LowPart = time.dwLowDateTime;
+	value.HighPart = time.dwHighDateTime;
+	return int64_t(value.QuadPart / 10);
+}
+#else
+static int64_t clock_us(clockid_t clock)
+{
+	timespec ts;
+	if (clock_gettime(clock, &ts) != 0)
+	{
+		return 0;
+	}
+	return int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+#endif
+
+int64_t process_cpu_time()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+	{
+		return 0;
+	}
+	return filetime_us(kernel) + filetime_us(user);
+#else
+	return clock_us(CLOCK_PROCESS_CPUTIME_ID);
+#endif
+}
+
+int64_t thread_cpu_time()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+	{
+		return 0;
+	}
+	return filetime_us(kernel) + filetime_us(user);
+#else
+	return clock_us(CLOCK_THREAD_CPUTIME_ID);
+#endif
+}
\ No newline at end of file
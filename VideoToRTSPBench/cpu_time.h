@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+int64_t process_cpu_time();   // 进程已用CPU时间(用户态+内核态, 微秒)
+int64_t thread_cpu_time();    // 当前线程已用CPU时间(用户态+内核态, 微秒)
\ No newline at end of file
@@ -0,0 +1,414 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <array>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include "send_rtsp.h"
+#include "rtsp_sink.h"
+#include "synthetic_clip.h"
+#include "cpu_time.h"
+
+extern "C"
+{
+#include "libavformat/avformat.h"
+};
+
+// 推流性能测试: 生成测试视频, 以1..N路并发推送到进程内的RTSP接收端, 统计吞吐、CPU和发送抖动
+// 每个并发档位输出一行JSON到标准输出(日志输出到标准错误), 便于脚本收集和对比
+struct BenchConfig
+{
+	ClipConfig clip;
+	std::vector<int> streams = { 1, 2, 4, 8, 16, 32 };  // 并发档位
+	int warmup = 3;              // 预热时长(秒), 不计入统计
+	int duration = 10;           // 每档统计时长(秒)
+	int port = 18554;            // 第一个接收端端口, 之后依次递增
+	double lateness_limit = 5;   // 发送延迟p99上限(毫秒), 超过视为节奏劣化
+	double receive_limit = 0.99; // 接收帧率下限(相对标称帧率), 低于视为丢帧
+	bool all = false;            // 劣化后继续测试更高档位
+	std::string dir;             // 测试视频目录, 默认系统临时目录
+	std::string output;          // 结果另存文件(追加)
+};
+
+static void print_usage()
+{
+	std::cerr << "Usage: VideoToRTSPBench [options]\n"
+		"  --codec h264|hevc        编码格式 (h264)\n"
+		"  --size WxH               分辨率 (1920x1080)\n"
+		"  --fps N                  帧率 (25)\n"
+		"  --gop N                  关键帧间隔 (50)\n"
+		"  --bframes N              连续B帧数量, 大于0时jitter_ms不准确 (0)\n"
+		"  --bitrate N              码率kbps (4000)\n"
+		"  --clip-seconds N         测试视频时长, 循环推流 (10)\n"
+		"  --streams 1,2,4,...      并发档位 (1,2,4,8,16,32)\n"
+		"  --warmup N               每档预热秒数 (3)\n"
+		"  --duration N             每档统计秒数 (10)\n"
+		"  --port N                 第一个接收端端口 (18554)\n"
+		"  --lateness-limit MS      发送延迟p99上限 (5)\n"
+		"  --receive-limit R        接收帧率下限, 相对标称帧率 (0.99)\n"
+		"  --all                    节奏劣化后继续测试\n"
+		"  --dir PATH               测试视频目录 (临时目录)\n"
+		"  --output FILE            结果同时追加到文件\n";
+}
+
+static std::vector<int> parse_list(const std::string& text)
+{
+	std::vector<int> values;
+	std::stringstream ss(text);
+	std::string item;
+	while (std::getline(ss, item, ','))
+	{
+		int value = std::atoi(item.c_str());
+		if (value > 0)
+		{
+			values.push_back(value);
+		}
+	}
+
+	return values;
+}
+
+static bool parse_args(int argc, char* argv[], BenchConfig& config)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--all")
+		{
+			config.all = true;
+			continue;
+		}
+
+		if (i + 1 >= argc)
+		{
+			return false;
+		}
+
+		std::string value = argv[++i];
+		if (arg == "--codec")
+		{
+			config.clip.codec = value;
+		}
+		else if (arg == "--size")
+		{
+			if (std::sscanf(value.c_str(), "%dx%d", &config.clip.width, &config.clip.height) != 2)
+			{
+				return false;
+			}
+		}
+		else if (arg == "--fps")
+		{
+			config.clip.fps = std::atoi(value.c_str());
+		}
+		else if (arg == "--gop")
+		{
+			config.clip.gop = std::atoi(value.c_str());
+		}
+		else if (arg == "--bframes")
+		{
+			config.clip.bframes = std::atoi(value.c_str());
+		}
+		else if (arg == "--bitrate")
+		{
+			config.clip.bitrate = std::atoi(value.c_str());
+		}
+		else if (arg == "--clip-seconds")
+		{
+			config.clip.seconds = std::atoi(value.c_str());
+		}
+		else if (arg == "--streams")
+		{
+			config.streams = parse_list(value);
+		}
+		else if (arg == "--warmup")
+		{
+			config.warmup = std::atoi(value.c_str());
+		}
+		else if (arg == "--duration")
+		{
+			config.duration = std::atoi(value.c_str());
+		}
+		else if (arg == "--port")
+		{
+			config.port = std::atoi(value.c_str());
+		}
+		else if (arg == "--lateness-limit")
+		{
+			config.lateness_limit = std::atof(value.c_str());
+		}
+		else if (arg == "--receive-limit")
+		{
+			config.receive_limit = std::atof(value.c_str());
+		}
+		else if (arg == "--dir")
+		{
+			config.dir = value;
+		}
+		else if (arg == "--output")
+		{
+			config.output = value;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	return config.clip.width > 0 && config.clip.height > 0 && config.clip.fps > 0 && config.clip.gop > 0
+		&& config.clip.seconds > 0 && config.duration > 0 && config.warmup >= 0 && config.receive_limit >= 0 && !config.streams.empty();
+}
+
+// 合并多路直方图的分桶计数, 计算分位数(毫秒)
+class HistogramSum
+{
+public:
+	void add(const Histogram& histogram)
+	{
+		for (size_t i = 0; i < m_buckets.size(); i++)
+		{
+			m_buckets[i] += histogram.bucket(i);
+		}
+	}
+
+	// 减去统计开始时的计数, 只保留统计窗口内的数据
+	void subtract(const HistogramSum& other)
+	{
+		for (size_t i = 0; i < m_buckets.size(); i++)
+		{
+			m_buckets[i] -= std::min(m_buckets[i], other.m_buckets[i]);
+		}
+	}
+
+	double quantile(double q) const
+	{
+		uint64_t total = 0;
+		for (uint64_t count : m_buckets)
+		{
+			total += count;
+		}
+		if (total == 0)
+		{
+			return 0;
+		}
+
+		uint64_t target = uint64_t(q * total + 0.5);
+		uint64_t cumulative = 0;
+		for (size_t i = 0; i < Histogram::BOUNDS.size(); i++)
+		{
+			cumulative += m_buckets[i];
+			if (cumulative >= target)
+			{
+				return Histogram::BOUNDS[i] / 1000.0;
+			}
+		}
+
+		return Histogram::BOUNDS.back() / 1000.0;
+	}
+
+protected:
+	std::array<uint64_t, Histogram::BOUNDS.size() + 1> m_buckets = {};
+};
+
+struct LevelResult
+{
+	int streams = 0;
+	int connected = 0;            // 成功连入接收端的路数
+	double sent_pps = 0;          // 发送帧率(所有流合计)
+	double received_pps = 0;      // 接收帧率(所有流合计)
+	double expected_pps = 0;      // 标称帧率(所有流合计)
+	double mbps = 0;              // 发送码率(Mbps, 所有流合计)
+	double cpu_per_stream = 0;    // 每路推流占用CPU(单核百分比), 不含接收端线程
+	double cpu_total = 0;         // 进程CPU(单核百分比), 含接收端线程
+	double lateness[4] = {};      // 发送延迟p50/p90/p99/p99.9(毫秒)
+	double jitter[3] = {};        // 接收抖动p50/p99/p99.9(毫秒)
+	double write_p99 = 0;         // 写入耗时p99(毫秒)
+	int64_t write_errors = 0;
+	bool degraded = false;        // 节奏劣化或丢帧
+};
+
+static LevelResult run_level(const BenchConfig& config, const std::string& clip, int streams)
+{
+	LevelResult result;
+	result.streams = streams;
+	result.expected_pps = double(config.clip.fps) * streams;
+
+	// 先启动接收端, 推流端在建立输出时连入
+	std::vector<std::unique_ptr<RtspSink>> sinks;
+	for (int i = 0; i < streams; i++)
+	{
+		sinks.push_back(std::make_unique<RtspSink>());
+		sinks.back()->start(config.port + i);
+	}
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+	std::vector<std::unique_ptr<RtspSender>> senders;
+	for (int i = 0; i < streams; i++)
+	{
+		RTSPConfig rtspConfig;
+		rtspConfig.url = sinks[i]->url();
+		rtspConfig.video = clip;
+		rtspConfig.loop = 1000000;  // 测试期间一直循环
+		senders.push_back(std::make_unique<RtspSender>());
+		senders.back()->async_send_rtsp(rtspConfig);
+	}
+
+	std::this_thread::sleep_for(std::chrono::seconds(config.warmup));
+
+	// 预热结束, 记录统计起点
+	auto start = std::chrono::steady_clock::now();
+	int64_t cpuStart = process_cpu_time();
+	int64_t sinkCpuStart = 0;
+	int64_t framesStart = 0;
+	int64_t bytesStart = 0;
+	int64_t errorsStart = 0;
+	HistogramSum latenessStart, writeStart;
+	for (int i = 0; i < streams; i++)
+	{
+		const SenderStats& stats = senders[i]->stats();
+		framesStart += stats.frames.load();
+		bytesStart += stats.bytes.load();
+		errorsStart += stats.write_errors.load();
+		latenessStart.add(stats.lateness);
+		writeStart.add(stats.write_latency);
+
+		sinks[i]->reset_stats();
+		sinkCpuStart += sinks[i]->cpu_time();
+	}
+
+	std::this_thread::sleep_for(std::chrono::seconds(config.duration));
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	int64_t cpu = process_cpu_time() - cpuStart;
+	int64_t sinkCpu = -sinkCpuStart;
+	int64_t frames = -framesStart;
+	int64_t bytes = -bytesStart;
+	int64_t received = 0;
+	HistogramSum lateness, jitter, write;
+	result.write_errors = -errorsStart;
+	for (int i = 0; i < streams; i++)
+	{
+		const SenderStats& stats = senders[i]->stats();
+		frames += stats.frames.load();
+		bytes += stats.bytes.load();
+		result.write_errors += stats.write_errors.load();
+		lateness.add(stats.lateness);
+		write.add(stats.write_latency);
+
+		sinkCpu += sinks[i]->cpu_time();
+		received += sinks[i]->frames();
+		jitter.add(sinks[i]->jitter());
+		result.connected += sinks[i]->connected() ? 1 : 0;
+	}
+	lateness.subtract(latenessStart);
+	write.subtract(writeStart);
+
+	for (auto& sender : senders)
+	{
+		sender->stop();
+	}
+	for (auto& sink : sinks)
+	{
+		sink->stop();
+	}
+
+	result.sent_pps = frames / elapsed;
+	result.received_pps = received / elapsed;
+	result.mbps = bytes * 8 / elapsed / 1e6;
+	result.cpu_total = cpu / 1e4 / elapsed;
+	result.cpu_per_stream = std::max<int64_t>(0, cpu - sinkCpu) / 1e4 / elapsed / streams;
+	result.lateness[0] = lateness.quantile(0.5);
+	result.lateness[1] = lateness.quantile(0.9);
+	result.lateness[2] = lateness.quantile(0.99);
+	result.lateness[3] = lateness.quantile(0.999);
+	result.jitter[0] = jitter.quantile(0.5);
+	result.jitter[1] = jitter.quantile(0.99);
+	result.jitter[2] = jitter.quantile(0.999);
+	result.write_p99 = write.quantile(0.99);
+	result.degraded = result.connected < streams
+		|| result.lateness[2] > config.lateness_limit
+		|| result.received_pps < result.expected_pps * config.receive_limit;
+
+	return result;
+}
+
+static std::string to_json(const BenchConfig& config, const LevelResult& result)
+{
+	return fmt::format("{{\"codec\":\"{}\",\"width\":{},\"height\":{},\"fps\":{},\"gop\":{},\"bframes\":{},\"bitrate_kbps\":{},"
+		"\"cores\":{},\"streams\":{},\"connected\":{},\"expected_pps\":{:.1f},\"sent_pps\":{:.1f},\"received_pps\":{:.1f},\"mbps\":{:.2f},"
+		"\"cpu_total_pct\":{:.2f},\"cpu_per_stream_pct\":{:.3f},"
+		"\"lateness_ms\":{{\"p50\":{:.3f},\"p90\":{:.3f},\"p99\":{:.3f},\"p999\":{:.3f}}},"
+		"\"jitter_ms\":{{\"p50\":{:.3f},\"p99\":{:.3f},\"p999\":{:.3f}}},"
+		"\"write_p99_ms\":{:.3f},\"write_errors\":{},\"degraded\":{}}}",
+		config.clip.codec, config.clip.width, config.clip.height, config.clip.fps, config.clip.gop, config.clip.bframes, config.clip.bitrate,
+		std::thread::hardware_concurrency(), result.streams, result.connected, result.expected_pps, result.sent_pps, result.received_pps, result.mbps,
+		result.cpu_total, result.cpu_per_stream,
+		result.lateness[0], result.lateness[1], result.lateness[2], result.lateness[3],
+		result.jitter[0], result.jitter[1], result.jitter[2],
+		result.write_p99, result.write_errors, result.degraded ? "true" : "false");
+}
+
+int main(int argc, char* argv[])
+{
+	BenchConfig config;
+	if (!parse_args(argc, argv, config))
+	{
+		print_usage();
+		return 1;
+	}
+
+	// 日志输出到标准错误, 标准输出只有测试结果
+	spdlog::set_default_logger(spdlog::stderr_color_mt("bench"));
+	spdlog::set_pattern("[%H:%M:%S.%e] [%l] %v");
+
+	// 接收端经RTP只能得到PTS, B帧按解码顺序到达时PTS不单调
+	if (config.clip.bframes > 0)
+	{
+		spdlog::warn("--bframes {}: RTP carries no DTS, jitter_ms is computed from non-monotonic PTS and is not meaningful", config.clip.bframes);
+	}
+	av_log_set_level(AV_LOG_ERROR);
+	avformat_network_init();
+
+	std::filesystem::path dir = config.dir.empty() ? std::filesystem::temp_directory_path() : std::filesystem::path(config.dir);
+	std::string clip = (dir / SyntheticClipName(config.clip)).string();
+	spdlog::info("Preparing clip {}", clip);
+	int ret = MakeSyntheticClip(config.clip, clip);
+	if (ret != 0)
+	{
+		spdlog::error("Make clip failed: {}", ret);
+		return 2;
+	}
+
+	std::ofstream output;
+	if (!config.output.empty())
+	{
+		output.open(config.output, std::ios::app);
+	}
+
+	for (int streams : config.streams)
+	{
+		spdlog::info("Running {} streams", streams);
+		LevelResult result = run_level(config, clip, streams);
+
+		std::string line = to_json(config, result);
+		std::cout << line << std::endl;
+		if (output.is_open())
+		{
+			output << line << std::endl;
+		}
+
+		if (result.degraded && !config.all)
+		{
+			spdlog::info("Pacing degraded at {} streams", streams);
+			break;
+		}
+	}
+
+	return 0;
+}
\ No newline at end of file
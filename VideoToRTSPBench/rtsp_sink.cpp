@@ -0,0 +1,151 @@
+#include <chrono>
+#include <cstdlib>
+#include <spdlog/spdlog.h>
+#include "rtsp_sink.h"
+#include "cpu_time.h"
+
+extern "C"
+{
+#include "libavformat/avformat.h"
+};
+
+static constexpr int LISTEN_TIMEOUT = 1;  // 等待推流端连入的超时(秒), 超时后检查退出标志再重新监听
+
+// 阻塞中的ffmpeg调用在退出时返回
+static int interrupt_callback(void* opaque)
+{
+	return static_cast<std::atomic_bool*>(opaque)->load() ? 1 : 0;
+}
+
+RtspSink::~RtspSink()
+{
+	stop();
+}
+
+bool RtspSink::start(int port, const std::string& path)
+{
+	stop();
+
+	m_port = port;
+	m_path = path;
+	m_quit = false;
+	m_connected = false;
+	m_cpuTime = 0;
+	reset_stats();
+	t = std::thread(&RtspSink::receive, this);
+
+	return true;
+}
+
+void RtspSink::stop()
+{
+	m_quit = true;
+	if (t.joinable())
+	{
+		t.join();
+	}
+}
+
+std::string RtspSink::url() const
+{
+	return "rtsp://127.0.0.1:" + std::to_string(m_port) + "/" + m_path;
+}
+
+bool RtspSink::connected() const
+{
+	return m_connected;
+}
+
+int64_t RtspSink::frames() const
+{
+	return m_frames.load(std::memory_order_relaxed);
+}
+
+int64_t RtspSink::bytes() const
+{
+	return m_bytes.load(std::memory_order_relaxed);
+}
+
+int64_t RtspSink::cpu_time() const
+{
+	return m_cpuTime.load(std::memory_order_relaxed);
+}
+
+const Histogram& RtspSink::jitter() const
+{
+	return m_jitter;
+}
+
+void RtspSink::reset_stats()
+{
+	m_frames = 0;
+	m_bytes = 0;
+	m_jitter.reset();
+}
+
+void RtspSink::receive()
+{
+	AVFormatContext* pInFmtCtx = NULL;
+	AVDictionary* options = NULL;
+	AVPacket* packet = av_packet_alloc();
+	int64_t lastArrival = -1;   // 上一帧到达时间(微秒)
+	int64_t lastTs = 0;         // 上一帧时间戳(微秒)
+
+	// 等待推流端连入
+	while (!m_quit && pInFmtCtx == NULL)
+	{
+		pInFmtCtx = avformat_alloc_context();
+		if (pInFmtCtx == NULL)
+		{
+			goto end;
+		}
+		pInFmtCtx->interrupt_callback.callback = interrupt_callback;
+		pInFmtCtx->interrupt_callback.opaque = &m_quit;
+
+		av_dict_set(&options, "rtsp_flags", "listen", 0);
+		av_dict_set_int(&options, "listen_timeout", LISTEN_TIMEOUT, 0);
+		if (avformat_open_input(&pInFmtCtx, url().c_str(), NULL, &options) < 0)
+		{
+			pInFmtCtx = NULL;  // 失败时已释放
+		}
+		av_dict_free(&options);
+	}
+
+	if (pInFmtCtx == NULL || packet == NULL)
+	{
+		goto end;
+	}
+	m_connected = true;
+
+	while (!m_quit && av_read_frame(pInFmtCtx, packet) >= 0)
+	{
+		int64_t arrival = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+		// 按DTS(到达顺序单调)计算抖动; RTP只携带PTS, 解复用器没有给出DTS时按PTS, 含B帧时不准确(见--bframes)
+		int64_t packetTs = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+		if (packetTs != AV_NOPTS_VALUE)
+		{
+			int64_t ts = av_rescale_q(packetTs, pInFmtCtx->streams[packet->stream_index]->time_base, av_make_q(1, 1000000));
+			if (lastArrival >= 0)
+			{
+				m_jitter.observe(std::llabs((arrival - lastArrival) - (ts - lastTs)));
+			}
+			lastArrival = arrival;
+			lastTs = ts;
+		}
+
+		m_frames.fetch_add(1, std::memory_order_relaxed);
+		m_bytes.fetch_add(packet->size, std::memory_order_relaxed);
+		m_cpuTime.store(thread_cpu_time(), std::memory_order_relaxed);
+		av_packet_unref(packet);
+	}
+
+end:
+	m_connected = false;
+	m_cpuTime.store(thread_cpu_time(), std::memory_order_relaxed);
+	if (pInFmtCtx)
+	{
+		avformat_close_input(&pInFmtCtx);
+	}
+	av_packet_free(&packet);
+}
\ No newline at end of file
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include "metrics.h"
+
+// 本地RTSP接收端: ffmpeg RTSP解复用器以监听模式(rtsp_flags=listen)接收推流, 不需要mediamtx
+// 每个接收端占用一个端口和一个线程, 统计收到的帧数和到达抖动
+class RtspSink
+{
+public:
+	RtspSink() = default;
+	~RtspSink();
+
+	bool start(int port, const std::string& path = "bench");
+	void stop();
+
+	std::string url() const;               // 推流地址
+	bool connected() const;                // 是否已有推流端连入
+
+	int64_t frames() const;                // 收到的帧数
+	int64_t bytes() const;                 // 收到的数据量(Byte)
+	int64_t cpu_time() const;              // 接收线程已用CPU时间(微秒), 每帧更新
+	const Histogram& jitter() const;       // 到达抖动: 相邻两帧到达间隔与时间戳间隔之差(微秒)
+
+	void reset_stats();                    // 清空统计, 预热结束时调用
+
+protected:
+	void receive();
+
+protected:
+	int m_port = 0;
+	std::string m_path;
+	std::atomic_bool m_quit = false;
+	std::atomic_bool m_connected = false;
+	std::atomic<int64_t> m_frames = 0;
+	std::atomic<int64_t> m_bytes = 0;
+	std::atomic<int64_t> m_cpuTime = 0;
+	Histogram m_jitter;
+	std::thread t;
+};
\ No newline at end of file
@@ -0,0 +1,237 @@
+#include <filesystem>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include "synthetic_clip.h"
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/opt.h>
+}
+
+static constexpr int NOISE_BLOCK = 64;  // 噪声块边长(像素)
+
+// 优先使用x264/x265, 没有时使用ffmpeg内置的同类编码器
+static const AVCodec* find_encoder(const std::string& codec)
+{
+	if (codec == "hevc" || codec == "h265")
+	{
+		const AVCodec* encoder = avcodec_find_encoder_by_name("libx265");
+		return encoder ? encoder : avcodec_find_encoder(AV_CODEC_ID_HEVC);
+	}
+
+	const AVCodec* encoder = avcodec_find_encoder_by_name("libx264");
+	return encoder ? encoder : avcodec_find_encoder(AV_CODEC_ID_H264);
+}
+
+// 填充一帧: 斜向运动的渐变背景, 加一个随帧移动的噪声块
+static void fill_frame(AVFrame* frame, int index)
+{
+	for (int y = 0; y < frame->height; y++)
+	{
+		uint8_t* line = frame->data[0] + y * frame->linesize[0];
+		for (int x = 0; x < frame->width; x++)
+		{
+			line[x] = uint8_t(x + y + index * 4);
+		}
+	}
+
+	for (int y = 0; y < frame->height / 2; y++)
+	{
+		uint8_t* u = frame->data[1] + y * frame->linesize[1];
+		uint8_t* v = frame->data[2] + y * frame->linesize[2];
+		for (int x = 0; x < frame->width / 2; x++)
+		{
+			u[x] = uint8_t(128 + y / 4 + index);
+			v[x] = uint8_t(64 + x / 4 + index * 2);
+		}
+	}
+
+	// 固定种子的线性同余随机数, 同样参数生成的文件内容一致
+	uint32_t seed = uint32_t(index) * 2654435761u + 1;
+	int left = (index * 8) % std::max(1, frame->width - NOISE_BLOCK);
+	int top = (index * 4) % std::max(1, frame->height - NOISE_BLOCK);
+	for (int y = top; y < std::min(frame->height, top + NOISE_BLOCK); y++)
+	{
+		uint8_t* line = frame->data[0] + y * frame->linesize[0];
+		for (int x = left; x < std::min(frame->width, left + NOISE_BLOCK); x++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			line[x] = uint8_t(seed >> 24);
+		}
+	}
+}
+
+// 取出编码器输出的帧并写入文件
+static int write_packets(AVCodecContext* codecContext, AVFormatContext* pOutFmtCtx, AVPacket* packet)
+{
+	int ret = 0;
+	while ((ret = avcodec_receive_packet(codecContext, packet)) >= 0)
+	{
+		av_packet_rescale_ts(packet, codecContext->time_base, pOutFmtCtx->streams[0]->time_base);
+		packet->stream_index = 0;
+		ret = av_interleaved_write_frame(pOutFmtCtx, packet);
+		if (ret < 0)
+		{
+			return ret;
+		}
+	}
+
+	return (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) ? 0 : ret;
+}
+
+std::string SyntheticClipName(const ClipConfig& config)
+{
+	return "bench_" + config.codec + "_" + std::to_string(config.width) + "x" + std::to_string(config.height)
+		+ "_" + std::to_string(config.fps) + "fps_g" + std::to_string(config.gop) + "_b" + std::to_string(config.bframes)
+		+ "_" + std::to_string(config.bitrate) + "k_" + std::to_string(config.seconds) + "s.mp4";
+}
+
+int MakeSyntheticClip(const ClipConfig& config, const std::string& file)
+{
+	if (std::filesystem::exists(file))
+	{
+		return 0;
+	}
+
+	// 先写临时文件, 生成完成后改名, 中断时不会留下不完整的文件
+	std::string tmpFile = file + ".tmp.mp4";
+
+	AVFormatContext* pOutFmtCtx = NULL;
+	AVCodecContext* codecContext = NULL;
+	AVStream* pOutStream = NULL;
+	AVFrame* frame = NULL;
+	AVPacket* packet = NULL;
+	const AVCodec* codec = find_encoder(config.codec);
+	int frames = config.fps * config.seconds;
+	int ret = 0;
+
+	if (codec == NULL)
+	{
+		return 10;
+	}
+
+	if (avformat_alloc_output_context2(&pOutFmtCtx, NULL, "mp4", tmpFile.c_str()) < 0)
+	{
+		return 20;
+	}
+
+	codecContext = avcodec_alloc_context3(codec);
+	if (codecContext == NULL)
+	{
+		ret = 30;
+		goto end;
+	}
+
+	codecContext->width = config.width;
+	codecContext->height = config.height;
+	codecContext->pix_fmt = AV_PIX_FMT_YUV420P;
+	codecContext->time_base = av_make_q(1, config.fps);
+	codecContext->framerate = av_make_q(config.fps, 1);
+	codecContext->gop_size = config.gop;
+	codecContext->max_b_frames = config.bframes;
+	codecContext->bit_rate = int64_t(config.bitrate) * 1000;
+	if (pOutFmtCtx->oformat->flags & AVFMT_GLOBALHEADER)
+	{
+		codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+	}
+
+	// 固定GOP: 关闭场景切换插入关键帧
+	av_opt_set(codecContext->priv_data, "preset", "veryfast", 0);
+	av_opt_set(codecContext->priv_data, "x264-params", "scenecut=0", 0);
+	av_opt_set(codecContext->priv_data, "x265-params", "scenecut=0:open-gop=0:log-level=error", 0);
+
+	if (avcodec_open2(codecContext, codec, NULL) < 0)
+	{
+		ret = 40;
+		goto end;
+	}
+
+	pOutStream = avformat_new_stream(pOutFmtCtx, NULL);
+	if (pOutStream == NULL || avcodec_parameters_from_context(pOutStream->codecpar, codecContext) < 0)
+	{
+		ret = 50;
+		goto end;
+	}
+	pOutStream->time_base = codecContext->time_base;
+
+	if (avio_open(&pOutFmtCtx->pb, tmpFile.c_str(), AVIO_FLAG_WRITE) < 0)
+	{
+		ret = 60;
+		goto end;
+	}
+
+	if (avformat_write_header(pOutFmtCtx, NULL) < 0)
+	{
+		ret = 70;
+		goto end;
+	}
+
+	frame = av_frame_alloc();
+	packet = av_packet_alloc();
+	if (frame == NULL || packet == NULL)
+	{
+		ret = 80;
+		goto end;
+	}
+
+	frame->width = config.width;
+	frame->height = config.height;
+	frame->format = AV_PIX_FMT_YUV420P;
+	if (av_frame_get_buffer(frame, 0) < 0)
+	{
+		ret = 80;
+		goto end;
+	}
+
+	for (int i = 0; i < frames; i++)
+	{
+		if (av_frame_make_writable(frame) < 0)
+		{
+			ret = 80;
+			goto end;
+		}
+
+		fill_frame(frame, i);
+		frame->pts = i;
+		if (avcodec_send_frame(codecContext, frame) < 0 || write_packets(codecContext, pOutFmtCtx, packet) < 0)
+		{
+			ret = 90;
+			goto end;
+		}
+	}
+
+	// 取出编码器中缓存的帧
+	if (avcodec_send_frame(codecContext, NULL) < 0 || write_packets(codecContext, pOutFmtCtx, packet) < 0 || av_write_trailer(pOutFmtCtx) < 0)
+	{
+		ret = 90;
+		goto end;
+	}
+
+end:
+	av_packet_free(&packet);
+	av_frame_free(&frame);
+	avcodec_free_context(&codecContext);
+	if (pOutFmtCtx && !(pOutFmtCtx->oformat->flags & AVFMT_NOFILE))
+	{
+		avio_closep(&pOutFmtCtx->pb);
+	}
+	avformat_free_context(pOutFmtCtx);
+
+	std::error_code ec;
+	if (ret == 0)
+	{
+		std::filesystem::rename(tmpFile, file, ec);
+		if (ec)
+		{
+			ret = 100;
+		}
+	}
+	else
+	{
+		std::filesystem::remove(tmpFile, ec);
+	}
+
+	return ret;
+}
\ No newline at end of file
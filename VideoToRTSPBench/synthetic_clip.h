@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+struct ClipConfig
+{
+	std::string codec = "h264";  // h264 / hevc
+	int width = 1920;            // 画面宽度
+	int height = 1080;           // 画面高度
+	int fps = 25;                // 帧率
+	int gop = 50;                // 关键帧间隔(帧)
+	int bframes = 0;             // 连续B帧数量
+	int bitrate = 4000;          // 码率(kbps)
+	int seconds = 10;            // 时长(秒)
+};
+
+// 生成测试视频(MP4), 画面为运动渐变加噪声块, 码率接近真实监控画面
+// 同样参数的文件已存在时直接复用; 成功返回0
+int MakeSyntheticClip(const ClipConfig& config, const std::string& file);
+
+// 按参数生成文件名, 如 bench_h264_1920x1080_25fps_g50_b0_4000k_10s.mp4
+std::string SyntheticClipName(const ClipConfig& config);
\ No newline at end of file
@@ -0,0 +1,466 @@
+#include <cmath>
+#include <cstdint>
+#include <charconv>
+#include "json.h"
+
+static const JsonValue NULL_VALUE;
+static const std::string EMPTY_STRING;
+static const std::vector<JsonValue> EMPTY_ARRAY;
+
+static constexpr int MAX_DEPTH = 64;  // 最大嵌套层数
+
+class JsonParser
+{
+public:
+	explicit JsonParser(const std::string& text) :m_text(text)
+	{
+	}
+
+	bool parse(JsonValue& value, std::string& error)
+	{
+		skip_space();
+		if (!parse_value(value, 0))
+		{
+			error = position() + ": " + m_error;
+			return false;
+		}
+
+		skip_space();
+		if (m_pos != m_text.size())
+		{
+			error = position() + ": unexpected trailing characters";
+			return false;
+		}
+
+		return true;
+	}
+
+protected:
+	// 行号和列号, 从1开始
+	std::string position() const
+	{
+		int line = 1;
+		int column = 1;
+		for (size_t i = 0; i < m_pos && i < m_text.size(); i++)
+		{
+			if (m_text[i] == '\n')
+			{
+				line++;
+				column = 1;
+			}
+			else
+			{
+				column++;
+			}
+		}
+
+		return "line " + std::to_string(line) + ", column " + std::to_string(column);
+	}
+
+	bool fail(const std::string& error)
+	{
+		m_error = error;
+		return false;
+	}
+
+	void skip_space()
+	{
+		while (m_pos < m_text.size())
+		{
+			char c = m_text[m_pos];
+			if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+			{
+				m_pos++;
+			}
+			else
+			{
+				break;
+			}
+		}
+	}
+
+	bool match(const char* word)
+	{
+		size_t len = std::char_traits<char>::length(word);
+		if (m_text.compare(m_pos, len, word) != 0)
+		{
+			return false;
+		}
+
+		m_pos += len;
+		return true;
+	}
+
+	bool parse_value(JsonValue& value, int depth)
+	{
+		if (depth > MAX_DEPTH)
+		{
+			return fail("nesting too deep");
+		}
+
+		if (m_pos >= m_text.size())
+		{
+			return fail("unexpected end of input");
+		}
+
+		char c = m_text[m_pos];
+		if (c == '{')
+		{
+			return parse_object(value, depth);
+		}
+		if (c == '[')
+		{
+			return parse_array(value, depth);
+		}
+		if (c == '"')
+		{
+			value.m_type = JsonValue::Type::String;
+			return parse_string(value.m_string);
+		}
+		if (match("true"))
+		{
+			value.m_type = JsonValue::Type::Bool;
+			value.m_bool = true;
+			return true;
+		}
+		if (match("false"))
+		{
+			value.m_type = JsonValue::Type::Bool;
+			value.m_bool = false;
+			return true;
+		}
+		if (match("null"))
+		{
+			value.m_type = JsonValue::Type::Null;
+			return true;
+		}
+
+		return parse_number(value);
+	}
+
+	// 按JSON语法检查: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?, 不接受nan/inf/十六进制/前导+
+	// 转换不受C locale影响, 超出double范围视为错误
+	bool parse_number(JsonValue& value)
+	{
+		auto digit = [this](size_t pos) { return pos < m_text.size() && m_text[pos] >= '0' && m_text[pos] <= '9'; };
+		auto digits = [this, &digit](size_t& pos)
+			{
+				size_t begin = pos;
+				while (digit(pos))
+				{
+					pos++;
+				}
+				return pos > begin;
+			};
+
+		size_t pos = m_pos;
+		if (pos < m_text.size() && m_text[pos] == '-')
+		{
+			pos++;
+		}
+
+		if (pos < m_text.size() && m_text[pos] == '0')
+		{
+			pos++;
+		}
+		else if (!digits(pos))
+		{
+			return fail("invalid value");
+		}
+
+		if (pos < m_text.size() && m_text[pos] == '.')
+		{
+			pos++;
+			if (!digits(pos))
+			{
+				return fail("invalid number");
+			}
+		}
+
+		if (pos < m_text.size() && (m_text[pos] == 'e' || m_text[pos] == 'E'))
+		{
+			pos++;
+			if (pos < m_text.size() && (m_text[pos] == '+' || m_text[pos] == '-'))
+			{
+				pos++;
+			}
+			if (!digits(pos))
+			{
+				return fail("invalid number");
+			}
+		}
+
+		double number = 0;
+		const char* begin = m_text.data() + m_pos;
+		std::from_chars_result result = std::from_chars(begin, m_text.data() + pos, number);
+		if (result.ec != std::errc() || result.ptr != m_text.data() + pos || !std::isfinite(number))
+		{
+			return fail("number out of range");
+		}
+
+		m_pos = pos;
+		value.m_type = JsonValue::Type::Number;
+		value.m_number = number;
+		return true;
+	}
+
+	// \uXXXX转UTF-8, 支持代理对
+	bool parse_unicode(std::string& out)
+	{
+		auto hex4 = [this](uint32_t& code)
+			{
+				if (m_pos + 4 > m_text.size())
+				{
+					return false;
+				}
+
+				code = 0;
+				for (int i = 0; i < 4; i++)
+				{
+					char c = m_text[m_pos++];
+					code <<= 4;
+					if (c >= '0' && c <= '9') code |= c - '0';
+					else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+					else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+					else return false;
+				}
+				return true;
+			};
+
+		uint32_t code = 0;
+		if (!hex4(code))
+		{
+			return fail("invalid \\u escape");
+		}
+
+		if (code >= 0xD800 && code <= 0xDBFF)
+		{
+			uint32_t low = 0;
+			if (!match("\\u") || !hex4(low) || low < 0xDC00 || low > 0xDFFF)
+			{
+				return fail("invalid surrogate pair");
+			}
+			code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+		}
+
+		if (code < 0x80)
+		{
+			out += char(code);
+		}
+		else if (code < 0x800)
+		{
+			out += char(0xC0 | (code >> 6));
+			out += char(0x80 | (code & 0x3F));
+		}
+		else if (code < 0x10000)
+		{
+			out += char(0xE0 | (code >> 12));
+			out += char(0x80 | ((code >> 6) & 0x3F));
+			out += char(0x80 | (code & 0x3F));
+		}
+		else
+		{
+			out += char(0xF0 | (code >> 18));
+			out += char(0x80 | ((code >> 12) & 0x3F));
+			out += char(0x80 | ((code >> 6) & 0x3F));
+			out += char(0x80 | (code & 0x3F));
+		}
+
+		return true;
+	}
+
+	bool parse_string(std::string& out)
+	{
+		m_pos++;  // 跳过引号
+		out.clear();
+		while (m_pos < m_text.size())
+		{
+			char c = m_text[m_pos++];
+			if (c == '"')
+			{
+				return true;
+			}
+
+			if (c != '\\')
+			{
+				out += c;
+				continue;
+			}
+
+			if (m_pos >= m_text.size())
+			{
+				break;
+			}
+
+			char e = m_text[m_pos++];
+			switch (e)
+			{
+			case '"': out += '"'; break;
+			case '\\': out += '\\'; break;
+			case '/': out += '/'; break;
+			case 'b': out += '\b'; break;
+			case 'f': out += '\f'; break;
+			case 'n': out += '\n'; break;
+			case 'r': out += '\r'; break;
+			case 't': out += '\t'; break;
+			case 'u':
+				if (!parse_unicode(out))
+				{
+					return false;
+				}
+				break;
+			default:
+				return fail("invalid escape");
+			}
+		}
+
+		return fail("unterminated string");
+	}
+
+	bool parse_array(JsonValue& value, int depth)
+	{
+		m_pos++;
+		value.m_type = JsonValue::Type::Array;
+		skip_space();
+		if (match("]"))
+		{
+			return true;
+		}
+
+		while (true)
+		{
+			JsonValue item;
+			skip_space();
+			if (!parse_value(item, depth + 1))
+			{
+				return false;
+			}
+			value.m_array.push_back(std::move(item));
+
+			skip_space();
+			if (match("]"))
+			{
+				return true;
+			}
+			if (!match(","))
+			{
+				return fail("expected ',' or ']'");
+			}
+		}
+	}
+
+	bool parse_object(JsonValue& value, int depth)
+	{
+		m_pos++;
+		value.m_type = JsonValue::Type::Object;
+		skip_space();
+		if (match("}"))
+		{
+			return true;
+		}
+
+		while (true)
+		{
+			std::string key;
+			skip_space();
+			if (m_pos >= m_text.size() || m_text[m_pos] != '"')
+			{
+				return fail("expected string key");
+			}
+			if (!parse_string(key))
+			{
+				return false;
+			}
+
+			skip_space();
+			if (!match(":"))
+			{
+				return fail("expected ':'");
+			}
+
+			JsonValue item;
+			skip_space();
+			if (!parse_value(item, depth + 1))
+			{
+				return false;
+			}
+			value.m_object[key] = std::move(item);
+
+			skip_space();
+			if (match("}"))
+			{
+				return true;
+			}
+			if (!match(","))
+			{
+				return fail("expected ',' or '}'");
+			}
+		}
+	}
+
+protected:
+	const std::string& m_text;
+	size_t m_pos = 0;
+	std::string m_error;
+};
+
+bool JsonValue::as_bool(bool def) const
+{
+	return m_type == Type::Bool ? m_bool : def;
+}
+
+double JsonValue::as_number(double def) const
+{
+	return m_type == Type::Number ? m_number : def;
+}
+
+// 超出int64_t范围时取边界值, 避免浮点转整数的未定义行为
+int64_t JsonValue::as_int(int64_t def) const
+{
+	if (m_type != Type::Number || std::isnan(m_number))
+	{
+		return def;
+	}
+
+	if (m_number >= 9223372036854775807.0)
+	{
+		return INT64_MAX;
+	}
+	if (m_number <= -9223372036854775808.0)
+	{
+		return INT64_MIN;
+	}
+	return int64_t(m_number);
+}
+
+const std::string& JsonValue::as_string() const
+{
+	return m_type == Type::String ? m_string : EMPTY_STRING;
+}
+
+const std::vector<JsonValue>& JsonValue::as_array() const
+{
+	return m_type == Type::Array ? m_array : EMPTY_ARRAY;
+}
+
+bool JsonValue::contains(const std::string& key) const
+{
+	return m_type == Type::Object && m_object.count(key) > 0;
+}
+
+const JsonValue& JsonValue::operator[](const std::string& key) const
+{
+	if (m_type != Type::Object)
+	{
+		return NULL_VALUE;
+	}
+
+	auto it = m_object.find(key);
+	return it != m_object.end() ? it->second : NULL_VALUE;
+}
+
+bool JsonValue::parse(const std::string& text, JsonValue& value, std::string& error)
+{
+	value = JsonValue();
+	return JsonParser(text).parse(value, error);
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// 最小JSON解析, 只用于读取配置文件
+class JsonValue
+{
+public:
+	enum class Type
+	{
+		Null,
+		Bool,
+		Number,
+		String,
+		Array,
+		Object
+	};
+
+	Type type() const { return m_type; }
+	bool is_null() const { return m_type == Type::Null; }
+	bool is_number() const { return m_type == Type::Number; }
+	bool is_string() const { return m_type == Type::String; }
+	bool is_array() const { return m_type == Type::Array; }
+	bool is_object() const { return m_type == Type::Object; }
+
+	bool as_bool(bool def = false) const;
+	double as_number(double def = 0) const;
+	int64_t as_int(int64_t def = 0) const;
+	const std::string& as_string() const;               // 非字符串返回空串
+	const std::vector<JsonValue>& as_array() const;     // 非数组返回空数组
+
+	bool contains(const std::string& key) const;
+	const JsonValue& operator[](const std::string& key) const;  // 不存在时返回null
+
+	// 解析失败返回false, error为错误位置和原因
+	static bool parse(const std::string& text, JsonValue& value, std::string& error);
+
+protected:
+	friend class JsonParser;
+
+	Type m_type = Type::Null;
+	bool m_bool = false;
+	double m_number = 0;
+	std::string m_string;
+	std::vector<JsonValue> m_array;
+	std::map<std::string, JsonValue> m_object;
+};
\ No newline at end of file
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/sinks/basic_file_sink.h>
+#include "send_rtsp.h"
+#include "metrics.h"
+#include "rtsp_server.h"
+#include "video_info_cache.h"
+#include "server_config.h"
+
+extern "C"
+{
+#include "libavformat/avformat.h"
+};
+
+// 无界面推流服务: 按配置文件启动所有推流, 收到SIGINT/SIGTERM或全部推流结束时退出
+static std::atomic_bool g_quit = false;
+
+static void on_signal(int)
+{
+	g_quit = true;
+}
+
+static void print_usage()
+{
+	fprintf(stderr, "Usage: videotortsp-server <config.json> [--log file]\n");
+}
+
+int main(int argc, char* argv[])
+{
+	std::string configFile;
+	std::string logFile;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--log" && i + 1 < argc)
+		{
+			logFile = argv[++i];
+		}
+		else if (configFile.empty() && arg.rfind("--", 0) != 0)
+		{
+			configFile = arg;
+		}
+		else
+		{
+			print_usage();
+			return 1;
+		}
+	}
+
+	if (configFile.empty())
+	{
+		print_usage();
+		return 1;
+	}
+
+	// 日志设置
+	auto logger = logFile.empty() ? spdlog::stdout_color_mt("server") : spdlog::basic_logger_mt("server", logFile);
+	spdlog::set_default_logger(logger);
+	spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%l] %v");
+	spdlog::flush_every(std::chrono::seconds(1));
+	av_log_set_level(AV_LOG_ERROR);
+	avformat_network_init();
+
+	ServerConfig config;
+	std::string error;
+	if (!LoadServerConfig(configFile, config, error))
+	{
+		spdlog::error("Load config failed: {}", error);
+		return 1;
+	}
+
+	if (config.streams.empty())
+	{
+		spdlog::error("No streams in {}", configFile);
+		return 1;
+	}
+
+	if (!config.info_cache.empty())
+	{
+		VideoInfoCache::instance().load(config.info_cache);
+	}
+
+	// 内置RTSP服务, 指向本机该端口的流地址直接由推流器写入
+	RtspServer::instance().set_gop_cache(size_t(std::max<int64_t>(config.gop_cache, 0)));
+	if (config.rtsp_port > 0 && !RtspServer::instance().start(config.rtsp_port))
+	{
+		return 1;
+	}
+
+	// 总出口限速, 桶容量为10毫秒的发送量
+	if (config.shape_total_mbps > 0)
+	{
+		int64_t rate = int64_t(config.shape_total_mbps * 1000000 / 8);
+		TokenBucket::global().configure(rate, rate / 100);
+	}
+
+	if (config.metrics_port > 0)
+	{
+		MetricsServer::instance().start(config.metrics_port, config.summary_interval);
+	}
+
+	std::signal(SIGINT, on_signal);
+	std::signal(SIGTERM, on_signal);
+
+	// 错开开始时间: 第k个地址(共n个)延迟 k/n 个GOP
+	size_t urlCount = 0;
+	for (const auto& stream : config.streams)
+	{
+		urlCount += stream.urls.size();
+	}
+
+	// 启动推流, 同一视频的多个地址由一个推流器分发
+	std::vector<std::unique_ptr<RtspSender>> senders;
+	size_t urlIndex = 0;
+	for (const auto& stream : config.streams)
+	{
+		std::vector<int> phases(stream.urls.size(), 0);   // 各地址的相位(毫秒)
+		if (config.stagger_start)
+		{
+			// 无法统计GOP(如全部为关键帧)时按1秒错开; 转码时按档位的关键帧间隔
+			double gop = stream.pattern ? double(stream.patternConfig.gop) / stream.patternConfig.fps
+				: !stream.ladder.empty() ? stream.ladder[stream.rendition].gop : GetGopDuration(stream.file);
+			gop = gop > 0 ? gop : 1.0;
+			for (size_t i = 0; i < phases.size(); i++)
+			{
+				phases[i] = int(gop * 1000 * (urlIndex + i) / urlCount);
+			}
+		}
+		urlIndex += stream.urls.size();
+
+		RTSPConfig rtspConfig;
+		rtspConfig.video = stream.file;
+		rtspConfig.source = stream.pattern ? SourceType::Pattern : !stream.ladder.empty() ? SourceType::Transcode : SourceType::File;
+		rtspConfig.pattern = stream.patternConfig;
+		rtspConfig.ladder = stream.ladder;
+		rtspConfig.rendition = stream.rendition;
+		rtspConfig.url = stream.urls.front();
+		rtspConfig.loop = stream.loop;
+		rtspConfig.speed = stream.speed;
+		rtspConfig.start_offset = stream.start_offset;
+		rtspConfig.end_offset = stream.end_offset;
+		rtspConfig.cache_limit = config.cache_limit;
+		rtspConfig.prefetch_ms = config.prefetch_ms;
+		rtspConfig.shape_peak = config.shape_peak;
+		rtspConfig.repeat_headers = config.repeat_headers;
+		rtspConfig.start_delay_ms = phases.front();
+
+		// 同一推流器的其他地址按相对第一个地址的相位延迟输出
+		auto sender = std::make_unique<RtspSender>();
+		sender->async_send_rtsp(rtspConfig);
+		for (size_t i = 1; i < stream.urls.size(); i++)
+		{
+			sender->add_output(stream.urls[i], phases[i] - phases.front());
+		}
+
+		std::string name = stream.ladder.empty() ? stream.file : stream.file + " [" + stream.ladder[stream.rendition].name() + "]";
+		spdlog::info("Start {} -> {} url(s), loop {}, speed {}", name, stream.urls.size(), stream.loop, stream.speed > 0 ? fmt::format("{}x", stream.speed) : std::string("max"));
+		senders.push_back(std::move(sender));
+	}
+
+	// 等待退出信号或全部推流结束(推流结束、打开失败或所有输出失效时输出数量归零)
+	while (!g_quit)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+		size_t running = 0;
+		for (auto& sender : senders)
+		{
+			running += sender->output_count() > 0 ? 1 : 0;
+		}
+
+		if (running == 0)
+		{
+			spdlog::info("All streams finished");
+			break;
+		}
+	}
+
+	for (auto& sender : senders)
+	{
+		sender->stop();
+	}
+	senders.clear();
+
+	RtspServer::instance().stop();
+	MetricsServer::instance().stop();
+	VideoInfoCache::instance().save();
+	spdlog::info("Server exit");
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,249 @@
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <limits>
+#include <algorithm>
+#include "server_config.h"
+#include "json.h"
+
+// "url"可以是字符串或字符串数组
+static void parse_urls(const JsonValue& url, std::vector<std::string>& urls)
+{
+	if (url.is_string())
+	{
+		urls.push_back(url.as_string());
+	}
+	for (const auto& value : url.as_array())
+	{
+		if (!value.as_string().empty())
+		{
+			urls.push_back(value.as_string());
+		}
+	}
+}
+
+static bool parse_rendition(const JsonValue& item, const std::string& name, Rendition& rendition, std::vector<std::string>& urls, std::string& error)
+{
+	if (!item.is_object())
+	{
+		error = name + ": expected an object";
+		return false;
+	}
+
+	rendition.codec = item["codec"].as_string().empty() ? rendition.codec : item["codec"].as_string();
+	rendition.width = int(item["width"].as_int(rendition.width));
+	rendition.height = int(item["height"].as_int(rendition.height));
+	rendition.bitrate = int(item["bitrate"].as_int(rendition.bitrate));
+	rendition.gop = item["gop"].as_number(rendition.gop);
+	if ((rendition.codec != "h264" && rendition.codec != "hevc" && rendition.codec != "h265")
+		|| rendition.width < 0 || rendition.height < 0 || rendition.bitrate <= 0 || rendition.gop <= 0)
+	{
+		error = name + ": invalid rendition";
+		return false;
+	}
+
+	parse_urls(item["url"], urls);
+	if (urls.empty() || urls.front().empty())
+	{
+		error = name + ": missing \"url\"";
+		return false;
+	}
+
+	return true;
+}
+
+// 解析一个条目, 转码条目按档位展开为多路推流
+static bool parse_stream(const JsonValue& item, size_t index, std::vector<StreamEntry>& entries, std::string& error)
+{
+	std::string name = "streams[" + std::to_string(index) + "]";
+	StreamEntry entry;
+	if (!item.is_object())
+	{
+		error = name + ": expected an object";
+		return false;
+	}
+
+	const JsonValue& pattern = item["pattern"];
+	if (pattern.is_object())
+	{
+		PatternConfig& config = entry.patternConfig;
+		config.codec = pattern["codec"].as_string().empty() ? config.codec : pattern["codec"].as_string();
+		config.width = int(pattern["width"].as_int(config.width));
+		config.height = int(pattern["height"].as_int(config.height));
+		config.fps = int(pattern["fps"].as_int(config.fps));
+		config.gop = int(pattern["gop"].as_int(config.gop));
+		config.bitrate = int(pattern["bitrate"].as_int(config.bitrate));
+		config.id = int(pattern["id"].as_int(config.id));
+		if (config.width <= 0 || config.height <= 0 || config.fps <= 0 || config.gop <= 0 || config.bitrate <= 0)
+		{
+			error = name + ": invalid \"pattern\"";
+			return false;
+		}
+
+		entry.pattern = true;
+		entry.file = config.name();
+	}
+	else
+	{
+		entry.file = item["file"].as_string();
+	}
+
+	if (entry.file.empty())
+	{
+		error = name + ": missing \"file\" or \"pattern\"";
+		return false;
+	}
+
+	// 转码条目的地址写在各档位中
+	const JsonValue& transcode = item["transcode"];
+	if (transcode.is_array() && entry.pattern)
+	{
+		error = name + ": \"transcode\" requires \"file\"";
+		return false;
+	}
+
+	parse_urls(item["url"], entry.urls);
+	if (!transcode.is_array() && (entry.urls.empty() || entry.urls.front().empty()))
+	{
+		error = name + ": missing \"url\"";
+		return false;
+	}
+
+	int64_t loop = item["loop"].as_int(1);
+	entry.loop = loop <= 0 ? std::numeric_limits<int>::max() : int(std::min<int64_t>(loop, std::numeric_limits<int>::max()));
+
+	entry.speed = item["speed"].as_number(1.0);
+
+	entry.start_offset = item["start_offset"].as_number(0);
+	entry.end_offset = item["end_offset"].as_number(0);
+	if (entry.start_offset < 0 || entry.end_offset < 0 || (entry.end_offset > 0 && entry.end_offset <= entry.start_offset))
+	{
+		error = name + ": invalid \"start_offset\"/\"end_offset\"";
+		return false;
+	}
+
+	if (!transcode.is_array())
+	{
+		entries.push_back(std::move(entry));
+		return true;
+	}
+
+	if (entry.start_offset > 0 || entry.end_offset > 0)
+	{
+		error = name + ": \"start_offset\"/\"end_offset\" not supported with \"transcode\"";
+		return false;
+	}
+
+	const auto& items = transcode.as_array();
+	if (items.empty())
+	{
+		error = name + ": empty \"transcode\"";
+		return false;
+	}
+
+	std::vector<std::vector<std::string>> urls(items.size());
+	entry.ladder.resize(items.size());
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		if (!parse_rendition(items[i], name + ".transcode[" + std::to_string(i) + "]", entry.ladder[i], urls[i], error))
+		{
+			return false;
+		}
+	}
+
+	// 每个档位一路推流, 共享同一个转码梯度
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		StreamEntry rendition = entry;
+		rendition.rendition = i;
+		rendition.urls = urls[i];
+		entries.push_back(std::move(rendition));
+	}
+
+	return true;
+}
+
+// 档位列表相同才能合并
+static bool same_ladder(const std::vector<Rendition>& a, const std::vector<Rendition>& b)
+{
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const Rendition& x, const Rendition& y) { return x.name() == y.name(); });
+}
+
+bool LoadServerConfig(const std::string& file, ServerConfig& config, std::string& error)
+{
+	std::ifstream is(std::filesystem::path(file), std::ios::binary);
+	if (!is)
+	{
+		error = "cannot open " + file;
+		return false;
+	}
+
+	std::stringstream ss;
+	ss << is.rdbuf();
+
+	JsonValue root;
+	if (!JsonValue::parse(ss.str(), root, error))
+	{
+		error = file + ": " + error;
+		return false;
+	}
+
+	const JsonValue* streams = &root;
+	if (root.is_object())
+	{
+		config.rtsp_port = int(root["rtsp_port"].as_int(config.rtsp_port));
+		config.metrics_port = int(root["metrics_port"].as_int(config.metrics_port));
+		config.summary_interval = int(root["summary_interval"].as_int(config.summary_interval));
+		config.cache_limit = root["cache_limit_mb"].as_int(config.cache_limit / (1024 * 1024)) * 1024 * 1024;
+		config.prefetch_ms = int(root["prefetch_ms"].as_int(config.prefetch_ms));
+		config.shape_peak = root["shape_peak"].as_number(config.shape_peak);
+		config.shape_total_mbps = root["shape_total_mbps"].as_number(config.shape_total_mbps);
+		config.stagger_start = root["stagger_start"].as_bool(config.stagger_start);
+		config.repeat_headers = root["repeat_headers"].as_bool(config.repeat_headers);
+		config.gop_cache = root["gop_cache_mb"].as_int(config.gop_cache / (1024 * 1024)) * 1024 * 1024;
+		config.info_cache = root["info_cache"].as_string();
+		streams = &root["streams"];
+	}
+
+	if (!streams->is_array())
+	{
+		error = file + ": expected a \"streams\" array";
+		return false;
+	}
+
+	// 合并同一视频、同一循环次数、回放速度、推流区间和转码档位的条目
+	config.streams.clear();
+	const auto& items = streams->as_array();
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		std::vector<StreamEntry> entries;
+		if (!parse_stream(items[i], i, entries, error))
+		{
+			error = file + ": " + error;
+			return false;
+		}
+
+		for (auto& entry : entries)
+		{
+			bool merged = false;
+			for (auto& stream : config.streams)
+			{
+				if (stream.file == entry.file && stream.loop == entry.loop && stream.speed == entry.speed
+					&& stream.start_offset == entry.start_offset && stream.end_offset == entry.end_offset
+					&& stream.rendition == entry.rendition && same_ladder(stream.ladder, entry.ladder))
+				{
+					stream.urls.insert(stream.urls.end(), entry.urls.begin(), entry.urls.end());
+					merged = true;
+					break;
+				}
+			}
+
+			if (!merged)
+			{
+				config.streams.push_back(std::move(entry));
+			}
+		}
+	}
+
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "test_pattern.h"
+#include "transcoder.h"
+
+// 一路推流: 同一视频可推送到多个地址, 只解复用一次
+struct StreamEntry
+{
+	std::string file;                // 本地视频; 测试图案时为图案名称
+	bool pattern = false;            // 使用生成的测试图案, 不读取文件
+	PatternConfig patternConfig;     // 测试图案参数
+	std::vector<Rendition> ladder;   // 转码档位, 非空时本地视频解码一次后按各档位重新编码
+	size_t rendition = 0;            // 本路推送的档位, 每个档位一路推流
+	std::vector<std::string> urls;   // 流地址
+	int loop = 1;                    // 循环次数, 配置<=0表示一直循环
+	double speed = 1.0;              // 回放速度倍数, 配置<=0表示不限速(压力测试)
+	double start_offset = 0;         // 推流区间开始(秒), 从之前最近的关键帧开始
+	double end_offset = 0;           // 推流区间结束(秒), 0表示到文件末尾
+};
+
+// 无界面推流服务配置, JSON格式:
+// {
+//   "rtsp_port": 8554,
+//   "metrics_port": 9101,
+//   "summary_interval": 60,
+//   "cache_limit_mb": 256,
+//   "prefetch_ms": 500,
+//   "shape_peak": 2.0,
+//   "shape_total_mbps": 0,
+//   "stagger_start": true,
+//   "repeat_headers": false,
+//   "gop_cache_mb": 8,
+//   "info_cache": "videotortsp-server.cache",
+//   "streams": [
+//     { "file": "/data/a.mp4", "url": "rtsp://127.0.0.1:8554/a", "loop": 0 },
+//     { "file": "/data/b.mp4", "url": ["rtsp://127.0.0.1:8554/b1", "rtsp://127.0.0.1:8554/b2"], "loop": 3 },
+//     { "file": "/data/c.mp4", "url": "rtsp://10.0.0.2:8554/c", "loop": 0, "speed": 4 },
+//     { "file": "/data/d.ts", "url": "rtsp://127.0.0.1:8554/d", "loop": 0, "start_offset": 3600, "end_offset": 3620 },
+//     { "pattern": { "codec": "h264", "width": 1280, "height": 720, "fps": 25, "gop": 50, "bitrate": 2000, "id": 7 }, "url": "rtsp://127.0.0.1:8554/p7", "loop": 0 },
+//     { "file": "/data/e.avi", "loop": 0, "transcode": [
+//         { "codec": "h264", "height": 1080, "bitrate": 4000, "gop": 2, "url": "rtsp://127.0.0.1:8554/e/main" },
+//         { "codec": "h264", "height": 360, "bitrate": 512, "url": "rtsp://127.0.0.1:8554/e/sub" } ] }
+//   ]
+// }
+// 也可以直接写streams数组; file、loop、speed和推流区间相同的条目合并为一路推流
+// start_offset/end_offset(秒)只推送文件中的一段, 循环时只重复该段; 关键帧索引保存在info_cache中
+// pattern代替file时推送生成的测试图案(彩条、流编号和时间码), 参数相同的推流共享一份编码结果, loop为GOP回放次数
+// transcode为转码档位列表(width/height只给一边时保持宽高比, gop为关键帧间隔秒数), 每个档位推送到自己的url
+// 视频只解码一次, 各档位由编码线程池编码; 用于MPEG-4/MJPEG等编码格式或模拟多码流网络摄像机, 不支持推流区间
+struct ServerConfig
+{
+	int rtsp_port = 8554;                     // 内置RTSP服务端口, 0表示不启动(推送到外部服务)
+	int metrics_port = 9101;                  // 指标服务端口, 0表示不启动
+	int summary_interval = 60;                // 指标摘要日志间隔(秒)
+	int64_t cache_limit = 256 * 1024 * 1024;  // 循环推流内存缓存上限(Byte)
+	int prefetch_ms = 500;                    // 预读时长(毫秒)
+	double shape_peak = 0;                    // 流量整形峰均比, 0表示不整形
+	double shape_total_mbps = 0;              // 内置RTSP服务总出口码率上限(Mbps), 0表示不限
+	bool stagger_start = false;               // 各地址开始时间在一个GOP内均匀错开, 避免关键帧同时突发
+	bool repeat_headers = false;              // 推送到外部服务时每个关键帧前重复参数集(码流过滤器)
+	int64_t gop_cache = 8 * 1024 * 1024;      // 内置RTSP服务每路GOP缓存上限(Byte), 新客户端从最近的关键帧立即开始; 0表示不缓存
+	std::string info_cache;                   // 视频信息缓存文件, 为空时不保存
+	std::vector<StreamEntry> streams;
+};
+
+bool LoadServerConfig(const std::string& file, ServerConfig& config, std::string& error);
\ No newline at end of file